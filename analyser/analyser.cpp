@@ -1,11 +1,23 @@
 #include "analyser.h"
+#include "src/exception.h"
+#include "src/util/util.hpp"
 
 #include <climits>
 
 namespace cc0 {
     std::pair<std::pair<std::vector<Constants>, std::vector<Function>>, std::optional<CompilationError>>
     Analyser::Analyse() {
-        auto err = analyseProgram();
+        std::optional<CompilationError> err;
+        try {
+            err = analyseProgram();
+        }
+        catch (const std::bad_optional_access &) {
+            // token 流在词法错误处提前结束，分析时可能取到不存在的 token
+            // 与一次读入所有 token 一样，这时报告词法错误
+            err = _tokens.drain();
+            if (!err.has_value())
+                throw;
+        }
         if (err.has_value())
             return std::make_pair(std::make_pair(std::vector<Constants>(), std::vector<Function>()), err);
         else
@@ -18,12 +30,21 @@ namespace cc0 {
         auto varErr = analyseVariableDeclaration();
         if (varErr.has_value())
             return varErr;
+        // 链接时各文件的全局变量依次排列
+        _globalsSize = _nextTokenIndex;
 
         _isStart = false;
         auto err = analyseFunction();
         if (err.has_value())
             return err;
 
+        // 目标文件的 main 和只声明的函数可以在其他文件中
+        if (_object)
+            return {};
+        for (auto &it : _functions) {
+            if (it.isDeclaration())
+                return std::make_optional<CompilationError>(_declarationPos.at(it.getIndex()), ErrorCode::ErrFunctionNotDefined);
+        }
         if (!isFunction("main"))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedMain);
 
@@ -33,6 +54,8 @@ namespace cc0 {
 
     // {<function-definition>} ::=
     //    <type-specifier><identifier><parameter-clause><compound-statement>
+    // <function-declaration> ::=
+    //    ['extern']<type-specifier><identifier><parameter-clause>';'
     std::optional<CompilationError> Analyser::analyseFunction() {
         // function-definition可能有一个或者多个
         while (true) {
@@ -41,6 +64,14 @@ namespace cc0 {
             if (!next.has_value())
                 return {};
 
+            bool isExtern = false;
+            if (next.value().GetType() == TokenType::EXTERN) {
+                isExtern = true;
+                next = nextToken();
+                if (!next.has_value())
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrFunctionDeclared);
+            }
+
             CONST_TYPE type;
             if (next.value().GetType() == TokenType::INT) {
                 type = I;
@@ -50,6 +81,8 @@ namespace cc0 {
                 type = C;
             } else if (next.value().GetType() == TokenType::VOID) {
                 type = V;
+            } else if (isExtern) {
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrFunctionDeclared);
             } else {
                 unreadToken();
                 return {};
@@ -60,22 +93,48 @@ namespace cc0 {
             if (!next.has_value() || next.value().GetType() != IDENTIFIER)
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrFunctionDeclared);
 
-            auto name = next.value().GetValueString();
-
-            _constants.emplace_back(S, name, _nextConstIndex++);
-            if (_current_function.empty())
-                _functions.emplace_back(_nextConstIndex - 1, name, _nextFunIndex++, 1, true, type);
-            else
-                _functions.emplace_back(_nextConstIndex - 1, name, _nextFunIndex++,
-                                        _current_function.back().getLevel() + 1,
-                                        true, type);
+            auto &name = next.value().GetString();
+            auto namePos = next.value().GetStartPos();
 
-            _current_function.push_back(_functions.back());
+            auto nameIndex = addConst(S, name);
+            // 声明过的函数沿用先前的下标
+            bool known = isFunction(name);
+            int32_t index = known ? getFunctionIndex(name) : _nextFunIndex;
+            int32_t level = _current_function.empty() ? 1 : _current_function.back().getLevel() + 1;
+            _current_function.emplace_back(nameIndex, name, index, level, true, type);
 
             auto err = analyseParameterClause();
             if (err.has_value())
                 return err;
 
+            // 与先前的声明不一致
+            if (known && (getFunction(name).getParams() != _current_function.back().getParams()
+                          || getFunction(name).getReType() != type))
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrFunctionDeclared);
+
+            // 只有声明，没有函数体
+            next = nextToken();
+            if (next.has_value() && next.value().GetType() == SEMICOLON) {
+                if (!known) {
+                    _current_function.back().setDeclaration(true);
+                    _functions.push_back(_current_function.back());
+                    _nextFunIndex++;
+                    _declarationPos.emplace(index, namePos);
+                }
+                _current_function.pop_back();
+                continue;
+            }
+            if (next.has_value())
+                unreadToken();
+            if (isExtern)
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrFunctionDeclared);
+            if (known && !getFunction(name).isDeclaration())
+                return std::make_optional<CompilationError>(namePos, ErrorCode::ErrDuplicateDeclaration);
+            if (!known) {
+                _functions.push_back(_current_function.back());
+                _nextFunIndex++;
+            }
+
             err = analyseCompoundStatement(false);
             if (err.has_value())
                 return err;
@@ -128,7 +187,7 @@ namespace cc0 {
                 next = nextToken();
                 if (!next.has_value() || next.value().GetType() != TokenType::IDENTIFIER)
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
-                auto dec = isDeclared(next.value().GetValueString());
+                auto dec = isDeclared(next.value().GetString());
                 if (dec.first && dec.second == 0)
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
 
@@ -196,8 +255,21 @@ namespace cc0 {
                 return {};
 
 
+            // extern 只用于全局，声明其他文件中定义的变量或函数
+            bool isExtern = false;
+            if (next.value().GetType() == TokenType::EXTERN) {
+                if (!_isStart)
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidVariableDeclaration);
+                isExtern = true;
+                next = nextToken();
+                if (!next.has_value())
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedVarType);
+            }
+
             bool isConst = false;
             if (next.value().GetType() == TokenType::CONST) {
+                if (isExtern)
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidVariableDeclaration);
                 isConst = true;
                 next = nextToken();
             }
@@ -211,6 +283,14 @@ namespace cc0 {
                 type = C;
             } else if (isConst) { // is const but has not type
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedVarType);
+            } else if (isExtern) {
+                // extern void f(); 交给函数声明
+                if (next.value().GetType() == TokenType::VOID) {
+                    unreadToken();
+                    unreadToken();
+                    return {};
+                }
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedVarType);
             } else {
                 unreadToken();
                 return {};
@@ -225,10 +305,12 @@ namespace cc0 {
             if (i.value().GetType() == TokenType::IDENTIFIER && l.value().GetType() == TokenType::LEFT_PAREN)// ( 转函数定义
             {
                 unreadToken();
+                if (isExtern)
+                    unreadToken();
                 return {};
             }
 
-            auto err = analyseInitDeclaratorList(type, isConst);
+            auto err = isExtern ? analyseExternDeclaratorList(type) : analyseInitDeclaratorList(type, isConst);
             if (err.has_value())
                 return err;
 
@@ -246,11 +328,13 @@ namespace cc0 {
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TokenType::IDENTIFIER)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
-        auto dec = isDeclared(next.value().GetValueString());
+        auto dec = isDeclared(next.value().GetString());
         if (dec.first && dec.second == 0)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
 
-        auto name = next.value().GetValueString();
+        auto &name = next.value().GetString();
+        if (_isStart && _externIndexes.count(name))
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
         auto iToken = next.value();
         // 变量可能没有初始化，仍然需要一次预读
         next = nextToken();
@@ -270,13 +354,9 @@ namespace cc0 {
                 addUninitializedVariable(iToken, type);
 
             //在栈上先占个位
-            if (_isStart) _start.emplace_back(Operation::IPUSH, 0);
-            else
-                addInstruction(I, IPUSH, 0);
+            addInstruction(I, IPUSH, 0);
             if (type == D) {
-                if (_isStart) _start.emplace_back(Operation::IPUSH, 0);
-                else
-                    addInstruction(I, IPUSH, 0);
+                addInstruction(I, IPUSH, 0);
                 addInstruction(V, I2D, 0);
             }
         }
@@ -311,6 +391,31 @@ namespace cc0 {
         return {};
     }
 
+    // <extern-declarator-list> ::= <identifier>{','<identifier>}
+    std::optional<CompilationError> Analyser::analyseExternDeclaratorList(CONST_TYPE type) {
+        while (true) {
+            auto next = nextToken();
+            if (!next.has_value() || next.value().GetType() != TokenType::IDENTIFIER)
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
+            auto &name = next.value().GetString();
+            if (_g_vars.isDeclared(name))
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
+
+            // 不占栈空间，地址在链接时填入，见 addLoadAddress
+            _externIndexes.emplace(name, _externs.size());
+            _externs.emplace_back(name, type);
+            _g_vars.addVar(name, type, 0, false, false);
+
+            next = nextToken();
+            if (!next.has_value())
+                return std::make_optional<CompilationError>(_current_pos, ErrNoSemicolon);
+            if (next.value().GetType() != COMMA) {
+                unreadToken();
+                return {};
+            }
+        }
+    }
+
     // <语句序列> ::= {<语句>}
     // <语句> :: = <赋值语句> | <输出语句> | <空语句>
     // <赋值语句> :: = <标识符>'='<表达式>';'
@@ -364,12 +469,12 @@ namespace cc0 {
                 if (err.has_value())
                     return err;
             } else if (tp == IDENTIFIER) {
-                nextToken();
+                auto &name = nextToken().value().GetString();
                 next = nextToken();
                 unreadToken();
                 unreadToken();
                 if (next.value().GetType() == LEFT_PAREN) {
-                    auto err = analyseFunctionCall(I);
+                    auto err = isNative(name) ? analyseNativeCall(V) : analyseFunctionCall(I);
                     if (err.has_value())
                         return err;
                 } else {
@@ -449,8 +554,7 @@ namespace cc0 {
             unreadToken();
             return {};
         }
-        auto iToken = next.value();
-        auto name = next.value().GetValueString();
+        auto &name = next.value().GetString();
         // 标识符声明过吗？
         if (!isDeclared(name).first)
             return std::make_optional<CompilationError>(_current_pos, ErrNotDeclared);
@@ -470,7 +574,7 @@ namespace cc0 {
         auto it = getVarInfo(name);
         auto ty = it.second.getType();
 //        std::cout << it.first << "  " << it.second;
-        addInstruction(N, LOADA, it.first, it.second.getIndex());
+        addLoadAddress(name, it);
 
 
         auto err = analyseExpression(ty);
@@ -614,19 +718,18 @@ namespace cc0 {
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoRightBracket);
                 break;
             case FLOAT:
-                _constants.emplace_back(D, next.value().GetValueString(), _nextConstIndex++);
-                addInstruction(V, LOADC, _nextConstIndex - 1);
+                addInstruction(V, LOADC, addConst(D, next.value().GetValueString()));
                 _expression_level.back() = D;
                 break;
             case CHAR_LIT:
-                gets = next.value().GetValueString().front();
+                gets = next.value().GetChar();
                 val = gets;
                 addInstruction(C, BIPUSH, val);
                 addInstruction(V, I2D, 0);
                 break;
             case INTEGER:
                 try {
-                    val = std::any_cast<int32_t>(next.value().GetValue());
+                    val = next.value().GetInt();
                     if (INT32_MIN <= val && val <= INT32_MAX)
                         addInstruction(type, IPUSH, (int32_t) val);
                     addInstruction(V, I2D, 0);
@@ -643,7 +746,10 @@ namespace cc0 {
                 unreadToken();
                 unreadToken();
                 auto tp = type > _expression_level.back() ? type : _expression_level.back();
-                if (next.value().GetType() == LEFT_PAREN)//<function-call>
+                if (next.value().GetType() == LEFT_PAREN && isNative(iToken.GetString())) {
+                    err = analyseNativeCall(tp);
+                    if (err.has_value()) return err;
+                } else if (next.value().GetType() == LEFT_PAREN)//<function-call>
                 {
                     err = analyseFunctionCall(tp);
                     if (tp == D) {
@@ -670,8 +776,8 @@ namespace cc0 {
 
     std::optional<CompilationError> Analyser::analyseIdentifier(CONST_TYPE type) {
         auto next = nextToken();
-        auto name = next.value().GetValueString();
-        if (!isDeclared(next.value().GetValueString()).first)
+        auto &name = next.value().GetString();
+        if (!isDeclared(next.value().GetString()).first)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotDeclared);
         if (isUninitializedVariable(name))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotInitialized);
@@ -681,7 +787,7 @@ namespace cc0 {
         if (info.getType() == D)
             _expression_level.back() = info.getType();
 
-        addInstruction(N, LOADA, it.first, it.second.getIndex());
+        addLoadAddress(name, it);
         addInstruction(info.getType(), TLOAD, 0);
 
         if (info.getType() != D && type == D)
@@ -693,7 +799,7 @@ namespace cc0 {
 
     std::optional<CompilationError> Analyser::analyseFunctionCall(CONST_TYPE type) {
         auto next = nextToken();
-        auto name = next.value().GetValueString();
+        auto &name = next.value().GetString();
         if (!isFunction(name))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotDeclared);
 
@@ -734,6 +840,56 @@ namespace cc0 {
         return {};
     }
 
+    // <native-call> ::= <identifier> '(' [<expression>{','<expression>}] ')'
+    std::optional<CompilationError> Analyser::analyseNativeCall(CONST_TYPE type) {
+        auto next = nextToken();
+        auto index = vm::findNative(next.value().GetString());
+        auto &native = vm::nativeFunctions().at(index);
+        std::string params = native.params;
+
+        nextToken();  // (
+        // 参数的表达式会压入新的 _expression_level，分析完后恢复
+        auto level = _expression_level;
+        std::size_t len = 0;
+        next = nextToken();
+        if (!next.has_value())
+            return std::make_optional<CompilationError>(_current_pos, ErrNoRightBracket);
+        if (next.value().GetType() != RIGHT_PAREN) {
+            unreadToken();
+            while (true) {
+                if (len >= params.size()) // 参数长度不匹配
+                    return std::make_optional<CompilationError>(_current_pos, ErrFunctionParams);
+                auto paramType = params[len] == 'd' ? D : I;
+                auto err = analyseExpression(paramType);
+                if (err.has_value()) return err;
+                if (paramType == I && _expression_level.back() == D)
+                    addInstruction(V, D2I, 0);
+                len++;
+                next = nextToken();
+                if (!next.has_value())
+                    return std::make_optional<CompilationError>(_current_pos, ErrNoRightBracket);
+                if (next.value().GetType() == RIGHT_PAREN)
+                    break;
+                if (next.value().GetType() != COMMA)
+                    return std::make_optional<CompilationError>(_current_pos, ErrNoRightBracket);
+            }
+        }
+        if (len != params.size())
+            return std::make_optional<CompilationError>(_current_pos, ErrFunctionParams);
+        _expression_level = std::move(level);
+
+        addInstruction(V, CALLNATIVE, index);
+        // 语句中的调用丢弃返回值
+        if (type == V)
+            addInstruction(V, native.returnType == 'd' ? POP2 : POP, 0);
+        else if (native.returnType == 'd')
+            _expression_level.back() = D;
+        else if (type == D)
+            addInstruction(V, I2D, 0);
+
+        return {};
+    }
+
     std::optional<CompilationError> Analyser::analyseConditionStatement() {
         auto next = nextToken();
         if (next.value().GetType() == IF) {
@@ -769,9 +925,8 @@ namespace cc0 {
             err = analyseStatementSequence(false);
             if (err.has_value()) return err;
 
-        } else { // todo switch
-            unreadToken();
-            return {};
+        } else { // switch 还不支持
+            return std::make_optional<CompilationError>(_current_pos, ErrConditionStatement);
         }
         return {};
     }
@@ -889,10 +1044,10 @@ namespace cc0 {
 
                 next = nextToken();
                 if (next.value().GetType() == STRING) {
-                    auto str = next.value().GetValueString();
+                    auto str = next.value().GetString();
                     str = str.substr(1);
                     str.pop_back();
-                    auto index = addConst(str);
+                    auto index = addConst(S, str);
                     addInstruction(V,LOADC,index);
                     addInstruction(V,SPRINT,0);
                 } else {
@@ -909,6 +1064,9 @@ namespace cc0 {
 
 
                 next = nextToken();  //pre )
+                // 每个 <printable> 之后只能是 ',' 或 ')'，否则上面的循环不会再读入 token
+                if (!next.has_value() || (next.value().GetType() != COMMA && next.value().GetType() != RIGHT_PAREN))
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidPrint);
             }
             addInstruction(V, PRINTL, 0);
         } catch (ErrorCode) {
@@ -940,7 +1098,7 @@ namespace cc0 {
         if (!next.has_value() || next.value().GetType() != TokenType::IDENTIFIER)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrScanStatement);
 
-        auto name = next.value().GetValueString();
+        auto &name = next.value().GetString();
 
         if (!isDeclared(name).first)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotDeclared);
@@ -950,7 +1108,7 @@ namespace cc0 {
         // todo type
         auto it = getVarInfo(name);
         auto ty = it.second.getType();
-        addInstruction(N, LOADA, it.first, it.second.getIndex());
+        addLoadAddress(name, it);
         addInstruction(ty, TSCAN, 0);
         addInstruction(ty, TSTORE, 0);
         if (isUninitializedVariable(name)) {
@@ -1035,19 +1193,24 @@ namespace cc0 {
 
 
     std::optional<Token> Analyser::nextToken() {
-        if (_offset == _tokens.size())
+        auto token = _tokens.at(_offset);
+        if (token == nullptr)
             return {};
         // 考虑到 _tokens[0..._offset-1] 已经被分析过了
         // 所以我们选择 _tokens[0..._offset-1] 的 EndPos 作为当前位置
-        _current_pos = _tokens[_offset].GetEndPos();
-        return _tokens[_offset++];
+        _current_pos = _tokens.endPos(*token);
+        _current_start_pos = token->GetStartPos();
+        _offset++;
+        return *token;
     }
 
     void Analyser::unreadToken() {
         if (_offset == 0)
             DieAndPrint("analyser unreads token from the begining.");
-        _current_pos = _tokens[_offset - 1].GetEndPos();
+        _current_pos = _tokens.endPos(*_tokens.at(_offset - 1));
         _offset--;
+        if (_offset > 0)
+            _current_start_pos = _tokens.at(_offset - 1)->GetStartPos();
     }
 
     bool Analyser::isUninitializedVariable(const std::string &s) {
@@ -1078,17 +1241,17 @@ namespace cc0 {
     }
 
     void Analyser::addUninitializedVariable(const Token &tk, CONST_TYPE type) {
-        if (_isStart) _g_vars.addVar(tk.GetValueString(), type, _nextTokenIndex++, true, false);
+        if (_isStart) _g_vars.addVar(tk.GetString(), type, _nextTokenIndex++, true, false);
         else _current_function.back().addUninitializedVariable(tk, type);
     }
 
     void Analyser::addVariable(const Token &tk, CONST_TYPE type) {
-        if (_isStart) _g_vars.addVar(tk.GetValueString(), type, _nextTokenIndex++, false, false);
+        if (_isStart) _g_vars.addVar(tk.GetString(), type, _nextTokenIndex++, false, false);
         else _current_function.back().addVariable(tk, type);
     }
 
     void Analyser::addLocalConstant(const Token &tk, CONST_TYPE type) {
-        if (_isStart) _g_vars.addVar(tk.GetValueString(), type, _nextTokenIndex++, false, true);
+        if (_isStart) _g_vars.addVar(tk.GetString(), type, _nextTokenIndex++, false, true);
         else _current_function.back().addLocalConstant(tk, type);
     }
 
@@ -1096,7 +1259,7 @@ namespace cc0 {
     void Analyser::addDouble(const cc0::Token &tk) {
 //        _constants.emplace_back(D, tk.GetValueString(), _nextConstIndex++);
 
-        if (_isStart) _g_vars.addVar(tk.GetValueString(), D, _nextTokenIndex++, false, false);
+        if (_isStart) _g_vars.addVar(tk.GetString(), D, _nextTokenIndex++, false, false);
         else _current_function.back().addDouble(tk, _nextTokenIndex++);
         _nextTokenIndex++;
     }
@@ -1104,7 +1267,7 @@ namespace cc0 {
     // 添加double未初始化变量
     void Analyser::addUninitializedDouble(const Token &tk) {
 //        _constants.emplace_back(D, tk.GetValueString(), _nextConstIndex++);
-        if (_isStart)_g_vars.addVar(tk.GetValueString(), D, _nextTokenIndex++, true, false);
+        if (_isStart)_g_vars.addVar(tk.GetString(), D, _nextTokenIndex++, true, false);
         else _current_function.back().addUninitializedDouble(tk, _nextTokenIndex++);
         _nextTokenIndex++;
     }
@@ -1113,7 +1276,7 @@ namespace cc0 {
     // 添加 double 常量
     void Analyser::addDoubleConst(const Token &tk) {
 //        _constants.emplace_back(D, tk.GetValueString(), _nextConstIndex++);
-        if (_isStart)_g_vars.addVar(tk.GetValueString(), D, _nextTokenIndex++, false, true);
+        if (_isStart)_g_vars.addVar(tk.GetString(), D, _nextTokenIndex++, false, true);
         else _current_function.back().addDoubleConst(tk, _nextTokenIndex++);
         _nextTokenIndex++;
     }
@@ -1189,17 +1352,209 @@ namespace cc0 {
 
         if (_isStart) {
             _start.emplace_back(realOp, x);
+            _start_positions.push_back(_current_start_pos);
         } else {
-            _current_function.back().addInstruction(realOp, x);
+            _current_function.back().addInstruction(realOp, x, _current_start_pos);
         }
 
     }
 
+    void Analyser::addLoadAddress(const std::string &name, const std::pair<int32_t, Var> &info) {
+        auto instruction = _isStart ? _start.size() : _current_function.back().getInsLen();
+        addInstruction(N, LOADA, info.first, info.second.getIndex());
+        auto ext = _externIndexes.find(name);
+        if (info.first != 1 || ext == _externIndexes.end())
+            return;
+        // .start 中的 loada 没有生成
+        if (_isStart && _start.size() == instruction)
+            return;
+        _externUses.push_back(vm::SymbolTable::GlobalUse{
+                static_cast<vm::u4>(ext->second),
+                _isStart ? 0 : static_cast<vm::u4>(_current_function.back().getIndex() + 1),
+                static_cast<vm::u4>(instruction)});
+    }
+
+    vm::SymbolTable Analyser::getSymbols() const {
+        const auto typeOf = [](CONST_TYPE type) {
+            return type == D ? 'D' : type == C ? 'C' : 'I';
+        };
+        vm::SymbolTable symbols;
+        symbols.globalsSize = _globalsSize;
+        for (auto &it : _functions) {
+            if (it.isDeclaration())
+                symbols.functionImports.push_back(it.getIndex());
+        }
+        for (auto &[name, var] : _g_vars._varsList) {
+            if (_externIndexes.find(name) == _externIndexes.end())
+                symbols.exports.push_back(vm::SymbolTable::Global{name, typeOf(var.getType()), static_cast<vm::u4>(var.getIndex())});
+        }
+        for (auto &[name, type] : _externs)
+            symbols.imports.push_back(vm::SymbolTable::Global{name, typeOf(type), 0});
+        symbols.uses = _externUses;
+        return symbols;
+    }
+
+    // 与 fmts.hpp 中指令的文本名一致，T 开头的指令没有对应的操作码
+    static bool toOpCode(Operation op, vm::OpCode &code) {
+        switch (op) {
+            case NOP: code = vm::OpCode::nop; break;
+            case LOADA: code = vm::OpCode::loada; break;
+            case LOADC: code = vm::OpCode::loadc; break;
+            case IPUSH: code = vm::OpCode::ipush; break;
+            case BIPUSH: code = vm::OpCode::bipush; break;
+            case ILOAD: code = vm::OpCode::iload; break;
+            case DLOAD: code = vm::OpCode::dload; break;
+            case ISTORE: code = vm::OpCode::istore; break;
+            case CSTORE: code = vm::OpCode::astore; break;
+            case DSTORE: code = vm::OpCode::dstore; break;
+            case NEW: code = vm::OpCode::_new; break;
+            case SNEW: code = vm::OpCode::snew; break;
+            case POP: code = vm::OpCode::pop; break;
+            case POP2: code = vm::OpCode::pop2; break;
+            case DUP: code = vm::OpCode::dup; break;
+            case IADD: code = vm::OpCode::iadd; break;
+            case DADD: code = vm::OpCode::dadd; break;
+            case ISUB: code = vm::OpCode::isub; break;
+            case DSUB: code = vm::OpCode::dsub; break;
+            case IMUL: code = vm::OpCode::imul; break;
+            case DMUL: code = vm::OpCode::dmul; break;
+            case IDIV: code = vm::OpCode::idiv; break;
+            case DDIV: code = vm::OpCode::ddiv; break;
+            case INEG: code = vm::OpCode::ineg; break;
+            case DNEG: code = vm::OpCode::dneg; break;
+            case ICMP: code = vm::OpCode::icmp; break;
+            case DCMP: code = vm::OpCode::dcmp; break;
+            case I2D: code = vm::OpCode::i2d; break;
+            case I2C: code = vm::OpCode::i2c; break;
+            case D2I: code = vm::OpCode::d2i; break;
+            case JMP: code = vm::OpCode::jmp; break;
+            case JNE: code = vm::OpCode::jne; break;
+            case JE: code = vm::OpCode::je; break;
+            case JL: code = vm::OpCode::jl; break;
+            case JGE: code = vm::OpCode::jge; break;
+            case JG: code = vm::OpCode::jg; break;
+            case JLE: code = vm::OpCode::jle; break;
+            case CALL: code = vm::OpCode::call; break;
+            case CALLNATIVE: code = vm::OpCode::callnative; break;
+            case RET: code = vm::OpCode::ret; break;
+            case IRET: code = vm::OpCode::iret; break;
+            case DRET: code = vm::OpCode::dret; break;
+            case IPRINT: code = vm::OpCode::iprint; break;
+            case DPRINT: code = vm::OpCode::dprint; break;
+            case CPRINT: code = vm::OpCode::cprint; break;
+            case SPRINT: code = vm::OpCode::sprint; break;
+            case PRINTL: code = vm::OpCode::printl; break;
+            case ISCAN: code = vm::OpCode::iscan; break;
+            case CSCAN: code = vm::OpCode::cscan; break;
+            case DSCAN: code = vm::OpCode::dscan; break;
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    static std::vector<vm::Instruction> toInstructions(const std::vector<Instruction> &v) {
+        std::vector<vm::Instruction> rtv;
+        rtv.reserve(v.size());
+        for (auto &it : v) {
+            vm::Instruction ins{vm::OpCode::nop, 0, 0};
+            if (!toOpCode(it.GetOperation(), ins.op))
+                throw InvalidFile("no such opcode");
+            // 操作数个数与文本汇编相同，没有的操作数为 0
+            auto paramCount = vm::infoOf(ins.op).paramCount;
+            if (paramCount > 0)
+                ins.x = static_cast<vm::u4>(it.GetX());
+            if (paramCount > 1)
+                ins.y = static_cast<vm::u4>(it.getY());
+            rtv.push_back(ins);
+        }
+        return rtv;
+    }
+
+    static vm::LineTable toLineTable(const std::vector<std::pair<std::uint64_t, std::uint64_t>> &positions) {
+        vm::LineTable lines;
+        for (size_t i = 0; i < positions.size(); ++i)
+            lines.add(i, positions[i].first + 1, positions[i].second + 1);
+        return lines;
+    }
+
+    ::File Analyser::toFile(bool lineTable) const {
+        std::vector<vm::Constant> constants;
+        constants.reserve(_constants.size());
+        for (auto &it : _constants) {
+            vm::Constant constant;
+            const auto &value = it.Get();
+            switch (it.GetConstType()) {
+                case S: {
+                    // 字符串常量保留着源码中的转义序列
+                    constant.type = vm::Constant::Type::STRING;
+                    std::string str;
+                    std::string_view rest = value;
+                    for (auto bs = rest.find('\\'); bs != std::string_view::npos; bs = rest.find('\\')) {
+                        str.append(rest.data(), bs);
+                        rest.remove_prefix(bs + 1);
+                        char ch;
+                        if (!parse_escape(rest, ch))
+                            throw InvalidFile("invalid escape seq in string constant " + value);
+                        str += ch;
+                    }
+                    str.append(rest.data(), rest.size());
+                    constant.value = std::move(str);
+                    break;
+                }
+                case I: {
+                    constant.type = vm::Constant::Type::INT;
+                    vm::int_t v;
+                    if (!parse_int(value, v))
+                        throw InvalidFile("int constant out of range: " + value);
+                    constant.value = v;
+                    break;
+                }
+                case D: {
+                    constant.type = vm::Constant::Type::DOUBLE;
+                    vm::double_t v;
+                    if (!parse_double(value, v))
+                        throw InvalidFile("double constant out of range: " + value);
+                    constant.value = v;
+                    break;
+                }
+                default:
+                    throw InvalidFile("invalid constant type");
+            }
+            constants.push_back(std::move(constant));
+        }
+
+        std::vector<vm::Function> functions(_functions.size());
+        for (auto &it : _functions) {
+            if (it.getParamsSize() > U2_MAX)
+                throw InvalidFile("too many parameters");
+            auto &function = functions.at(it.getIndex());
+            function.nameIndex = it.getNameIndex();
+            function.paramSize = it.getParamsSize();
+            function.level = it.getLevel();
+            function.instructions = toInstructions(it.getInstructions());
+            if (lineTable)
+                function.lines = toLineTable(it.getPositions());
+        }
+
+        ::File file{0x00000001, std::move(constants), toInstructions(_start), std::move(functions)};
+        if (lineTable)
+            file.startLines = toLineTable(_start_positions);
+        if (_object)
+            file.symbols = getSymbols();
+        // addConst 已合并相同的常量，这里与 --link 一样再检查一遍
+        file.dedup_constants();
+        return file;
+    }
+
     void Analyser::addInstruction(CONST_TYPE type, Operation op, int32_t x, int32_t y) {
         if (_isStart) {
-            if (type == I) _start.emplace_back(op, x, y);
+            if (type == I) {
+                _start.emplace_back(op, x, y);
+                _start_positions.push_back(_current_start_pos);
+            }
         } else {
-            _current_function.back().addInstruction(op, x, y);
+            _current_function.back().addInstruction(op, x, y, _current_start_pos);
         }
 
     }
@@ -1235,6 +1590,10 @@ namespace cc0 {
         return false;
     }
 
+    bool Analyser::isNative(const std::string &s) {
+        return !isFunction(s) && vm::findNative(s) >= 0;
+    }
+
     int32_t Analyser::getFunctionIndex(const std::string &s) {
         for (auto &it : _functions) {
             if (it.getName() == s) return it.getIndex();
@@ -1257,8 +1616,10 @@ namespace cc0 {
         }
     }
 
-    int32_t Analyser::addConst(const std::string &s) {
-        _constants.emplace_back(S, s, _nextConstIndex++);
-        return _nextConstIndex - 1;
+    int32_t Analyser::addConst(CONST_TYPE type, const std::string &s) {
+        auto [it, inserted] = _constIndexes.try_emplace(static_cast<char>(type) + s, _nextConstIndex);
+        if (inserted)
+            _constants.emplace_back(type, s, _nextConstIndex++);
+        return it->second;
     }
 }
\ No newline at end of file
@@ -4,11 +4,16 @@
 #include "type/constans.h"
 #include "type/funciton.h"
 #include "tokenizer/token.h"
+#include "tokenizer/token_stream.h"
+#include "src/native.h"
+#include "src/symbol_table.h"
+#include "src/file.h"
 
 #include <vector>
 #include <optional>
 #include <utility>
 #include <map>
+#include <unordered_map>
 #include <cstdint>
 #include <cstddef> // for std::size_t
 
@@ -21,9 +26,11 @@ namespace cc0 {
 		using uint32_t = std::uint32_t;
 		using int32_t = std::int32_t;
 	public:
-		Analyser(std::vector<Token> v)
-			: _tokens(std::move(v)), _offset(0),  _current_pos(0, 0),
-              _constants({}),_start({}),  _g_vars({}),_nextTokenIndex(0) {}
+		// object 为 true 时编译为目标文件：可以没有 main，只有声明的函数和 extern 变量由链接的其他文件定义
+		// 分析时从 tokens 中逐个读取 token，词法错误由调用者通过 TokenStream::drain 取得
+		Analyser(TokenStream &tokens, bool object = false)
+			: _tokens(tokens), _offset(0),  _current_pos(0, 0), _current_start_pos(0, 0),
+              _constants({}),_start({}),  _g_vars({}),_nextTokenIndex(0), _object(object) {}
 		Analyser(Analyser&&) = delete;
 		Analyser(const Analyser&) = delete;
 		Analyser& operator=(Analyser) = delete;
@@ -32,6 +39,13 @@ namespace cc0 {
 		std::pair<std::pair<std::vector<Constants>,std::vector<Function>>, std::optional<CompilationError>> Analyse();
 	    std::vector<Function> getFunctions() const { return _functions;}
         std::vector<Instruction> getStart()  const { return _start;}
+        // 与 getStart() 一一对应的源码位置
+        std::vector<std::pair<uint64_t, uint64_t>> getStartPositions() const { return _start_positions; }
+        // 目标文件的符号表
+        vm::SymbolTable getSymbols() const;
+        // 直接转为虚拟机的 File，不经过文本汇编；lineTable 为 true 时附带行号表
+        // 常量无法表示时抛出 InvalidFile
+        ::File toFile(bool lineTable) const;
 
 	private:
 		// 所有的递归子程序
@@ -62,6 +76,8 @@ namespace cc0 {
         std::optional<CompilationError> analyseAssignmentExpression();
         // <function-call>
         std::optional<CompilationError> analyseFunctionCall(CONST_TYPE type);
+        // 调用 C++ 实现的内建函数，type 为 V 时丢弃返回值
+        std::optional<CompilationError> analyseNativeCall(CONST_TYPE type);
 
 		std::optional<CompilationError> analyseExpression(CONST_TYPE type);
 
@@ -97,12 +113,16 @@ namespace cc0 {
 
 
 	private:
-		std::vector<Token> _tokens;
+		TokenStream &_tokens;
+		// 下一个要读取的 token 的下标
 		std::size_t _offset;
 		std::pair<uint64_t, uint64_t> _current_pos;
+		// 最近读到的 token 的起始位置，记录到生成的指令上
+		std::pair<uint64_t, uint64_t> _current_start_pos;
         std::vector<Constants> _constants;
         std::vector<Function> _functions;
         std::vector<Instruction> _start;
+        std::vector<std::pair<uint64_t, uint64_t>> _start_positions;
 		// 为了简单处理，我们直接把符号表耦合在语法分析里
 		// 变量                   示例
 		// _uninitialized_vars    var a;
@@ -125,14 +145,32 @@ namespace cc0 {
         bool _isStart = true;
 
         int32_t _nextConstIndex=0;
+        // 常量表的索引，key 为类型加上值，见 addConst
+        std::unordered_map<std::string, int32_t> _constIndexes;
         int32_t _nextFunIndex=0;
 
 
 		// 下一个 token 在栈的偏移
 		int32_t _nextTokenIndex;
 
+        bool _object;
+        // 全局变量占用的栈空间
+        int32_t _globalsSize = 0;
+        // extern 变量在 _externs 中的下标
+        std::map<std::string, int32_t> _externIndexes;
+        std::vector<std::pair<std::string, CONST_TYPE>> _externs;
+        // 取 extern 变量地址的 loada，链接时填入地址
+        std::vector<vm::SymbolTable::GlobalUse> _externUses;
+        // 只有声明的函数的位置，key 为函数下标
+        std::map<int32_t, std::pair<uint64_t, uint64_t>> _declarationPos;
+
         std::optional<CompilationError> analyseInitDeclaratorList(CONST_TYPE type, bool isConst);
 
+        std::optional<CompilationError> analyseExternDeclaratorList(CONST_TYPE type);
+
+        // 取变量的地址，info 为 getVarInfo 的结果
+        void addLoadAddress(const std::string &name, const std::pair<int32_t, Var> &info);
+
         std::optional<CompilationError> analyseUnaryExpression(CONST_TYPE type);
 
         void addInstruction( CONST_TYPE type ,Operation op, int32_t x);
@@ -142,6 +180,9 @@ namespace cc0 {
 
         bool isFunction(const std::string &s);
 
+        // 用户定义的同名函数优先于内建函数
+        bool isNative(const std::string &s);
+
         int32_t getFunctionIndex(const std::string &s);
 
         std::optional<CompilationError> analyseParameterClause();
@@ -167,6 +208,7 @@ namespace cc0 {
 
         void assignVar(const std::string &s);
 
-        int32_t addConst(const std::string &s);
+        // 相同类型和值的常量只加入一次，返回其在常量表中的 index
+        int32_t addConst(CONST_TYPE type, const std::string &s);
     };
 }
@@ -0,0 +1,82 @@
+// times the keyword lookup of parseIdentifier: the perfect hash of
+// tokenizer/keyword.h against the chain of compares it replaced
+// build: g++ -std=c++17 -O2 -I. bench/keyword_lookup.cpp -o keyword_lookup
+// usage: keyword_lookup [words]
+#include "tokenizer/keyword.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using namespace cc0;
+
+// the order of the old parseIdentifier, "for" was tried twice
+constexpr std::string_view chainOrder[] = {
+    "const", "extern", "void", "int", "char", "double", "struct",
+    "if", "else", "switch", "case", "default", "while", "for", "for", "do",
+    "return", "break", "continue", "print", "scan",
+};
+
+// the loop and the call without a lookup
+__attribute__((noinline)) std::size_t findNothing(std::string_view str) {
+    return str.empty();
+}
+
+__attribute__((noinline)) std::size_t findChain(std::string_view str) {
+    for (std::size_t i = 0; i < sizeof chainOrder / sizeof chainOrder[0]; i++) {
+        if (str == chainOrder[i])
+            return 1;
+    }
+    return 0;
+}
+
+__attribute__((noinline)) std::size_t findHash(std::string_view str) {
+    return keyword::find(str) != keyword::Count;
+}
+
+// one keyword in four, the rest are identifiers of 1 to 12 characters
+std::vector<std::string> makeWords(std::size_t n) {
+    std::mt19937 rng(42);
+    std::vector<std::string> words;
+    words.reserve(n);
+    for (std::size_t i = 0; i < n; i++) {
+        if (rng() % 4 == 0) {
+            words.emplace_back(keyword::Keywords[rng() % keyword::Count].name);
+            continue;
+        }
+        std::string word(1 + rng() % 12, ' ');
+        for (auto& c : word)
+            c = static_cast<char>('a' + rng() % 26);
+        words.push_back(std::move(word));
+    }
+    return words;
+}
+
+template <typename Find>
+void run(const char* name, const std::vector<std::string>& words, Find find) {
+    auto begin = std::chrono::steady_clock::now();
+    std::size_t sum = 0;
+    for (auto& word : words)
+        sum += find(word);
+    auto end = std::chrono::steady_clock::now();
+    std::printf("%-8s %8.1f ms  %zu keywords\n", name,
+        std::chrono::duration<double, std::milli>(end - begin).count(), sum);
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 12000000;
+    auto words = makeWords(n);
+    std::printf("%zu words\n", n);
+    run("nothing", words, findNothing);
+    run("chain", words, findChain);
+    run("hash", words, findHash);
+    return 0;
+}
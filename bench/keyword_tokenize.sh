@@ -0,0 +1,36 @@
+#!/bin/sh
+# times the tokenize stage of cc0 -t on an identifier-dense source,
+# one line per cc0 given, e.g. the builds before and after a tokenizer change
+# usage: bench/keyword_tokenize.sh path/to/cc0 [path/to/other/cc0 ...]
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# 200k lines of keywords and identifiers, about 15 MB
+awk 'BEGIN {
+    srand(42);
+    n = split("const extern void int char double struct if else switch case default while for do return break continue print scan", kw, " ");
+    for (line = 0; line < 200000; line++) {
+        s = "";
+        for (w = 0; w < 11; w++) {
+            if (rand() < 0.25) {
+                word = kw[int(rand() * n) + 1];
+            } else {
+                word = "";
+                len = 1 + int(rand() * 12);
+                for (c = 0; c < len; c++)
+                    word = word sprintf("%c", 97 + int(rand() * 26));
+            }
+            s = s word " ";
+        }
+        print s;
+    }
+}' > "$dir/words.c0"
+echo "$(wc -c < "$dir/words.c0") bytes"
+
+for cc0 in "$@"; do
+    for run in 1 2 3; do
+        "$cc0" -t "$dir/words.c0" -o "$dir/out" --time-report 2>&1 |
+            awk -v cc0="$cc0" '$1 == "tokenize" { print cc0 ": tokenize " $3 " ms" }'
+    done
+done
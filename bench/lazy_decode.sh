@@ -0,0 +1,26 @@
+#!/bin/sh
+# checks that -r on a binary file decodes only the functions that are called
+# usage: bench/lazy_decode.sh path/to/cc0
+set -e
+cc0=${1:-./cc0}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# 200 functions, main calls one of them
+i=0
+while [ $i -lt 200 ]; do
+    echo "int f$i(int x) { return x * $i + 1; }"
+    i=$((i + 1))
+done > "$dir/unused.c0"
+echo "int main() { print(f7(6)); return 0; }" >> "$dir/unused.c0"
+
+"$cc0" -c "$dir/unused.c0" -o "$dir/unused.o0"
+out=$("$cc0" -r "$dir/unused.o0" --time-report 2>&1)
+echo "$out" | grep -q '^43$' || { echo "$out"; echo "wrong output"; exit 1; }
+decoded=$(echo "$out" | awk '$1 == "decoded" { print $3 }')
+if [ "$decoded" != 2 ]; then
+    echo "$out"
+    echo "decoded $decoded functions, expected 2 (main and f7)"
+    exit 1
+fi
+echo "ok: 2 of 201 functions decoded"
@@ -4,16 +4,23 @@
 #include <string>
 #include <utility>
 #include <iostream>
+#include <stdexcept>
 
 namespace cc0 {
 
-	inline void DieAndPrint(std::string condition) {
-		std::cout << "Exception: " <<  condition << "\n";
-		std::cout << "The program should not reach here.\n";
-		std::cout << "Please check your program carefully.\n";
-		std::cout << "If you believe it's not your fault, please report this to TAs.\n";
-		std::abort();
-		// or *((int*)114514) = 19260817;
+	// 程序不应到达的状态
+	// 抛出异常而不是 abort，cc0 --serve 只让这一个请求失败，命令行下仍然异常终止
+	class UnexpectedState final : public std::logic_error {
+	public:
+		explicit UnexpectedState(const std::string& condition)
+			: std::logic_error("Exception: " + condition + "\n"
+				"The program should not reach here.\n"
+				"Please check your program carefully.\n"
+				"If you believe it's not your fault, please report this to TAs.") {}
+	};
+
+	[[noreturn]] inline void DieAndPrint(std::string condition) {
+		throw UnexpectedState(condition);
 	}
 
 	// To keep it simple, we don't create an error system.
@@ -49,6 +56,7 @@ namespace cc0 {
         ErrScanStatement,
         ErrFunctionCall,
         ErrNeedMain,
+        ErrFunctionNotDefined,
         ErrViod
 	};
 
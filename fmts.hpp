@@ -102,6 +102,9 @@ namespace fmt {
                 case cc0::ErrNeedMain:
                     name = "you should declare main function .";
                     break;
+                case cc0::ErrFunctionNotDefined:
+                    name = "the function is declared but not defined, compile with --object to link it from another file.";
+                    break;
                 case cc0::ErrViod:
                     name = "you can't use void in expression";
                     break;
@@ -170,6 +173,9 @@ namespace fmt {
                 case cc0::CONST:
                     name = "Const";
                     break;
+                case cc0::EXTERN:
+                    name = "Extern";
+                    break;
                 case cc0::PRINT:
                     name = "Print";
                     break;
@@ -358,6 +364,9 @@ namespace fmt {
                 case cc0::POP:
                     name = "pop";
                     break;
+                case cc0::POP2:
+                    name = "pop2";
+                    break;
                 case cc0::DUP:
                     name = "dup";
                     break;
@@ -430,6 +439,9 @@ namespace fmt {
                 case cc0::CALL:
                     name = "call";
                     break;
+                case cc0::CALLNATIVE:
+                    name = "callnative";
+                    break;
                 case cc0::RET:
                     name = "ret";
                     break;
@@ -481,6 +493,7 @@ namespace fmt {
                 // 0
                 case cc0::NOP:
                 case cc0::POP:
+                case cc0::POP2:
                 case cc0::DUP:
                 case cc0::NEW:
                 case cc0::TLOAD:
@@ -541,6 +554,7 @@ namespace fmt {
                 case cc0::JG:
                 case cc0::JLE:
                 case cc0::CALL:
+                case cc0::CALLNATIVE:
                     return format_to(ctx.out(), "{} {}", p.GetOperation(), p.GetX());
                 case cc0::LOADA:
                     return format_to(ctx.out(), "{} {}, {}", p.GetOperation(), p.GetX(), p.getY());
@@ -7,12 +7,27 @@
 #include "fmts.hpp"
 #include "src/vm.h"
 #include "src/vm.cpp"
+#include "src/compile_cache.h"
+#include "src/time_report.h"
+#include "src/compile_server.h"
+#include "src/mapped_file.h"
+#include "src/util/thread_pool.hpp"
 
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <sstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
-std::vector<cc0::Token> _tokenize(std::istream &input) {
-    cc0::Tokenizer tkz(input);
+// the tokens refer to strings kept by tkz
+std::vector<cc0::Token> _tokenize(cc0::Tokenizer &tkz, vm::TimeReport *report) {
+    vm::TimeReport::Scope scope(report, "tokenize");
     auto p = tkz.AllTokens();
     if (p.second.has_value()) {
         fmt::print(stderr, "Tokenization error: {}\n", p.second.value());
@@ -21,21 +36,43 @@ std::vector<cc0::Token> _tokenize(std::istream &input) {
     return p.first;
 }
 
-void Tokenize(std::istream &input, std::ostream &output) {
-    auto v = _tokenize(input);
+void Tokenize(std::istream &input, std::ostream &output, vm::TimeReport *report) {
+    cc0::Tokenizer tkz(input);
+    auto v = _tokenize(tkz, report);
+    if (report)
+        report->count("tokens", v.size());
+    vm::TimeReport::Scope scope(report, "text emit");
     for (auto &it : v)
         output << fmt::format("{}\n", it);
     return;
 }
 
-void Analyse(std::istream &input, std::ostream &output) {
-    auto tks = _tokenize(input);
-    cc0::Analyser analyser(tks);
-    auto p = analyser.Analyse();
+void Analyse(std::istream &input, std::ostream &output, bool lineTable, bool object, vm::TimeReport *report) {
+    cc0::Tokenizer tkz(input);
+    cc0::TokenStream tokens(tkz, report);
+    cc0::Analyser analyser(tokens, object);
+    auto p = [&] {
+        vm::TimeReport::Scope scope(report, "analyse");
+        return analyser.Analyse();
+    }();
+    if (auto err = tokens.drain(); err.has_value()) {
+        fmt::print(stderr, "Tokenization error: {}\n", err.value());
+        exit(2);
+    }
     if (p.second.has_value()) {
         fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
         exit(2);
     }
+    if (report) {
+        uint64_t instructions = analyser.getStart().size();
+        for (auto &it : p.first.second)
+            instructions += it.getInstructions().size();
+        report->count("tokens", tokens.count());
+        report->count("constants", p.first.first.size());
+        report->count("functions", p.first.second.size());
+        report->count("instructions", instructions);
+    }
+    vm::TimeReport::Scope scope(report, "text emit");
     auto c = p.first.first;
     output << ".constants:\n";
     for (auto &it : c)
@@ -57,24 +94,152 @@ void Analyse(std::istream &input, std::ostream &output) {
             output << index++ << "    " << fmt::format("{}\n", ins);
     }
 
+    if (lineTable) {
+        // {function} {instruction} {line} {column}, function -1 is .start, 1-based
+        output << ".lines:\n";
+        const auto outputLines = [&](int32_t fun, const std::vector<std::pair<uint64_t, uint64_t>> &positions) {
+            vm::LineTable lines;
+            for (size_t i = 0; i < positions.size(); ++i)
+                lines.add(i, positions[i].first + 1, positions[i].second + 1);
+            for (auto &e : lines.entries)
+                output << fmt::format("{} {} {} {}\n", fun, e.instruction, e.line, e.column);
+        };
+        outputLines(-1, analyser.getStartPositions());
+        for (auto &it : f)
+            outputLines(it.getIndex(), it.getPositions());
+    }
+
+    if (object)
+        analyser.getSymbols().output_text(output);
+
     return;
 }
 
-void assemble_text(std::ifstream *in, std::ofstream *out) {
+// the size of the program to the time report
+void count_file(vm::TimeReport *report, const File &file) {
+    if (!report)
+        return;
+    uint64_t instructions = file.start.size();
+    for (auto &fun : file.functions)
+        instructions += fun.instructions.size();
+    report->count("constants", file.constants.size());
+    report->count("functions", file.functions.size());
+    report->count("instructions", instructions);
+}
+
+// a whole source in memory for the tokenizer, a file is mapped and stdin read
+struct Source {
+    std::unique_ptr<MappedFile> mapped;
+    std::string buffer;
+
+    std::string_view text() const {
+        if (mapped)
+            return std::string_view(reinterpret_cast<const char *>(mapped->data()), mapped->size());
+        return buffer;
+    }
+};
+
+// throws InvalidFile if the file can not be read
+Source read_source(const std::string &path) {
+    Source source;
+    if (path == "-")
+        source.buffer.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    else
+        source.mapped = std::make_unique<MappedFile>(path);
+    return source;
+}
+
+// what a file given to -r holds, told apart by its first bytes
+enum class InputFormat { Source, Binary, Image };
+
+InputFormat format_of(std::string_view head) {
+    const char magic[] = {char(File::magic_v >> 24), char(File::magic_v >> 16), char(File::magic_v >> 8), char(File::magic_v)};
+    if (head.compare(0, sizeof magic, magic, sizeof magic) == 0)
+        return InputFormat::Binary;
+    if (head.compare(0, sizeof vm::imageMagic, vm::imageMagic, sizeof vm::imageMagic) == 0)
+        return InputFormat::Image;
+    return InputFormat::Source;
+}
+
+// a source if the file can not be read, the error is left to the reader
+InputFormat format_of_file(const std::string &path) {
+    if (path == "-")
+        return InputFormat::Source;
+    char head[sizeof vm::imageMagic];
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    in.read(head, sizeof head);
+    return format_of(std::string_view(head, static_cast<size_t>(in.gcount())));
+}
+
+// the source analysed and lowered to a File in memory, nullopt after the error is printed to err
+std::optional<File> compile(std::string_view source, bool lineTable, bool object, vm::TimeReport *report, std::ostream &err) {
+    if (report)
+        report->count("source bytes", source.size());
+    cc0::Tokenizer tkz(source);
+    cc0::TokenStream tokens(tkz, report);
+    cc0::Analyser analyser(tokens, object);
+    auto r = [&] {
+        vm::TimeReport::Scope scope(report, "analyse");
+        return analyser.Analyse();
+    }();
+    if (auto e = tokens.drain(); e.has_value()) {
+        err << fmt::format("Tokenization error: {}\n", e.value());
+        return {};
+    }
+    if (r.second.has_value()) {
+        err << fmt::format("Syntactic analysis error: {}\n", r.second.value());
+        return {};
+    }
+    if (report)
+        report->count("tokens", tokens.count());
+    try {
+        vm::TimeReport::Scope scope(report, "lower");
+        auto file = analyser.toFile(lineTable);
+        count_file(report, file);
+        return file;
+    }
+    catch (const std::exception &e) {
+        println(err, e.what());
+        return {};
+    }
+}
+
+// the object files linked, nullopt after the error is printed
+std::optional<File> link_objects(const std::vector<std::string> &inputs, vm::TimeReport *report) {
+    std::vector<File> objects;
+    for (auto &path : inputs) {
+        try {
+            vm::TimeReport::Scope scope(report, "load objects");
+            objects.push_back(File::load_binary(path));
+        }
+        catch (const std::exception &e) {
+            println(std::cerr, path + ":", e.what());
+            return {};
+        }
+    }
     try {
-        File f = File::parse_file_text(*in);
-        // f.output_text(std::cout);
-        f.output_binary(*out);
+        vm::TimeReport::Scope scope(report, "link");
+        auto file = File::link(std::move(objects));
+        count_file(report, file);
+        return file;
     }
     catch (const std::exception &e) {
         println(std::cerr, e.what());
+        return {};
     }
 }
 
-void execute(std::ifstream *in, std::ostream *out) {
+// runs the file, or with executable the image at path
+void execute(std::optional<File> file, const std::string &path, bool executable, vm::SampleProfiler *profiler, vm::PerfCounters *perf,
+             vm::TimeReport *report) {
     try {
-        File f = File::parse_file_binary(*in);
-        auto avm = std::move(vm::VM::make_vm(f));
+        auto avm = [&] {
+            vm::TimeReport::Scope scope(report, "load program");
+            return executable ? vm::VM::make_vm(vm::Image::load(path)) : vm::VM::make_vm(std::move(*file));
+        }();
+        avm->setProfiler(profiler);
+        avm->setPerfCounters(perf);
+        avm->setTimeReport(report);
         avm->start();
     }
     catch (const std::exception &e) {
@@ -82,11 +247,299 @@ void execute(std::ifstream *in, std::ostream *out) {
     }
 }
 
+// the options of -c with many inputs
+struct BatchOptions {
+    bool lineTable;
+    bool object;
+    bool executable;
+    int version;
+    // nullptr without --cache
+    const vm::CompileCache *compileCache;
+};
+
+// compiles the source at input to output as -c does, false after the error is printed to err
+bool compile_file(const std::string &input, const std::string &output, const BatchOptions &options, std::ostream &err) {
+    Source source;
+    try {
+        source = read_source(input);
+    }
+    catch (const std::exception &) {
+        err << fmt::format("Fail to open {} for reading.\n", input);
+        return false;
+    }
+    std::string key;
+    std::vector<unsigned char> image;
+    if (options.compileCache)
+        key = options.compileCache->key(source.text(), fmt::format("-g={} --binary-version={} --image={} --object={}",
+                                                            options.lineTable, options.version, options.executable, options.object));
+    if (key.empty() || !options.compileCache->load(key, image)) {
+        auto file = compile(source.text(), options.lineTable, options.object, nullptr, err);
+        if (!file)
+            return false;
+        file->version = options.version;
+        try {
+            image = options.executable ? vm::VM::make_image(std::move(*file)) : file->serialize_binary();
+        }
+        catch (const std::exception &e) {
+            println(err, e.what());
+            return false;
+        }
+        if (!key.empty())
+            options.compileCache->store(key, image);
+    }
+    std::ofstream outf(output, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!outf || !outf.write(reinterpret_cast<const char *>(image.data()), image.size())) {
+        err << fmt::format("Fail to open {} for writing.\n", output);
+        return false;
+    }
+    return true;
+}
+
+// -c with many inputs, each compiled on its own on a pool of threads, to the input with the extension .o0
+// or into the directory; the errors are printed in the order of the inputs, returns the exit status
+int compile_batch(const std::vector<std::string> &inputs, const std::string &directory, size_t jobs, const BatchOptions &options) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> outputs;
+    for (auto &input : inputs) {
+        if (input == "-") {
+            fmt::print(stderr, "The source can not be read from stdin with more than one input.\n");
+            return 2;
+        }
+        fs::path output(input);
+        output.replace_extension(".o0");
+        if (!directory.empty())
+            output = fs::path(directory) / output.filename();
+        outputs.push_back(output.string());
+    }
+    if (!directory.empty()) {
+        std::error_code ec;
+        fs::create_directories(directory, ec);
+        if (ec) {
+            fmt::print(stderr, "Fail to create the directory {}: {}.\n", directory, ec.message());
+            return 2;
+        }
+    }
+    // two threads must never write the same file, also when the same input is given twice
+    // or through another path, e.g. f.c0 and ./f.c0
+    std::vector<std::string> names;
+    for (auto &output : outputs) {
+        std::error_code ec;
+        auto name = fs::weakly_canonical(fs::absolute(output), ec);
+        names.push_back(ec ? output : name.string());
+    }
+    std::sort(names.begin(), names.end());
+    if (auto it = std::adjacent_find(names.begin(), names.end()); it != names.end()) {
+        fmt::print(stderr, "More than one input is compiled to {}.\n", *it);
+        return 2;
+    }
+    std::vector<std::string> errors(inputs.size());
+    std::vector<char> failed(inputs.size());
+    {
+        ThreadPool pool(std::min(jobs, inputs.size()));
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            pool.submit([&, i] {
+                std::ostringstream err;
+                failed[i] = !compile_file(inputs[i], outputs[i], options, err);
+                errors[i] = err.str();
+            });
+        }
+    }
+    size_t failures = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        std::istringstream lines(errors[i]);
+        for (std::string line; std::getline(lines, line);)
+            fmt::print(stderr, "{}: {}\n", inputs[i], line);
+        failures += failed[i];
+    }
+    if (failures == 0)
+        return 0;
+    fmt::print(stderr, "{} of {} files failed to compile.\n", failures, inputs.size());
+    return 2;
+}
+
+// what cc0 --serve keeps between the requests
+struct ServerState {
+    // the binary files of the sources compiled, by the key of the compile cache
+    std::unordered_map<std::string, std::vector<unsigned char>> binaries;
+    std::mutex mutex;
+    // only for the keys, the binary files are kept in memory
+    vm::CompileCache compileCache;
+};
+
+// the binary files kept by the server, dropped all at once beyond
+const size_t SERVER_CACHE_ENTRIES = 1024;
+// a program run by the server stops after so many instructions, a second or two,
+// so that one that never ends does not hold a thread of the pool
+const uint64_t SERVER_RUN_INSTRUCTIONS = 500000000;
+
+// compile: the source to the binary file, run: the source run as -r does, exec: the binary file run
+vm::ServerResponse serve_request(const vm::ServerRequest &request, ServerState &state) {
+    bool lineTable = false, object = false;
+    int version = 1;
+    for (size_t i = 0; i < request.options.size(); ++i) {
+        auto &option = request.options[i];
+        if (option == "-g")
+            lineTable = true;
+        else if (option == "--object")
+            object = true;
+        else if (option == "--binary-version" && i + 1 < request.options.size()) {
+            auto &value = request.options[++i];
+            if (value != "1" && value != "2")
+                return {2, "", fmt::format("Unsupported binary file version {}.\n", value)};
+            version = value == "1" ? 1 : 2;
+        }
+        else
+            return {2, "", fmt::format("Unknown option {}.\n", option)};
+    }
+    bool run = request.command == "run" || request.command == "exec";
+    if (!run && request.command != "compile")
+        return {2, "", fmt::format("Unknown command {}.\n", request.command)};
+    if (object && run)
+        return {2, "", "An object file can not run, link it with --link first.\n"};
+    // any program fits version 2, the binary file of a run is never seen
+    if (object || run)
+        version = 2;
+
+    std::ostringstream err;
+    std::optional<File> file;
+    std::vector<unsigned char> binary;
+    if (request.command == "exec") {
+        binary.assign(request.payload.begin(), request.payload.end());
+    } else {
+        auto key = state.compileCache.key(request.payload, fmt::format("-g={} --binary-version={} --image={} --object={}",
+                                                                       lineTable, version, false, object));
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (auto it = state.binaries.find(key); it != state.binaries.end())
+                binary = it->second;
+        }
+        if (binary.empty()) {
+            file = compile(request.payload, lineTable, object, nullptr, err);
+            if (!file)
+                return {2, "", err.str()};
+            file->version = version;
+            try {
+                binary = file->serialize_binary();
+            }
+            catch (const std::exception &e) {
+                return {2, "", fmt::format("{}\n", e.what())};
+            }
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.binaries.size() >= SERVER_CACHE_ENTRIES)
+                state.binaries.clear();
+            state.binaries.emplace(key, binary);
+        }
+    }
+    if (!run)
+        return {0, std::string(binary.begin(), binary.end()), err.str()};
+    if (!file) {
+        try {
+            // the bytes are kept by the file, the functions are decoded on first call
+            auto bytes = std::make_shared<const std::vector<unsigned char>>(std::move(binary));
+            file = File::parse_binary(bytes->data(), bytes->size(), bytes);
+        }
+        catch (const std::exception &e) {
+            return {2, "", fmt::format("{}\n", e.what())};
+        }
+    }
+    std::istringstream in(request.input);
+    std::ostringstream out;
+    try {
+        auto avm = vm::VM::make_vm(std::move(*file));
+        avm->setStreams(in, out, err);
+        avm->setInstructionLimit(SERVER_RUN_INSTRUCTIONS);
+        avm->start();
+    }
+    catch (const std::exception &e) {
+        println(err, e.what());
+    }
+    return {0, out.str(), err.str()};
+}
+
+// the input sent to cc0 --serve at path, returns the exit status
+int request_server(const std::string &path, const std::string &input_file, const std::string &output_file, bool run,
+                   std::vector<std::string> options) {
+    vm::ServerRequest request;
+    request.options = std::move(options);
+    std::ifstream inf;
+    if (input_file != "-") {
+        inf.open(input_file, std::ios::in | std::ios::binary);
+        if (!inf) {
+            fmt::print(stderr, "Fail to open {} for reading.\n", input_file);
+            return 2;
+        }
+    }
+    std::istream &input = input_file != "-" ? inf : std::cin;
+    request.payload.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    if (format_of(request.payload) == InputFormat::Image) {
+        fmt::print(stderr, "An image is run without --connect, by the build of cc0 that wrote it.\n");
+        return 2;
+    }
+    if (!run) {
+        request.command = "compile";
+    } else {
+        // a binary file is run as it is, a source is compiled first
+        request.command = format_of(request.payload) == InputFormat::Binary ? "exec" : "run";
+        // what the program scans, unless the source is read from stdin
+        if (input_file != "-")
+            request.input.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    }
+    vm::ServerResponse response;
+    if (std::string err; !vm::CompileServer::request(path, request, response, err)) {
+        fmt::print(stderr, "Fail to request {}: {}.\n", path, err);
+        return 2;
+    }
+    std::cerr << response.errors;
+    if (run) {
+        std::cout << response.output;
+    } else if (response.status == 0) {
+        std::ofstream outf(output_file, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!outf) {
+            fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
+            return 2;
+        }
+        outf.write(response.output.data(), response.output.size());
+    }
+    return response.status;
+}
+
+
+// the number of input files, the first positional argument and the ones right after it,
+// so that they are all given to input with nargs
+size_t count_inputs(int argc, char **argv) {
+    // the options followed by a value
+    static const std::unordered_set<std::string_view> valued{
+        "--binary-version", "-o", "--output", "-j", "--jobs", "--profile", "--profile-interval",
+        "--profile-timer", "--time-report-json", "--serve", "--connect"
+    };
+    const auto is_option = [](std::string_view arg) {
+        // as argparse does, negative numbers are positional
+        return !arg.empty() && arg[0] == '-' && !(arg.size() > 1 && (std::isdigit((unsigned char) arg[1]) || arg[1] == '.'));
+    };
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (!is_option(arg)) {
+            int end = i;
+            while (end < argc && !is_option(argv[end]))
+                end++;
+            return end - i;
+        }
+        if (valued.count(arg))
+            i++;
+        else if (arg.size() > 1 && arg[1] != '-')
+            // many short options such as -gc, each of -o and -j takes the next argument
+            for (auto c : arg.substr(1))
+                i += valued.count(std::string{ '-', c });
+    }
+    return 0;
+}
 
 int main(int argc, char **argv) {
     argparse::ArgumentParser program("cc0");
     program.add_argument("input")
-            .help("speicify the file to be compiled.");
+            .nargs(std::max<size_t>(1, count_inputs(argc, argv)))
+            .default_value(std::vector<std::string>())
+            .help("speicify the file to be compiled, or with --link the object files to be linked.");
     program.add_argument("-t")
             .default_value(false)
             .implicit_value(true)
@@ -99,13 +552,77 @@ int main(int argc, char **argv) {
             .default_value(false)
             .implicit_value(true)
             .help("perform syntactic analysis for the input file to binary file.");
+    program.add_argument("-g")
+            .default_value(false)
+            .implicit_value(true)
+            .help("with -s, -c or -r, emit the source line table.");
+    program.add_argument("--binary-version")
+            .default_value(1)
+            .action([](const std::string &value) {
+                if (value != "1" && value != "2")
+                    throw std::runtime_error("error: --binary-version: 1 or 2 expected, " + value + " provided.");
+                return value == "1" ? 1 : 2;
+            })
+            .help("with -c or -r, the version of the binary file, 1 or 2 (32-bit counts, smaller files).");
     program.add_argument("-o", "--output")
-            .default_value(std::string("out"))
-            .help("specify the output file.");
+            .default_value(std::string(""))
+            .help("specify the output file, or the directory of the outputs of -c with many inputs.");
+    program.add_argument("-j", "--jobs")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); })
+            .help("with -c and many inputs or --serve, the number of threads, the number of CPUs by default.");
     program.add_argument("-r")
             .default_value(false)
             .implicit_value(true)
             .help("Run you code input file directly.");
+    program.add_argument("--image")
+            .default_value(false)
+            .implicit_value(true)
+            .help("with -c or -r, write an execution image for this build of cc0 instead of a binary file.");
+    program.add_argument("--object")
+            .default_value(false)
+            .implicit_value(true)
+            .help("with -s or -c, compile to an object file (always version 2) to be linked with others.");
+    program.add_argument("--link")
+            .default_value(false)
+            .implicit_value(true)
+            .help("link the object files into one binary file, also with -r, --image and --binary-version.");
+    program.add_argument("--cache")
+            .default_value(false)
+            .implicit_value(true)
+            .help("with -c or -r, reuse the binary file of an unchanged source from $XDG_CACHE_HOME/cc0.");
+    program.add_argument("--profile")
+            .default_value(std::string(""))
+            .help("with -r, write sampled call stacks in folded format (for flamegraph.pl) to the file.");
+    program.add_argument("--profile-interval")
+            .default_value(1000)
+            .action([](const std::string &value) { return std::stoi(value); })
+            .help("take a sample every N executed instructions.");
+    program.add_argument("--profile-timer")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); })
+            .help("take samples on SIGPROF at the given frequency (Hz) instead.");
+    program.add_argument("--perf-counters")
+            .default_value(false)
+            .implicit_value(true)
+            .help("with -r, report cycles, instructions, branch and L1d misses of the run.");
+    program.add_argument("--perf-per-function")
+            .default_value(false)
+            .implicit_value(true)
+            .help("with --perf-counters, attribute the counters to each C0 function.");
+    program.add_argument("--time-report")
+            .default_value(false)
+            .implicit_value(true)
+            .help("report the wall time, CPU time and peak RSS growth of each stage of cc0 to stderr.");
+    program.add_argument("--time-report-json")
+            .default_value(std::string(""))
+            .help("write the time report as JSON to the file.");
+    program.add_argument("--serve")
+            .default_value(std::string(""))
+            .help("listen on the Unix domain socket for compile and run requests until SIGINT or SIGTERM.");
+    program.add_argument("--connect")
+            .default_value(std::string(""))
+            .help("with -c or -r, send the input to the server listening on the socket.");
 
     try {
         program.parse_args(argc, argv);
@@ -116,16 +633,104 @@ int main(int argc, char **argv) {
         exit(2);
     }
 
-    auto input_file = program.get<std::string>("input");
+    // the samples are taken from a run in this process
+    if (!program.get<std::string>("--profile").empty() &&
+        (program["-r"] == false || !program.get<std::string>("--serve").empty() || !program.get<std::string>("--connect").empty())) {
+        fmt::print(stderr, "--profile goes with -r only, and not with --serve or --connect.\n");
+        exit(2);
+    }
+    auto jobs = program.get<int>("--jobs");
+    if (jobs <= 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    if (auto path = program.get<std::string>("--serve"); !path.empty()) {
+        ServerState state;
+        vm::CompileServer server(path, jobs);
+        if (std::string err; !server.listen(err)) {
+            fmt::print(stderr, "Fail to listen on {}: {}.\n", path, err);
+            exit(2);
+        }
+        server.serve([&state](const vm::ServerRequest &request) { return serve_request(request, state); });
+        return 0;
+    }
+    auto time_report_file = program.get<std::string>("--time-report-json");
+    std::unique_ptr<vm::TimeReport> report;
+    if (program["--time-report"] == true || !time_report_file.empty())
+        report = std::make_unique<vm::TimeReport>();
+    // at the end of the run
+    const auto output_report = [&] {
+        if (report && program["--time-report"] == true)
+            report->report(std::cerr);
+        if (report && !time_report_file.empty()) {
+            std::ofstream reportf(time_report_file, std::ios::out | std::ios::trunc);
+            if (!reportf) {
+                fmt::print(stderr, "Fail to open {} for writing.\n", time_report_file);
+                exit(2);
+            }
+            report->output_json(reportf);
+        }
+    };
+    auto inputs = program.get<std::vector<std::string>>("input");
+    // not required for --serve only
+    if (inputs.empty()) {
+        fmt::print(stderr, "error: input: expected 1 argument(s). 0 provided.\n\n");
+        program.print_help();
+        exit(2);
+    }
+    auto input_file = inputs.front();
     auto output_file = program.get<std::string>("--output");
+    bool link = program["--link"] == true;
+    if (inputs.size() > 1 && !link) {
+        if (program["-c"] == false || program["-r"] == true || !program.get<std::string>("--connect").empty()) {
+            fmt::print(stderr, "Only the sources compiled by -c or the object files to be linked can be more than one.\n");
+            exit(2);
+        }
+        vm::CompileCache compileCache;
+        BatchOptions options;
+        options.lineTable = program["-g"] == true;
+        options.object = program["--object"] == true;
+        options.executable = program["--image"] == true;
+        options.version = options.object ? 2 : program.get<int>("--binary-version");
+        options.compileCache = program["--cache"] == true && compileCache.enabled() ? &compileCache : nullptr;
+        if (options.object && options.executable) {
+            fmt::print(stderr, "An object file can not run, link it with --link first.\n");
+            exit(2);
+        }
+        int status;
+        {
+            vm::TimeReport::Scope scope(report.get(), "compile batch");
+            status = compile_batch(inputs, output_file, jobs, options);
+        }
+        if (report)
+            report->count("files", inputs.size());
+        output_report();
+        return status;
+    }
+    if (output_file.empty())
+        output_file = "out";
+    if (link && (program["-t"] == true || program["-s"] == true || program["-c"] == true || program["--object"] == true)) {
+        fmt::print(stderr, "--link goes with -o, -r, --image and --binary-version only.\n");
+        exit(2);
+    }
+    if (auto path = program.get<std::string>("--connect"); !path.empty()) {
+        bool run = program["-r"] == true;
+        if (link || program["-t"] == true || program["-s"] == true || program["--image"] == true || run == (program["-c"] == true)) {
+            fmt::print(stderr, "--connect goes with either -c or -r, and -o, -g, --object and --binary-version.\n");
+            exit(2);
+        }
+        std::vector<std::string> options{"--binary-version", std::to_string(program.get<int>("--binary-version"))};
+        if (program["-g"] == true)
+            options.push_back("-g");
+        if (program["--object"] == true)
+            options.push_back("--object");
+        return request_server(path, input_file, output_file, run, std::move(options));
+    }
     std::istream *input;
     std::ostream *output;
-    std::ifstream *cache;
     std::ifstream inf;
-    std::ifstream infcache;
-    std::ofstream outcache;
     std::ofstream outf;
-    if (input_file != "-") {
+    if (link) {
+        input = nullptr;
+    } else if (input_file != "-") {
         inf.open(input_file, std::ios::in);
         if (!inf) {
             fmt::print(stderr, "Fail to open {} for reading.\n", input_file);
@@ -134,7 +739,7 @@ int main(int argc, char **argv) {
         input = &inf;
     } else
         input = &std::cin;
-    if (output_file != "-" && program["-c"] == false && program["-r"] == false) {
+    if (output_file != "-" && program["-c"] == false && program["-r"] == false && !link) {
         outf.open(output_file, std::ios::out | std::ios::trunc);
         if (!outf) {
             fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
@@ -156,53 +761,163 @@ int main(int argc, char **argv) {
         fmt::print(stderr, "You can only perform tokenization or syntactic analysis at one time.");
         exit(2);
     }
-    if (program["-t"] == true) {
-        Tokenize(*input, *output);
+    auto version = program.get<int>("--binary-version");
+    bool executable = program["--image"] == true;
+    bool run = program["-r"] == true;
+    // -r alone runs the program in memory, an image is run from the output file
+    bool write = !run || program["-c"] == true || executable;
+    auto image_file = output_file;
+    // the compiled or linked program, or the binary file, or the image, read from the cache
+    std::optional<File> file;
+    std::vector<unsigned char> image;
+    vm::CompileCache compileCache;
+    std::string key;
+    if (link) {
+        file = link_objects(inputs, report.get());
+        if (!file)
+            exit(2);
+    } else if (program["-t"] == true) {
+        Tokenize(*input, *output, report.get());
     } else if (program["-s"] == true) {
-        Analyse(*input, *output);
-    } else if (program["-c"] == true || program["-r"] == true) {
-        outcache.open("cache", std::ios::out | std::ios::trunc);
-        if (!outcache) {
-            fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
+        Analyse(*input, *output, program["-g"] == true, program["--object"] == true, report.get());
+    } else if (auto format = run && program["-c"] == false ? format_of_file(input_file) : InputFormat::Source;
+               format == InputFormat::Image) {
+        // mapped and run as it is, nothing is compiled or written
+        image_file = input_file;
+        executable = true;
+        write = false;
+    } else if (format == InputFormat::Binary) {
+        // a binary file, linked or compiled before, the functions are decoded on first call
+        try {
+            vm::TimeReport::Scope scope(report.get(), "load binary");
+            inf.close();
+            file = File::load_binary(input_file);
+        }
+        catch (const std::exception &e) {
+            println(std::cerr, input_file + ":", e.what());
             exit(2);
         }
-        output = &outcache;
-
-        Analyse(*input, *output);
-        outcache.close();
-
-        infcache.open("cache", std::ios::in);
-        cache = &infcache;
-        outf.open(output_file, std::ios::binary | std::ios::out | std::ios::trunc);
-        if (!outf) {
+        if (file->is_object()) {
+            fmt::print(stderr, "An object file can not run, link it with --link first.\n");
+            exit(2);
+        }
+    } else if (program["-c"] == true || run) {
+        bool object = program["--object"] == true;
+        if (object && (executable || run)) {
+            fmt::print(stderr, "An object file can not run, link it with --link first.\n");
+            exit(2);
+        }
+        if (object)
+            version = 2;
+        // the tokenizer reads the source in place
+        Source source;
+        try {
+            vm::TimeReport::Scope scope(report.get(), "read input");
             inf.close();
+            source = read_source(input_file);
+        }
+        catch (const std::exception &) {
+            fmt::print(stderr, "Fail to open {} for reading.\n", input_file);
             exit(2);
         }
-        output = &outf;
-        assemble_text(cache, dynamic_cast<std::ofstream *>(output));
+        if (program["--cache"] == true && compileCache.enabled()) {
+            vm::TimeReport::Scope scope(report.get(), "cache lookup");
+            key = compileCache.key(source.text(), fmt::format("-g={} --binary-version={} --image={} --object={}",
+                                                       program["-g"] == true, version, executable, object));
+        }
+        bool hit = false;
+        if (!key.empty()) {
+            vm::TimeReport::Scope scope(report.get(), "cache lookup");
+            hit = compileCache.load(key, image);
+        }
+        if (!hit) {
+            file = compile(source.text(), program["-g"] == true, object, report.get(), std::cerr);
+            if (!file)
+                exit(2);
+        }
     } else {
         inf.close();
-        infcache.close();
-        outcache.close();
         outf.close();
         fmt::print(stderr, "You must choose tokenization or syntactic analysis.");
         exit(2);
     }
-    if (program["-r"] == true) {
-        outf.close();
-        infcache.close();
-        infcache.open(output_file, std::ios::binary | std::ios::in);
-        if (!infcache) {
+    if (file && (write || !key.empty())) {
+        file->version = version;
+        try {
+            vm::TimeReport::Scope scope(report.get(), executable ? "make image" : "serialize");
+            if (executable) {
+                image = vm::VM::make_image(std::move(*file));
+                file.reset();
+            } else {
+                image = file->serialize_binary();
+            }
+        }
+        catch (const std::exception &e) {
+            println(std::cerr, e.what());
             exit(2);
         }
-        cache = &infcache;
-        output = &std::cout;
-        execute(cache, output);
+        if (!key.empty()) {
+            vm::TimeReport::Scope scope(report.get(), "cache store");
+            compileCache.store(key, image);
+        }
+    }
+    if (!image.empty() && write) {
+        vm::TimeReport::Scope scope(report.get(), "write output");
+        outf.open(output_file, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!outf) {
+            fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
+            exit(2);
+        }
+        outf.write(reinterpret_cast<const char *>(image.data()), image.size());
+    }
+    if (run && !executable && !file) {
+        // a binary file from the cache, the functions are decoded on first call
+        try {
+            vm::TimeReport::Scope scope(report.get(), "load binary");
+            auto bytes = std::make_shared<const std::vector<unsigned char>>(std::move(image));
+            file = File::parse_binary(bytes->data(), bytes->size(), bytes);
+        }
+        catch (const std::exception &e) {
+            println(std::cerr, e.what());
+            exit(2);
+        }
+    }
+    if (run) {
+        outf.close();
+        auto profile_file = program.get<std::string>("--profile");
+        std::unique_ptr<vm::SampleProfiler> profiler;
+        if (!profile_file.empty()) {
+            profiler = std::make_unique<vm::SampleProfiler>(program.get<int>("--profile-interval"));
+            if (auto hz = program.get<int>("--profile-timer"); hz > 0 && !profiler->startTimer(hz)) {
+                fmt::print(stderr, "Fail to start the profiling timer, sampling every {} instructions.\n",
+                           program.get<int>("--profile-interval"));
+            }
+        }
+        std::unique_ptr<vm::PerfCounters> perf;
+        if (program["--perf-counters"] == true || program["--perf-per-function"] == true) {
+            perf = std::make_unique<vm::PerfCounters>(program["--perf-per-function"] == true);
+            if (std::string err; !perf->open(err)) {
+                fmt::print(stderr, "Performance counters unavailable ({}), running without them.\n", err);
+                perf.reset();
+            }
+        }
+        execute(std::move(file), image_file, executable, profiler.get(), perf.get(), report.get());
+        if (perf) {
+            perf->report(std::cerr);
+        }
+        if (profiler) {
+            profiler->stopTimer();
+            std::ofstream proff(profile_file, std::ios::out | std::ios::trunc);
+            if (!proff) {
+                fmt::print(stderr, "Fail to open {} for writing.\n", profile_file);
+                exit(2);
+            }
+            profiler->output_folded(proff);
+        }
 
     }
     inf.close();
-    infcache.close();
-    outcache.close();
     outf.close();
+    output_report();
     return 0;
 }
\ No newline at end of file
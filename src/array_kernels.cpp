@@ -0,0 +1,383 @@
+#include "./array_kernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CC0_HAS_SSE2 1
+#endif
+
+#if defined(CC0_HAS_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CC0_HAS_AVX2 1
+#define CC0_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace vm {
+namespace kernels {
+
+namespace scalar {
+
+template <typename T>
+void fill(T* dst, T value, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        dst[i] = value;
+    }
+}
+
+// wraps instead of overflowing
+inline u4 sum(const i4* a, std::size_t n, u4 acc) {
+    for (std::size_t i = 0; i < n; ++i) {
+        acc += static_cast<u4>(a[i]);
+    }
+    return acc;
+}
+
+inline f8 sum(const f8* a, std::size_t n, f8 acc) {
+    for (std::size_t i = 0; i < n; ++i) {
+        acc += a[i];
+    }
+    return acc;
+}
+
+inline u4 dot(const i4* a, const i4* b, std::size_t n, u4 acc) {
+    for (std::size_t i = 0; i < n; ++i) {
+        acc += static_cast<u4>(a[i]) * static_cast<u4>(b[i]);
+    }
+    return acc;
+}
+
+inline f8 dot(const f8* a, const f8* b, std::size_t n, f8 acc) {
+    for (std::size_t i = 0; i < n; ++i) {
+        acc += a[i] * b[i];
+    }
+    return acc;
+}
+
+template <typename T>
+T min(const T* a, std::size_t n, T acc) {
+    for (std::size_t i = 0; i < n; ++i) {
+        acc = a[i] < acc ? a[i] : acc;
+    }
+    return acc;
+}
+
+template <typename T>
+T max(const T* a, std::size_t n, T acc) {
+    for (std::size_t i = 0; i < n; ++i) {
+        acc = a[i] > acc ? a[i] : acc;
+    }
+    return acc;
+}
+
+}
+
+#ifdef CC0_HAS_SSE2
+namespace sse2 {
+
+inline __m128i load(const i4* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+// SSE2 has neither pmulld nor pminsd/pmaxsd
+inline __m128i mullo(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd,  _MM_SHUFFLE(0, 0, 2, 0)));
+}
+inline __m128i min(__m128i a, __m128i b) {
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+inline __m128i max(__m128i a, __m128i b) {
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+inline void lanes(__m128i v, i4 (&out)[4]) { _mm_storeu_si128(reinterpret_cast<__m128i*>(out), v); }
+inline void lanes(__m128d v, f8 (&out)[2]) { _mm_storeu_pd(out, v); }
+
+void fill(i4* dst, i4 value, std::size_t n) {
+    __m128i v = _mm_set1_epi32(value);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+    scalar::fill(dst + i, value, n - i);
+}
+
+void fill(f8* dst, f8 value, std::size_t n) {
+    __m128d v = _mm_set1_pd(value);
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, v);
+    }
+    scalar::fill(dst + i, value, n - i);
+}
+
+i4 sum(const i4* a, std::size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_epi32(acc, load(a + i));
+    }
+    i4 l[4];
+    lanes(acc, l);
+    u4 s = static_cast<u4>(l[0]) + static_cast<u4>(l[1]) + static_cast<u4>(l[2]) + static_cast<u4>(l[3]);
+    return static_cast<i4>(scalar::sum(a + i, n - i, s));
+}
+
+f8 sum(const f8* a, std::size_t n) {
+    __m128d acc = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_add_pd(acc, _mm_loadu_pd(a + i));
+    }
+    f8 l[2];
+    lanes(acc, l);
+    return scalar::sum(a + i, n - i, l[0] + l[1]);
+}
+
+i4 dot(const i4* a, const i4* b, std::size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_epi32(acc, mullo(load(a + i), load(b + i)));
+    }
+    i4 l[4];
+    lanes(acc, l);
+    u4 s = static_cast<u4>(l[0]) + static_cast<u4>(l[1]) + static_cast<u4>(l[2]) + static_cast<u4>(l[3]);
+    return static_cast<i4>(scalar::dot(a + i, b + i, n - i, s));
+}
+
+f8 dot(const f8* a, const f8* b, std::size_t n) {
+    __m128d acc = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    f8 l[2];
+    lanes(acc, l);
+    return scalar::dot(a + i, b + i, n - i, l[0] + l[1]);
+}
+
+i4 min(const i4* a, std::size_t n) {
+    __m128i acc = _mm_set1_epi32(std::numeric_limits<i4>::max());
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = min(acc, load(a + i));
+    }
+    i4 l[4];
+    lanes(acc, l);
+    return scalar::min(a + i, n - i, scalar::min(l, 4, l[0]));
+}
+
+i4 max(const i4* a, std::size_t n) {
+    __m128i acc = _mm_set1_epi32(std::numeric_limits<i4>::min());
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = max(acc, load(a + i));
+    }
+    i4 l[4];
+    lanes(acc, l);
+    return scalar::max(a + i, n - i, scalar::max(l, 4, l[0]));
+}
+
+f8 min(const f8* a, std::size_t n) {
+    __m128d acc = _mm_set1_pd(std::numeric_limits<f8>::infinity());
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_min_pd(_mm_loadu_pd(a + i), acc);
+    }
+    f8 l[2];
+    lanes(acc, l);
+    return scalar::min(a + i, n - i, scalar::min(l, 2, l[0]));
+}
+
+f8 max(const f8* a, std::size_t n) {
+    __m128d acc = _mm_set1_pd(-std::numeric_limits<f8>::infinity());
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_max_pd(_mm_loadu_pd(a + i), acc);
+    }
+    f8 l[2];
+    lanes(acc, l);
+    return scalar::max(a + i, n - i, scalar::max(l, 2, l[0]));
+}
+
+}
+#endif
+
+#ifdef CC0_HAS_AVX2
+namespace avx2 {
+
+CC0_TARGET_AVX2 inline __m256i load(const i4* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+
+CC0_TARGET_AVX2 inline void lanes(__m256i v, i4 (&out)[8]) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v); }
+CC0_TARGET_AVX2 inline void lanes(__m256d v, f8 (&out)[4]) { _mm256_storeu_pd(out, v); }
+
+CC0_TARGET_AVX2 void fill(i4* dst, i4 value, std::size_t n) {
+    __m256i v = _mm256_set1_epi32(value);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    }
+    scalar::fill(dst + i, value, n - i);
+}
+
+CC0_TARGET_AVX2 void fill(f8* dst, f8 value, std::size_t n) {
+    __m256d v = _mm256_set1_pd(value);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, v);
+    }
+    scalar::fill(dst + i, value, n - i);
+}
+
+CC0_TARGET_AVX2 i4 sum(const i4* a, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm256_add_epi32(acc, load(a + i));
+    }
+    i4 l[8];
+    lanes(acc, l);
+    return static_cast<i4>(scalar::sum(a + i, n - i, scalar::sum(l, 8, 0)));
+}
+
+CC0_TARGET_AVX2 f8 sum(const f8* a, std::size_t n) {
+    __m256d acc = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_add_pd(acc, _mm256_loadu_pd(a + i));
+    }
+    f8 l[4];
+    lanes(acc, l);
+    return scalar::sum(a + i, n - i, (l[0] + l[1]) + (l[2] + l[3]));
+}
+
+CC0_TARGET_AVX2 i4 dot(const i4* a, const i4* b, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(load(a + i), load(b + i)));
+    }
+    i4 l[8];
+    lanes(acc, l);
+    return static_cast<i4>(scalar::dot(a + i, b + i, n - i, scalar::sum(l, 8, 0)));
+}
+
+CC0_TARGET_AVX2 f8 dot(const f8* a, const f8* b, std::size_t n) {
+    __m256d acc = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    f8 l[4];
+    lanes(acc, l);
+    return scalar::dot(a + i, b + i, n - i, (l[0] + l[1]) + (l[2] + l[3]));
+}
+
+CC0_TARGET_AVX2 i4 min(const i4* a, std::size_t n) {
+    __m256i acc = _mm256_set1_epi32(std::numeric_limits<i4>::max());
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm256_min_epi32(acc, load(a + i));
+    }
+    i4 l[8];
+    lanes(acc, l);
+    return scalar::min(a + i, n - i, scalar::min(l, 8, l[0]));
+}
+
+CC0_TARGET_AVX2 i4 max(const i4* a, std::size_t n) {
+    __m256i acc = _mm256_set1_epi32(std::numeric_limits<i4>::min());
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm256_max_epi32(acc, load(a + i));
+    }
+    i4 l[8];
+    lanes(acc, l);
+    return scalar::max(a + i, n - i, scalar::max(l, 8, l[0]));
+}
+
+CC0_TARGET_AVX2 f8 min(const f8* a, std::size_t n) {
+    __m256d acc = _mm256_set1_pd(std::numeric_limits<f8>::infinity());
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_min_pd(_mm256_loadu_pd(a + i), acc);
+    }
+    f8 l[4];
+    lanes(acc, l);
+    return scalar::min(a + i, n - i, scalar::min(l, 4, l[0]));
+}
+
+CC0_TARGET_AVX2 f8 max(const f8* a, std::size_t n) {
+    __m256d acc = _mm256_set1_pd(-std::numeric_limits<f8>::infinity());
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_max_pd(_mm256_loadu_pd(a + i), acc);
+    }
+    f8 l[4];
+    lanes(acc, l);
+    return scalar::max(a + i, n - i, scalar::max(l, 4, l[0]));
+}
+
+}
+#endif
+
+static bool hasAvx2() {
+#ifdef CC0_HAS_AVX2
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+#else
+    return false;
+#endif
+}
+
+#if defined(CC0_HAS_AVX2)
+#define DISPATCH(fn, ...) return hasAvx2() ? avx2::fn(__VA_ARGS__) : sse2::fn(__VA_ARGS__)
+#elif defined(CC0_HAS_SSE2)
+#define DISPATCH(fn, ...) return sse2::fn(__VA_ARGS__)
+#else
+#define DISPATCH(fn, ...) return generic::fn(__VA_ARGS__)
+#endif
+
+#if !defined(CC0_HAS_SSE2)
+namespace generic {
+void fill(i4* dst, i4 value, std::size_t n) { scalar::fill(dst, value, n); }
+void fill(f8* dst, f8 value, std::size_t n) { scalar::fill(dst, value, n); }
+i4 sum(const i4* a, std::size_t n) { return static_cast<i4>(scalar::sum(a, n, 0)); }
+f8 sum(const f8* a, std::size_t n) { return scalar::sum(a, n, 0.0); }
+i4 dot(const i4* a, const i4* b, std::size_t n) { return static_cast<i4>(scalar::dot(a, b, n, 0)); }
+f8 dot(const f8* a, const f8* b, std::size_t n) { return scalar::dot(a, b, n, 0.0); }
+i4 min(const i4* a, std::size_t n) { return scalar::min(a, n, std::numeric_limits<i4>::max()); }
+i4 max(const i4* a, std::size_t n) { return scalar::max(a, n, std::numeric_limits<i4>::min()); }
+f8 min(const f8* a, std::size_t n) { return scalar::min(a, n, std::numeric_limits<f8>::infinity()); }
+f8 max(const f8* a, std::size_t n) { return scalar::max(a, n, -std::numeric_limits<f8>::infinity()); }
+}
+#endif
+
+void fill(i4* dst, i4 value, std::size_t n) { DISPATCH(fill, dst, value, n); }
+void fill(f8* dst, f8 value, std::size_t n) { DISPATCH(fill, dst, value, n); }
+i4 sum(const i4* a, std::size_t n) { DISPATCH(sum, a, n); }
+f8 sum(const f8* a, std::size_t n) { DISPATCH(sum, a, n); }
+i4 dot(const i4* a, const i4* b, std::size_t n) { DISPATCH(dot, a, b, n); }
+f8 dot(const f8* a, const f8* b, std::size_t n) { DISPATCH(dot, a, b, n); }
+i4 min(const i4* a, std::size_t n) { DISPATCH(min, a, n); }
+i4 max(const i4* a, std::size_t n) { DISPATCH(max, a, n); }
+f8 min(const f8* a, std::size_t n) { DISPATCH(min, a, n); }
+f8 max(const f8* a, std::size_t n) { DISPATCH(max, a, n); }
+
+#undef DISPATCH
+
+const char* path() {
+#if defined(CC0_HAS_SSE2)
+    return hasAvx2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+}
+}
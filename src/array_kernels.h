@@ -0,0 +1,39 @@
+#ifndef ARRAY_KERNELS_H_INCLUDED
+#define ARRAY_KERNELS_H_INCLUDED
+
+#include "./type.h"
+
+#include <cstddef>
+
+namespace vm {
+
+// Kernels behind the array builtins (ifill, dsum, ddot, ...).
+// On x86 they use AVX2 if the CPU has it (checked once at run time) and
+// SSE2 otherwise, elsewhere plain loops. Pointers need not be aligned.
+// Integer arithmetic wraps like iadd/imul; double sums and dot products
+// are accumulated in vector lanes, so their rounding depends on the path.
+namespace kernels {
+
+void fill(i4* dst, i4 value, std::size_t n);
+void fill(f8* dst, f8 value, std::size_t n);
+
+i4 sum(const i4* a, std::size_t n);
+f8 sum(const f8* a, std::size_t n);
+
+i4 dot(const i4* a, const i4* b, std::size_t n);
+f8 dot(const f8* a, const f8* b, std::size_t n);
+
+// INT32_MAX / INT32_MIN / +inf / -inf for n == 0
+i4 min(const i4* a, std::size_t n);
+i4 max(const i4* a, std::size_t n);
+f8 min(const f8* a, std::size_t n);
+f8 max(const f8* a, std::size_t n);
+
+// "avx2", "sse2" or "scalar"
+const char* path();
+
+}
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "./compile_cache.h"
+#include "./util/sha256.hpp"
+#include "./util/print.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vm {
+
+// bumped when the layout of the key or of the entries changes
+static const char* const cacheFormat = "cc0 compile cache 1";
+
+CompileCache::CompileCache() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg == '/') {
+        _directory = std::string(xdg) + "/cc0";
+    }
+    else if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        _directory = std::string(home) + "/.cache/cc0";
+    }
+    // a rebuilt compiler has another size or modification time,
+    // without /proc the build time of this file stands in for it
+    struct stat st;
+    if (::stat("/proc/self/exe", &st) == 0) {
+        _compiler = strfmt("{} {} {}.{}", st.st_size, st.st_ino, st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    }
+    else {
+        _compiler = __DATE__ " " __TIME__;
+    }
+}
+
+std::string CompileCache::key(std::string_view source, std::string_view options) const {
+    Sha256 h;
+    // every part is preceded by its size, so no two inputs give the same bytes
+    for (std::string_view part : { std::string_view(cacheFormat), std::string_view(_compiler), options, source }) {
+        auto size = std::to_string(part.size()) + ":";
+        h.update(size);
+        h.update(part);
+    }
+    return Sha256::to_hex(h.finish());
+}
+
+std::string CompileCache::pathOf(const std::string& key) const {
+    return _directory + "/" + key + ".o0";
+}
+
+bool CompileCache::load(const std::string& key, std::vector<unsigned char>& image) const {
+    if (!enabled()) {
+        return false;
+    }
+    std::ifstream in(pathOf(key), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    image.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !in.bad() && !image.empty();
+}
+
+void CompileCache::store(const std::string& key, const std::vector<unsigned char>& image) const {
+    if (!enabled()) {
+        return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(_directory, ec);
+    if (ec) {
+        return;
+    }
+    auto path = pathOf(key);
+    // one temporary file per writer: threads of this process (-c -j N) storing
+    // the same key must not truncate each other's file before the rename
+    static std::atomic<unsigned long> writers{ 0 };
+    auto temp = strfmt("{}.{}.{}.tmp", path, ::getpid(), writers.fetch_add(1, std::memory_order_relaxed));
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(image.data()), image.size());
+        if (!out.flush()) {
+            out.close();
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp, ec);
+    }
+}
+
+}
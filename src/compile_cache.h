@@ -0,0 +1,39 @@
+#ifndef COMPILE_CACHE_H_INCLUDED
+#define COMPILE_CACHE_H_INCLUDED
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vm {
+
+// Binary files of compiled sources, one file per key in $XDG_CACHE_HOME/cc0
+// (~/.cache/cc0 without it). The key is the SHA-256 of the source, the
+// options that change the binary file and the identity of the compiler
+// executable, so a rebuilt compiler never reuses the entries of another.
+// Failures to read or write the cache only cost a compilation.
+class CompileCache {
+public:
+    // the directory is created by the first store
+    CompileCache();
+
+    bool enabled() const noexcept { return !_directory.empty(); }
+    const std::string& directory() const noexcept { return _directory; }
+
+    std::string key(std::string_view source, std::string_view options) const;
+    // false on a miss
+    bool load(const std::string& key, std::vector<unsigned char>& image) const;
+    // the entry is written to a temporary file of its own and renamed, so a
+    // concurrent run or thread sees either the whole entry or none
+    void store(const std::string& key, const std::vector<unsigned char>& image) const;
+
+private:
+    std::string pathOf(const std::string& key) const;
+
+    std::string _directory;
+    std::string _compiler;
+};
+
+}
+
+#endif
@@ -0,0 +1,260 @@
+#include "./compile_server.h"
+#include "./util/thread_pool.hpp"
+#include "./util/print.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sstream>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace vm {
+
+// a longer header or a larger payload is not a request of cc0
+static const size_t MAX_HEADER_SIZE = 4096;
+static const size_t MAX_BODY_SIZE = size_t(1) << 28;
+// a client that stops sending or reading does not hold a thread for longer
+static const int IO_TIMEOUT_SECONDS = 30;
+
+static volatile std::sig_atomic_t stopping = 0;
+
+static void onStop(int) {
+    stopping = 1;
+}
+
+static bool readFull(int fd, char* data, size_t size) {
+    while (size > 0) {
+        auto n = ::read(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool writeFull(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        // MSG_NOSIGNAL, a client gone away is not a SIGPIPE
+        auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// the header is short, it is read a byte at a time so nothing after it is consumed
+static bool readLine(int fd, std::string& line) {
+    line.clear();
+    char ch;
+    while (line.size() < MAX_HEADER_SIZE && readFull(fd, &ch, 1)) {
+        if (ch == '\n') {
+            return true;
+        }
+        line.push_back(ch);
+    }
+    return false;
+}
+
+static bool readBody(int fd, size_t size, std::string& body) {
+    body.resize(size);
+    return size == 0 || readFull(fd, body.data(), size);
+}
+
+static bool readRequest(int fd, ServerRequest& request) {
+    std::string line;
+    if (!readLine(fd, line)) {
+        return false;
+    }
+    std::istringstream header(line);
+    size_t payloadSize, inputSize;
+    if (!(header >> request.command >> payloadSize >> inputSize)
+        || payloadSize > MAX_BODY_SIZE || inputSize > MAX_BODY_SIZE) {
+        return false;
+    }
+    for (std::string option; header >> option;) {
+        request.options.push_back(std::move(option));
+    }
+    return readBody(fd, payloadSize, request.payload) && readBody(fd, inputSize, request.input);
+}
+
+static bool writeResponse(int fd, const ServerResponse& response) {
+    auto header = strfmt("{} {} {}\n", response.status, response.output.size(), response.errors.size());
+    return writeFull(fd, header.data(), header.size())
+        && writeFull(fd, response.output.data(), response.output.size())
+        && writeFull(fd, response.errors.data(), response.errors.size());
+}
+
+static void setTimeout(int fd) {
+    timeval tv{};
+    tv.tv_sec = IO_TIMEOUT_SECONDS;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+}
+
+// false if the path does not fit in a sockaddr_un
+static bool socketAddress(const std::string& path, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof addr.sun_path) {
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    return true;
+}
+
+CompileServer::CompileServer(std::string path, size_t threads) : _path(std::move(path)), _threads(threads), _fd(-1) {
+    //
+}
+
+CompileServer::~CompileServer() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        ::unlink(_path.c_str());
+    }
+}
+
+bool CompileServer::listen(std::string& error) {
+    sockaddr_un addr;
+    if (!socketAddress(_path, addr)) {
+        error = "the path of the socket is empty or too long";
+        return false;
+    }
+    struct stat st;
+    if (::stat(_path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            error = _path + " exists and is not a socket";
+            return false;
+        }
+        // the socket of a server that did not remove it, unless the server is still there
+        int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        bool alive = probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0;
+        if (probe >= 0) {
+            ::close(probe);
+        }
+        if (alive) {
+            error = "another server listens on " + _path;
+            return false;
+        }
+        ::unlink(_path.c_str());
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        error = std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    if (::listen(fd, SOMAXCONN) != 0) {
+        error = std::strerror(errno);
+        ::close(fd);
+        ::unlink(_path.c_str());
+        return false;
+    }
+    _fd = fd;
+    return true;
+}
+
+void CompileServer::serve(const Handler& handler) {
+    // without SA_RESTART, so the signal interrupts accept
+    struct sigaction action {};
+    action.sa_handler = onStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // the workers inherit the blocked signals, the signals go to this thread
+    sigset_t signals, old;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old);
+    ThreadPool pool(_threads);
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+
+    while (!stopping) {
+        int client = ::accept(_fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                println(std::cerr, "accept:", std::strerror(errno));
+                break;
+            }
+            continue;
+        }
+        pool.submit([client, &handler] {
+            setTimeout(client);
+            ServerRequest request;
+            ServerResponse response;
+            if (readRequest(client, request)) {
+                try {
+                    response = handler(request);
+                }
+                catch (const std::exception& e) {
+                    response = ServerResponse{ 2, "", strfmt("{}\n", e.what()) };
+                }
+            }
+            else {
+                response = ServerResponse{ 2, "", "invalid request\n" };
+            }
+            writeResponse(client, response);
+            ::close(client);
+        });
+    }
+}
+
+bool CompileServer::request(const std::string& path, const ServerRequest& request, ServerResponse& response, std::string& error) {
+    sockaddr_un addr;
+    if (!socketAddress(path, addr)) {
+        error = "the path of the socket is empty or too long";
+        return false;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        error = std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    std::string header = strfmt("{} {} {}", request.command, request.payload.size(), request.input.size());
+    for (auto& option : request.options) {
+        header += " " + option;
+    }
+    header += "\n";
+    bool sent = writeFull(fd, header.data(), header.size())
+        && writeFull(fd, request.payload.data(), request.payload.size())
+        && writeFull(fd, request.input.data(), request.input.size());
+    std::string line;
+    size_t outputSize, errorsSize;
+    bool received = sent && readLine(fd, line)
+        && (std::istringstream(line) >> response.status >> outputSize >> errorsSize)
+        && outputSize <= MAX_BODY_SIZE && errorsSize <= MAX_BODY_SIZE
+        && readBody(fd, outputSize, response.output) && readBody(fd, errorsSize, response.errors);
+    ::close(fd);
+    if (!received) {
+        error = "no answer from the server";
+        return false;
+    }
+    return true;
+}
+
+}
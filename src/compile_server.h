@@ -0,0 +1,64 @@
+#ifndef COMPILE_SERVER_H_INCLUDED
+#define COMPILE_SERVER_H_INCLUDED
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+// A request to cc0 --serve. On the socket it is one line
+//     {command} {payload size} {input size} {options...}\n
+// followed by the payload and the input, the sizes in bytes.
+struct ServerRequest {
+    // compile, run or exec
+    std::string command;
+    std::vector<std::string> options;
+    // the source, or the binary file for exec
+    std::string payload;
+    // what the program scans
+    std::string input;
+};
+
+// The answer to a request, on the socket
+//     {status} {output size} {errors size}\n
+// followed by the output and the errors.
+struct ServerResponse {
+    // 0 or the exit status cc0 would have
+    int status = 0;
+    // the binary file for compile, what the program prints for run and exec
+    std::string output;
+    std::string errors;
+};
+
+// Listens on a Unix domain socket and answers each connection, one request
+// per connection, with the handler on a pool of threads. The process stays
+// up between the requests, so they do not pay for starting cc0.
+class CompileServer {
+public:
+    using Handler = std::function<ServerResponse(const ServerRequest&)>;
+
+    CompileServer(std::string path, std::size_t threads);
+    CompileServer(const CompileServer&) = delete;
+    CompileServer& operator=(const CompileServer&) = delete;
+    // removes the socket
+    ~CompileServer();
+
+    // binds the socket, a stale socket left at the path is replaced
+    bool listen(std::string& error);
+    // until SIGINT or SIGTERM, then answers the requests already accepted
+    void serve(const Handler& handler);
+
+    // the client side, false with the reason if there is no answer
+    static bool request(const std::string& path, const ServerRequest& request, ServerResponse& response, std::string& error);
+
+private:
+    std::string _path;
+    std::size_t _threads;
+    int _fd;
+};
+
+}
+
+#endif
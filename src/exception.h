@@ -81,6 +81,15 @@ public:
     }
 };
 
+class InstructionLimitExceeded : public std::exception {
+public:
+    InstructionLimitExceeded() {}
+    virtual ~InstructionLimitExceeded() {}
+    virtual const char* what() const noexcept {
+        return "instruction limit exceeded";
+    }
+};
+
 class IOError : public std::exception {
 public:
     IOError() {}
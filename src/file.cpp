@@ -4,26 +4,233 @@
 #include "./constant.h"
 #include "./function.h"
 #include "./exception.h"
+#include "./mapped_file.h"
 #include "./util/print.hpp"
+#include "./util/byte_order.hpp"
+#include "./util/leb128.hpp"
 
 #include <iostream>
 #include <fstream>
+#include <iterator>
+#include <optional>
 #include <string>
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
+#include <cstring>
+
 
 File::File(
     vm::u4 version, 
     std::vector<vm::Constant> constants, 
     std::vector<vm::Instruction> instructions, 
     std::vector<vm::Function> functions
-) : version(version), constants(constants), start(instructions), functions(functions) {
+) : version(version), constants(std::move(constants)), start(std::move(instructions)), functions(std::move(functions)) {
     //
 }
 
 
+bool File::has_line_table() const {
+    if (!startLines.empty()) {
+        return true;
+    }
+    return std::any_of(functions.begin(), functions.end(), 
+        [](const vm::Function& fun) { return !fun.lines.empty(); }
+    );
+}
+
+size_t File::dedup_constants() {
+    load_all();
+    // type and the bytes of the value, so doubles are compared bitwise
+    const auto keyOf = [](const vm::Constant& c) {
+        std::string key(1, static_cast<char>(c.type));
+        switch (c.type) {
+        case vm::Constant::Type::STRING:
+            key += std::get<vm::str_t>(c.value);
+            break;
+        case vm::Constant::Type::INT: {
+            auto v = std::get<vm::int_t>(c.value);
+            key.append(reinterpret_cast<const char*>(&v), sizeof v);
+        } break;
+        case vm::Constant::Type::DOUBLE: {
+            auto v = std::get<vm::double_t>(c.value);
+            key.append(reinterpret_cast<const char*>(&v), sizeof v);
+        } break;
+        }
+        return key;
+    };
+    std::unordered_map<std::string, vm::u4> indexes;
+    std::vector<vm::u4> remap(constants.size());
+    std::vector<vm::Constant> unique;
+    for (size_t i = 0; i < constants.size(); ++i) {
+        auto [it, inserted] = indexes.try_emplace(keyOf(constants[i]), static_cast<vm::u4>(unique.size()));
+        if (inserted) {
+            unique.push_back(std::move(constants[i]));
+        }
+        remap[i] = it->second;
+    }
+    size_t removed = constants.size() - unique.size();
+    constants = std::move(unique);
+    if (removed == 0) {
+        return 0;
+    }
+    // indexes out of range are left to the verification of the VM
+    const auto remapInstructions = [&](std::vector<vm::Instruction>& instructions) {
+        for (auto& ins : instructions) {
+            if (vm::infoOf(ins.op).has(vm::OPF_CONSTANT) && ins.x < remap.size()) {
+                ins.x = remap[ins.x];
+            }
+        }
+    };
+    remapInstructions(start);
+    for (auto& fun : functions) {
+        remapInstructions(fun.instructions);
+        if (fun.nameIndex < remap.size()) {
+            fun.nameIndex = remap[fun.nameIndex];
+        }
+    }
+    return removed;
+}
+
+// Two passes over the objects: the first gives every function defined and
+// every global exported its place in the program, the second copies the
+// objects with their indexes and offsets moved to those places.
+File File::link(std::vector<File> objects) {
+    const auto nameOf = [](const File& file, const vm::Function& fun) -> const vm::str_t& {
+        return std::get<vm::str_t>(file.constants.at(fun.nameIndex).value);
+    };
+    struct Definition {
+        char type;
+        vm::u4 offset;
+    };
+    std::unordered_map<std::string, vm::u4> functionIndexes;
+    std::vector<vm::u2> paramSizes;
+    std::unordered_map<std::string, Definition> globals;
+    // the globals of the objects follow each other in the frame of .start
+    std::vector<vm::u4> globalsBase;
+    std::vector<std::vector<bool>> imported;
+    vm::u4 globalsSize = 0;
+    for (auto& object : objects) {
+        if (!object.is_object()) {
+            throw InvalidFile("not an object file, compile it with --object");
+        }
+        object.load_all();
+        auto& symbols = *object.symbols;
+        auto& isImported = imported.emplace_back(object.functions.size(), false);
+        for (auto fun : symbols.functionImports) {
+            isImported.at(fun) = true;
+        }
+        for (size_t j = 0; j < object.functions.size(); ++j) {
+            if (isImported[j]) {
+                continue;
+            }
+            auto& name = nameOf(object, object.functions[j]);
+            if (!functionIndexes.try_emplace(name, static_cast<vm::u4>(paramSizes.size())).second) {
+                throw InvalidFile(strfmt("function {} is defined more than once", name));
+            }
+            paramSizes.push_back(object.functions[j].paramSize);
+        }
+        globalsBase.push_back(globalsSize);
+        for (auto& g : symbols.exports) {
+            if (!globals.try_emplace(g.name, Definition{ g.type, globalsSize + g.offset }).second) {
+                throw InvalidFile(strfmt("global {} is defined more than once", g.name));
+            }
+        }
+        globalsSize += symbols.globalsSize;
+    }
+    if (functionIndexes.find("main") == functionIndexes.end()) {
+        throw InvalidFile("main() not found");
+    }
+
+    std::vector<vm::Constant> constants;
+    std::vector<vm::Instruction> start;
+    vm::LineTable startLines;
+    std::vector<vm::Function> functions;
+    functions.reserve(paramSizes.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        auto& object = objects[i];
+        auto& symbols = *object.symbols;
+        auto constantsBase = static_cast<vm::u4>(constants.size());
+        std::vector<vm::u4> functionMap;
+        for (size_t j = 0; j < object.functions.size(); ++j) {
+            auto& fun = object.functions[j];
+            auto& name = nameOf(object, fun);
+            auto it = functionIndexes.find(name);
+            if (it == functionIndexes.end()) {
+                throw InvalidFile(strfmt("undefined function {}", name));
+            }
+            if (paramSizes[it->second] != fun.paramSize) {
+                throw InvalidFile(strfmt("function {} takes {} parameter slots, declared with {}",
+                    name, paramSizes[it->second], fun.paramSize));
+            }
+            functionMap.push_back(it->second);
+        }
+        std::vector<vm::u4> importOffsets;
+        for (auto& g : symbols.imports) {
+            auto it = globals.find(g.name);
+            if (it == globals.end()) {
+                throw InvalidFile(strfmt("undefined global {}", g.name));
+            }
+            if (it->second.type != g.type) {
+                throw InvalidFile(strfmt("global {} is declared with another type", g.name));
+            }
+            importOffsets.push_back(it->second.offset);
+        }
+
+        // level 0 is .start, a loada reaching as far as .start addresses a global
+        const auto relocate = [&](std::vector<vm::Instruction>& instructions, vm::u4 level) {
+            for (auto& ins : instructions) {
+                const auto& info = vm::infoOf(ins.op);
+                if (info.has(vm::OPF_CONSTANT)) {
+                    ins.x += constantsBase;
+                }
+                else if (ins.op == vm::OpCode::call) {
+                    if (ins.x >= functionMap.size()) {
+                        throw InvalidFile(strfmt("call {} out of range", ins.x));
+                    }
+                    ins.x = functionMap[ins.x];
+                }
+                else if (ins.op == vm::OpCode::loada && ins.x >= level) {
+                    ins.y += globalsBase[i];
+                }
+            }
+        };
+        auto startBase = static_cast<vm::u4>(start.size());
+        for (auto& e : object.startLines.entries) {
+            startLines.entries.push_back(vm::LineEntry{ e.instruction + startBase, e.line, e.column });
+        }
+        relocate(object.start, 0);
+        for (auto& fun : object.functions) {
+            relocate(fun.instructions, fun.level);
+            fun.nameIndex += constantsBase;
+        }
+        for (auto& use : symbols.uses) {
+            auto& instructions = use.function == 0 ? object.start : object.functions.at(use.function - 1).instructions;
+            if (use.instruction >= instructions.size() || instructions[use.instruction].op != vm::OpCode::loada) {
+                throw InvalidFile("the symbol table refers to no loada");
+            }
+            instructions[use.instruction].y = importOffsets.at(use.global);
+        }
+
+        std::move(object.constants.begin(), object.constants.end(), std::back_inserter(constants));
+        std::move(object.start.begin(), object.start.end(), std::back_inserter(start));
+        for (size_t j = 0; j < object.functions.size(); ++j) {
+            if (!imported[i][j]) {
+                functions.push_back(std::move(object.functions[j]));
+            }
+        }
+    }
+
+    File file{2, std::move(constants), std::move(start), std::move(functions)};
+    file.startLines = std::move(startLines);
+    // every object has its own copy of the names and literals it uses
+    file.dedup_constants();
+    return file;
+}
+
 void File::output_text(std::ostream& out) {
+    load_all();
     int i;
     
     i = 0;
@@ -56,172 +263,797 @@ void File::output_text(std::ostream& out) {
         }
         ++i;
     }
+
+    if (has_line_table()) {
+        // {function} {instruction} {line} {column}, function -1 is .start
+        println(out, ".lines:");
+        for (auto& e : startLines.entries) {
+            println(out, -1, e.instruction, e.line, e.column);
+        }
+        i = 0;
+        for (auto& fun : functions) {
+            for (auto& e : fun.lines.entries) {
+                println(out, i, e.instruction, e.line, e.column);
+            }
+            ++i;
+        }
+    }
+
+    if (symbols) {
+        symbols->output_text(out);
+    }
 }
 
-void File::output_binary(std::ofstream& out) {
+namespace {
 
-    char bytes[8];
-    const auto writeNBytes = [&](void* addr, int count) {
-        assert(0 < count && count <= 8);
-        char* p = reinterpret_cast<char*>(addr) + (count-1);
-        for (int i = 0; i < count; ++i) {
-            bytes[i] = *p--;
-        }
-        out.write(bytes, count);
-    };
+// .o0 v2 is a header, a section table and the sections:
+//   magic(4) version(4) sections_count(4)
+//   { id(4) offset(4) size(4) } * sections_count, offsets from the file start
+// All counts, indices and operands in the sections are LEB128, OPF_SIGNED
+// operands signed, the others unsigned. Unknown sections are skipped.
+//   CONSTANTS  count, { type(1) value }, a string is length and bytes,
+//              an int 4 and a double 8 bytes as in v1
+//   START      count, { opcode(1) operands }
+//   FUNCTIONS  count, { name_index param_size level code_offset(4) code_size(4) },
+//              the body of a function is at code_offset in CODE
+//   CODE       the bodies of the functions, each like START
+//   LINES      optional, count, { function instruction line column },
+//              function 0 is .start and i+1 the function i
+//   SYMBOLS    only in object files, globals_size, count { function },
+//              count { name type(1) offset } exported globals,
+//              count { name type(1) } imported globals,
+//              count { import function instruction } their uses,
+//              a name is length and bytes, function as in LINES
+enum class Section : vm::u4 {
+    CONSTANTS = 1,
+    START     = 2,
+    FUNCTIONS = 3,
+    CODE      = 4,
+    LINES     = 5,
+    SYMBOLS   = 6,
+};
+
+struct SectionEntry {
+    Section id;
+    vm::u4 offset;
+    vm::u4 size;
+};
+
+// where a function body is in the CODE section
+struct CodeSpan {
+    vm::u4 offset;
+    vm::u4 size;
+};
+
+// The encoders run twice over a file, with a ByteCounter to size the
+// buffer and then with a ByteWriter to fill it.
+struct ByteCounter {
+    size_t pos = 0;
+
+    template <typename T>
+    void put(T) { pos += sizeof(T); }
+    void putBytes(const char*, size_t count) { pos += count; }
+    void putULEB(vm::u4 v) { pos += uleb128_size(v); }
+    void putSLEB(vm::int_t v) { pos += sleb128_size(v); }
+};
+
+struct ByteWriter {
+    unsigned char* data;
+    size_t pos = 0;
+
+    template <typename T>
+    void put(T v) { store_be(data + pos, v); pos += sizeof v; }
+    void putBytes(const char* bytes, size_t count) { std::memcpy(data + pos, bytes, count); pos += count; }
+    void putULEB(vm::u4 v) { pos += store_uleb128(data + pos, v); }
+    void putSLEB(vm::int_t v) { pos += store_sleb128(data + pos, v); }
+};
 
+// v1 has 2-byte counts and indices, a file that does not fit is an error
+void checkV1(size_t value, size_t max, const char* what) {
+    if (value > max) {
+        throw InvalidFile(strfmt("{} {} does not fit .o0 version 1, write version 2 instead", what, value));
+    }
+}
+
+template <typename Writer>
+void encodeV1(Writer& w, const File& file) {
+    if (file.is_object()) {
+        throw InvalidFile("object files need .o0 version 2");
+    }
     // magic
-    out.write("\x43\x30\x3A\x29", 4);
+    w.putBytes("\x43\x30\x3A\x29", 4);
     // version
-    out.write("\x00\x00\x00\x01", 4);
+    w.put(vm::u4(1));
     // constants_count
-    vm::u2 constants_count = constants.size();
-    writeNBytes(&constants_count, sizeof constants_count);
+    checkV1(file.constants.size(), U2_MAX, "constants count");
+    w.put(static_cast<vm::u2>(file.constants.size()));
     // constants
-    for (auto& constant : constants) {
+    for (auto& constant : file.constants) {
         switch (constant.type)
         {
         case vm::Constant::Type::STRING: {
-            out.write("\x00", 1);
-            std::string v = std::get<vm::str_t>(constant.value);
-            vm::u2 len = v.length();
-            writeNBytes(&len, sizeof len);
-            out.write(v.c_str(), len);
+            w.put(vm::u1(0));
+            const auto& v = std::get<vm::str_t>(constant.value);
+            checkV1(v.length(), U2_MAX, "string constant length");
+            w.put(static_cast<vm::u2>(v.length()));
+            w.putBytes(v.data(), v.length());
         } break;
         case vm::Constant::Type::INT: {
-            out.write("\x01", 1);
-            vm::int_t v = std::get<vm::int_t>(constant.value);
-            writeNBytes(&v, sizeof v);
+            w.put(vm::u1(1));
+            w.put(std::get<vm::int_t>(constant.value));
         } break;
         case vm::Constant::Type::DOUBLE: {
-            out.write("\x02", 1);
-            vm::double_t v = std::get<vm::double_t>(constant.value);
-            writeNBytes(&v, sizeof v);
+            w.put(vm::u1(2));
+            w.put(std::get<vm::double_t>(constant.value));
         } break;
         default: assert(("unexpected error", false)); break;
         }
     }
 
-    auto to_binary = [&](const std::vector<vm::Instruction>& v) {
-        vm::u2 instructions_count = v.size();
-        writeNBytes(&instructions_count, sizeof instructions_count);
+    const auto to_binary = [&](const std::vector<vm::Instruction>& v) {
+        checkV1(v.size(), U2_MAX, "instructions count");
+        w.put(static_cast<vm::u2>(v.size()));
         for (auto& ins : v) {
-            vm::u1 op = static_cast<vm::u1>(ins.op); 
-            writeNBytes(&op, sizeof op);
-            if (auto it = vm::paramSizeOfOpCode.find(ins.op); it != vm::paramSizeOfOpCode.end()) {
-                auto paramSizes = it->second;
-                switch (paramSizes[0]) {
-                #define CASE(n) case n: { vm::u##n x = ins.x; writeNBytes(&x, n); }
-                CASE(1); break; 
-                CASE(2); break;
-                CASE(4); break;
-                #undef CASE
+            w.put(static_cast<vm::u1>(ins.op));
+            const auto& info = vm::infoOf(ins.op);
+            for (int i = 0; i < info.paramCount; ++i) {
+                vm::u4 param = i == 0 ? ins.x : ins.y;
+                switch (info.paramSizes[i]) {
+                case 1: checkV1(param, U1_MAX, info.name); w.put(static_cast<vm::u1>(param)); break;
+                case 2: checkV1(param, U2_MAX, info.name); w.put(static_cast<vm::u2>(param)); break;
+                case 4: w.put(static_cast<vm::u4>(param)); break;
                 default: assert(("unexpected error", false));
                 }
-                if (paramSizes.size() == 2) {
-                    switch (paramSizes[1]) {
-                    #define CASE(n) case n: { vm::u##n y = ins.y; writeNBytes(&y, n); }
-                    CASE(1); break; 
-                    CASE(2); break;
-                    CASE(4); break;
-                    #undef CASE
-                    default: assert(("unexpected error", false));
-                    }
-                }
             }
         }
     };
 
     // start
-    to_binary(start);
+    to_binary(file.start);
     // functions_count
-    vm::u2 functions_count = functions.size();
-    writeNBytes(&functions_count, sizeof functions_count);
+    checkV1(file.functions.size(), U2_MAX, "functions count");
+    w.put(static_cast<vm::u2>(file.functions.size()));
     // functions
-    for (auto& fun : functions) {
-        vm::u2 v;
-        v = fun.nameIndex; writeNBytes(&v, sizeof v);
-        v = fun.paramSize; writeNBytes(&v, sizeof v);
-        v = fun.level;     writeNBytes(&v, sizeof v);
+    for (auto& fun : file.functions) {
+        checkV1(fun.nameIndex, U2_MAX, "function name index");
+        w.put(static_cast<vm::u2>(fun.nameIndex));
+        w.put(static_cast<vm::u2>(fun.paramSize));
+        w.put(static_cast<vm::u2>(fun.level));
         to_binary(fun.instructions);
     }
+
+    // line table, optional
+    if (file.has_line_table()) {
+        vm::u4 entries_count = file.startLines.entries.size();
+        for (auto& fun : file.functions) {
+            entries_count += fun.lines.entries.size();
+        }
+        w.put(entries_count);
+        const auto to_binary_lines = [&](vm::u2 index, const vm::LineTable& lines) {
+            for (auto& e : lines.entries) {
+                checkV1(e.instruction, U2_MAX, "line table instruction index");
+                w.put(index);
+                w.put(static_cast<vm::u2>(e.instruction));
+                w.put(static_cast<vm::u4>(e.line));
+                w.put(static_cast<vm::u4>(e.column));
+            }
+        };
+        to_binary_lines(U2_MAX, file.startLines);
+        for (size_t i = 0; i < file.functions.size(); ++i) {
+            to_binary_lines(i, file.functions[i].lines);
+        }
+    }
+}
+
+template <typename Writer>
+void encodeConstantsV2(Writer& w, const File& file) {
+    w.putULEB(file.constants.size());
+    for (auto& constant : file.constants) {
+        switch (constant.type)
+        {
+        case vm::Constant::Type::STRING: {
+            w.put(vm::u1(0));
+            const auto& v = std::get<vm::str_t>(constant.value);
+            w.putULEB(v.length());
+            w.putBytes(v.data(), v.length());
+        } break;
+        case vm::Constant::Type::INT: {
+            w.put(vm::u1(1));
+            w.put(std::get<vm::int_t>(constant.value));
+        } break;
+        case vm::Constant::Type::DOUBLE: {
+            w.put(vm::u1(2));
+            w.put(std::get<vm::double_t>(constant.value));
+        } break;
+        default: assert(("unexpected error", false)); break;
+        }
+    }
+}
+
+template <typename Writer>
+void encodeInstructionsV2(Writer& w, const std::vector<vm::Instruction>& v) {
+    w.putULEB(v.size());
+    for (auto& ins : v) {
+        w.put(static_cast<vm::u1>(ins.op));
+        const auto& info = vm::infoOf(ins.op);
+        if (info.paramCount > 0) {
+            if (info.has(vm::OPF_SIGNED)) {
+                w.putSLEB(static_cast<vm::int_t>(ins.x));
+            }
+            else {
+                w.putULEB(ins.x);
+            }
+        }
+        if (info.paramCount > 1) {
+            w.putULEB(ins.y);
+        }
+    }
+}
+
+template <typename Writer>
+void encodeFunctionsV2(Writer& w, const File& file, const std::vector<CodeSpan>& code) {
+    w.putULEB(file.functions.size());
+    for (size_t i = 0; i < file.functions.size(); ++i) {
+        auto& fun = file.functions[i];
+        w.putULEB(fun.nameIndex);
+        w.putULEB(fun.paramSize);
+        w.putULEB(fun.level);
+        w.put(code[i].offset);
+        w.put(code[i].size);
+    }
+}
+
+template <typename Writer>
+void encodeLinesV2(Writer& w, const File& file) {
+    size_t entries_count = file.startLines.entries.size();
+    for (auto& fun : file.functions) {
+        entries_count += fun.lines.entries.size();
+    }
+    w.putULEB(entries_count);
+    const auto to_binary_lines = [&](vm::u4 index, const vm::LineTable& lines) {
+        for (auto& e : lines.entries) {
+            w.putULEB(index);
+            w.putULEB(e.instruction);
+            w.putULEB(e.line);
+            w.putULEB(e.column);
+        }
+    };
+    to_binary_lines(0, file.startLines);
+    for (size_t i = 0; i < file.functions.size(); ++i) {
+        to_binary_lines(i + 1, file.functions[i].lines);
+    }
+}
+
+template <typename Writer>
+void encodeSymbolsV2(Writer& w, const vm::SymbolTable& symbols) {
+    const auto putName = [&](const std::string& name) {
+        w.putULEB(name.size());
+        w.putBytes(name.data(), name.size());
+    };
+    w.putULEB(symbols.globalsSize);
+    w.putULEB(symbols.functionImports.size());
+    for (auto fun : symbols.functionImports) {
+        w.putULEB(fun);
+    }
+    w.putULEB(symbols.exports.size());
+    for (auto& g : symbols.exports) {
+        putName(g.name);
+        w.put(static_cast<vm::u1>(g.type));
+        w.putULEB(g.offset);
+    }
+    w.putULEB(symbols.imports.size());
+    for (auto& g : symbols.imports) {
+        putName(g.name);
+        w.put(static_cast<vm::u1>(g.type));
+    }
+    w.putULEB(symbols.uses.size());
+    for (auto& use : symbols.uses) {
+        w.putULEB(use.global);
+        w.putULEB(use.function);
+        w.putULEB(use.instruction);
+    }
+}
+
+// the sections of a v2 file and the function bodies in CODE, returns the file size
+size_t layoutV2(const File& file, std::vector<SectionEntry>& sections, std::vector<CodeSpan>& code) {
+    const auto sizeOf = [](auto encode) {
+        ByteCounter c;
+        encode(c);
+        return c.pos;
+    };
+    size_t codeSize = 0;
+    code.clear();
+    for (auto& fun : file.functions) {
+        size_t size = sizeOf([&](ByteCounter& c) { encodeInstructionsV2(c, fun.instructions); });
+        code.push_back(CodeSpan{ static_cast<vm::u4>(codeSize), static_cast<vm::u4>(size) });
+        codeSize += size;
+    }
+
+    std::vector<std::pair<Section, size_t>> sizes = {
+        { Section::CONSTANTS, sizeOf([&](ByteCounter& c) { encodeConstantsV2(c, file); }) },
+        { Section::START,     sizeOf([&](ByteCounter& c) { encodeInstructionsV2(c, file.start); }) },
+        { Section::FUNCTIONS, sizeOf([&](ByteCounter& c) { encodeFunctionsV2(c, file, code); }) },
+        { Section::CODE,      codeSize },
+    };
+    if (file.has_line_table()) {
+        sizes.emplace_back(Section::LINES, sizeOf([&](ByteCounter& c) { encodeLinesV2(c, file); }));
+    }
+    if (file.symbols) {
+        sizes.emplace_back(Section::SYMBOLS, sizeOf([&](ByteCounter& c) { encodeSymbolsV2(c, *file.symbols); }));
+    }
+
+    size_t pos = 12 + 12 * sizes.size();
+    sections.clear();
+    for (auto& [id, size] : sizes) {
+        sections.push_back(SectionEntry{ id, static_cast<vm::u4>(pos), static_cast<vm::u4>(size) });
+        pos += size;
+    }
+    if (pos > U4_MAX) {
+        throw InvalidFile("too large the binary file");
+    }
+    return pos;
+}
+
+}
+
+size_t File::binary_size() const {
+    if (!all_loaded()) {
+        File copy = *this;
+        copy.load_all();
+        return copy.binary_size();
+    }
+    switch (version) {
+    case 1: {
+        ByteCounter c;
+        encodeV1(c, *this);
+        return c.pos;
+    }
+    case 2: {
+        std::vector<SectionEntry> sections;
+        std::vector<CodeSpan> code;
+        return layoutV2(*this, sections, code);
+    }
+    default:
+        throw InvalidFile(strfmt("unsupported binary file version {}", version));
+    }
+}
+
+// The whole file is encoded into one buffer of binary_size() bytes,
+// output_binary(std::ofstream&) then writes it at once.
+void File::output_binary(std::vector<unsigned char>& buffer) const {
+    if (!all_loaded()) {
+        File copy = *this;
+        copy.load_all();
+        copy.output_binary(buffer);
+        return;
+    }
+    switch (version) {
+    case 1: {
+        buffer.resize(binary_size());
+        ByteWriter w{ buffer.data() };
+        encodeV1(w, *this);
+        assert(w.pos == buffer.size());
+    } break;
+    case 2: {
+        std::vector<SectionEntry> sections;
+        std::vector<CodeSpan> code;
+        buffer.resize(layoutV2(*this, sections, code));
+        ByteWriter w{ buffer.data() };
+        w.putBytes("\x43\x30\x3A\x29", 4);
+        w.put(vm::u4(2));
+        w.put(static_cast<vm::u4>(sections.size()));
+        for (auto& s : sections) {
+            w.put(static_cast<vm::u4>(s.id));
+            w.put(s.offset);
+            w.put(s.size);
+        }
+        for (auto& s : sections) {
+            assert(w.pos == s.offset);
+            switch (s.id) {
+            case Section::CONSTANTS: encodeConstantsV2(w, *this); break;
+            case Section::START:     encodeInstructionsV2(w, start); break;
+            case Section::FUNCTIONS: encodeFunctionsV2(w, *this, code); break;
+            case Section::CODE:
+                for (auto& fun : functions) {
+                    encodeInstructionsV2(w, fun.instructions);
+                }
+                break;
+            case Section::LINES:     encodeLinesV2(w, *this); break;
+            case Section::SYMBOLS:   encodeSymbolsV2(w, *symbols); break;
+            }
+        }
+        assert(w.pos == buffer.size());
+    } break;
+    default:
+        throw InvalidFile(strfmt("unsupported binary file version {}", version));
+    }
+}
+
+std::vector<unsigned char> File::serialize_binary() const {
+    std::vector<unsigned char> buffer;
+    output_binary(buffer);
+    return buffer;
+}
+
+void File::output_binary(std::ofstream& out) {
+    auto buffer = serialize_binary();
+    out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+}
+
+namespace {
+
+// bounds checked big-endian and LEB128 reads of [p, end)
+struct ByteReader {
+    const unsigned char* p;
+    const unsigned char* end;
+
+    void ensure(size_t count, const char* msg) const {
+        if (static_cast<size_t>(end - p) < count) {
+            throw InvalidFile(msg);
+        }
+    }
+    template <typename T>
+    T get() {
+        ensure(sizeof(T), "incomplete binary file");
+        auto rtv = load_be<T>(p);
+        p += sizeof(T);
+        return rtv;
+    }
+    vm::u4 getULEB() {
+        vm::u4 v;
+        if (!load_uleb128(p, end, v)) {
+            throw InvalidFile("invalid binary file: invalid LEB128 value");
+        }
+        return v;
+    }
+    vm::int_t getSLEB() {
+        vm::int_t v;
+        if (!load_sleb128(p, end, v)) {
+            throw InvalidFile("invalid binary file: invalid LEB128 value");
+        }
+        return v;
+    }
+};
+
+void decodeInstructionsV1(ByteReader& r, std::vector<vm::Instruction>& v) {
+    auto instructionsCount = r.get<vm::u2>();
+    // every instruction is at least one byte
+    r.ensure(instructionsCount, "incomplete binary file");
+    v.reserve(instructionsCount);
+    for (int j = 0; j < instructionsCount; ++j) {
+        vm::Instruction ins{ vm::OpCode::nop, 0, 0 };
+        auto op = r.get<vm::u1>();
+        const auto& info = vm::opCodeTable[op];
+        if (!info.valid()) {
+            throw InvalidFile("invalid binary file: invalid opcode");
+        }
+        ins.op = static_cast<vm::OpCode>(op);
+        for (int i = 0; i < info.paramCount; ++i) {
+            vm::u4 param = 0;
+            switch (info.paramSizes[i]) {
+            case 1: param = r.get<vm::u1>(); break;
+            case 2: param = r.get<vm::u2>(); break;
+            case 4: param = r.get<vm::u4>(); break;
+            default: ;
+            }
+            (i == 0 ? ins.x : ins.y) = param;
+        }
+        v.push_back(ins);
+    }
+}
+
+// moves r past a v1 body without decoding it, the opcodes are checked
+// as their operand widths are needed to find the end
+void skipInstructionsV1(ByteReader& r) {
+    auto instructionsCount = r.get<vm::u2>();
+    for (int j = 0; j < instructionsCount; ++j) {
+        const auto& info = vm::opCodeTable[r.get<vm::u1>()];
+        if (!info.valid()) {
+            throw InvalidFile("invalid binary file: invalid opcode");
+        }
+        size_t size = info.paramSizes[0] + info.paramSizes[1];
+        r.ensure(size, "incomplete binary file");
+        r.p += size;
+    }
+}
+
+void decodeInstructionsV2(ByteReader& r, std::vector<vm::Instruction>& v) {
+    auto instructionsCount = r.getULEB();
+    // every instruction is at least one byte
+    r.ensure(instructionsCount, "incomplete binary file");
+    v.reserve(instructionsCount);
+    for (vm::u4 j = 0; j < instructionsCount; ++j) {
+        vm::Instruction ins{ vm::OpCode::nop, 0, 0 };
+        auto op = r.get<vm::u1>();
+        const auto& info = vm::opCodeTable[op];
+        if (!info.valid()) {
+            throw InvalidFile("invalid binary file: invalid opcode");
+        }
+        ins.op = static_cast<vm::OpCode>(op);
+        if (info.paramCount > 0) {
+            ins.x = info.has(vm::OPF_SIGNED) ? static_cast<vm::u4>(r.getSLEB()) : r.getULEB();
+        }
+        if (info.paramCount > 1) {
+            ins.y = r.getULEB();
+        }
+        v.push_back(ins);
+    }
+}
+
+File parseBinaryV2(const unsigned char* buffer, size_t bufferSize, bool lazy) {
+    // magic and version are checked by File::parse_binary
+    ByteReader header{ buffer + 8, buffer + bufferSize };
+    auto sectionsCount = header.get<vm::u4>();
+    header.ensure(static_cast<size_t>(sectionsCount) * 12, "incomplete binary file");
+    const unsigned char* sections[7] = {};
+    const unsigned char* sectionEnds[7] = {};
+    for (vm::u4 j = 0; j < sectionsCount; ++j) {
+        auto id = header.get<vm::u4>();
+        auto offset = header.get<vm::u4>();
+        auto size = header.get<vm::u4>();
+        if (offset > bufferSize || size > bufferSize - offset) {
+            throw InvalidFile("invalid binary file: section out of range");
+        }
+        if (id == 0 || id > static_cast<vm::u4>(Section::SYMBOLS)) {
+            // unknown section
+            continue;
+        }
+        if (sections[id] != nullptr) {
+            throw InvalidFile("invalid binary file: duplicated section");
+        }
+        sections[id] = buffer + offset;
+        sectionEnds[id] = buffer + offset + size;
+    }
+    const auto section = [&](Section id) {
+        auto i = static_cast<vm::u4>(id);
+        if (sections[i] == nullptr) {
+            throw InvalidFile("invalid binary file: section missing");
+        }
+        return ByteReader{ sections[i], sectionEnds[i] };
+    };
+    const auto ensureEnd = [](const ByteReader& r) {
+        if (r.p != r.end) {
+            throw InvalidFile("invalid binary file: unused content");
+        }
+    };
+
+    // parse constants
+    auto r = section(Section::CONSTANTS);
+    auto constantsCount = r.getULEB();
+    // every constant is at least two bytes
+    r.ensure(static_cast<size_t>(constantsCount) * 2, "incomplete binary file");
+    std::vector<vm::Constant> constants;
+    constants.reserve(constantsCount);
+    for (vm::u4 j = 0; j < constantsCount; ++j) {
+        vm::Constant constant;
+        constant.type = static_cast<vm::Constant::Type>(r.get<vm::u1>());
+        switch (constant.type)
+        {
+        case vm::Constant::Type::STRING: {
+            auto length = r.getULEB();
+            r.ensure(length, "invalid binary file: incomplete string constant");
+            constant.value = vm::str_t(reinterpret_cast<const char*>(r.p), length);
+            r.p += length;
+        } break;
+        case vm::Constant::Type::INT: {
+            constant.value = r.get<vm::int_t>();
+        } break;
+        case vm::Constant::Type::DOUBLE: {
+            r.ensure(8, "invalid binary file: incomplete double constant");
+            constant.value = r.get<vm::double_t>();
+        } break;
+        default:
+            throw InvalidFile("invalid binary file: invalid constant type");
+        }
+        constants.push_back(std::move(constant));
+    }
+    ensureEnd(r);
+
+    // parse start
+    std::vector<vm::Instruction> start;
+    r = section(Section::START);
+    decodeInstructionsV2(r, start);
+    ensureEnd(r);
+
+    // parse functions
+    auto code = section(Section::CODE);
+    r = section(Section::FUNCTIONS);
+    auto functionsCount = r.getULEB();
+    // every function header is at least 11 bytes
+    r.ensure(static_cast<size_t>(functionsCount) * 11, "incomplete binary file");
+    std::vector<vm::Function> functions;
+    functions.reserve(functionsCount);
+    bool mainFound = false;
+    for (vm::u4 j = 0; j < functionsCount; ++j) {
+        vm::Function fun;
+        fun.nameIndex = r.getULEB();
+        if (fun.nameIndex >= constants.size()) {
+            throw InvalidFile("invalid binary file: function name not found");
+        }
+        if (constants[fun.nameIndex].type != vm::Constant::Type::STRING) {
+            throw InvalidFile("invalid binary file: function name not found");
+        }
+        if (std::get<vm::str_t>(constants[fun.nameIndex].value) == "main") {
+            mainFound = true;
+        }
+        auto paramSize = r.getULEB();
+        auto level = r.getULEB();
+        if (paramSize > U2_MAX || level > U2_MAX) {
+            throw InvalidFile("invalid binary file: invalid function header");
+        }
+        fun.paramSize = paramSize;
+        fun.level = level;
+        auto offset = r.get<vm::u4>();
+        auto size = r.get<vm::u4>();
+        if (offset > static_cast<size_t>(code.end - code.p) || size > static_cast<size_t>(code.end - code.p) - offset) {
+            throw InvalidFile("invalid binary file: function body out of range");
+        }
+        ByteReader body{ code.p + offset, code.p + offset + size };
+        if (lazy) {
+            fun.code = body.p;
+            fun.codeEnd = body.end;
+        }
+        else {
+            decodeInstructionsV2(body, fun.instructions);
+            ensureEnd(body);
+        }
+        functions.push_back(std::move(fun));
+    }
+    ensureEnd(r);
+
+    // an object file may leave main() to another
+    bool object = sections[static_cast<vm::u4>(Section::SYMBOLS)] != nullptr;
+    if (!mainFound && !object) {
+        throw InvalidFile("invalid binary file: main() not found");
+    }
+
+    // parse line table, optional
+    vm::LineTable startLines;
+    if (sections[static_cast<vm::u4>(Section::LINES)] != nullptr) {
+        r = section(Section::LINES);
+        auto entriesCount = r.getULEB();
+        // 4 bytes per entry at least
+        r.ensure(static_cast<size_t>(entriesCount) * 4, "incomplete binary file");
+        for (vm::u4 j = 0; j < entriesCount; ++j) {
+            auto index = r.getULEB();
+            auto instruction = r.getULEB();
+            auto line = r.getULEB();
+            auto column = r.getULEB();
+            if (index > functions.size()) {
+                throw InvalidFile("invalid binary file: line table refers to no function");
+            }
+            auto& lines = index == 0 ? startLines : functions[index - 1].lines;
+            if (!lines.empty() && lines.entries.back().instruction >= instruction) {
+                throw InvalidFile("invalid binary file: unordered line table");
+            }
+            lines.entries.push_back(vm::LineEntry{instruction, line, column});
+        }
+        ensureEnd(r);
+    }
+
+    // parse symbol table, object files only
+    std::optional<vm::SymbolTable> symbols;
+    if (object) {
+        r = section(Section::SYMBOLS);
+        symbols.emplace();
+        const auto getGlobal = [&](bool exported) {
+            vm::SymbolTable::Global g;
+            auto length = r.getULEB();
+            r.ensure(length, "invalid binary file: incomplete symbol name");
+            g.name.assign(reinterpret_cast<const char*>(r.p), length);
+            r.p += length;
+            g.type = static_cast<char>(r.get<vm::u1>());
+            if (!vm::SymbolTable::valid_type(g.type)) {
+                throw InvalidFile("invalid binary file: invalid symbol type");
+            }
+            g.offset = exported ? r.getULEB() : 0;
+            return g;
+        };
+        symbols->globalsSize = r.getULEB();
+        auto count = r.getULEB();
+        r.ensure(count, "incomplete binary file");
+        for (vm::u4 j = 0; j < count; ++j) {
+            auto fun = r.getULEB();
+            if (fun >= functions.size()) {
+                throw InvalidFile("invalid binary file: symbol table refers to no function");
+            }
+            symbols->functionImports.push_back(fun);
+        }
+        count = r.getULEB();
+        r.ensure(static_cast<size_t>(count) * 3, "incomplete binary file");
+        for (vm::u4 j = 0; j < count; ++j) {
+            symbols->exports.push_back(getGlobal(true));
+        }
+        count = r.getULEB();
+        r.ensure(static_cast<size_t>(count) * 2, "incomplete binary file");
+        for (vm::u4 j = 0; j < count; ++j) {
+            symbols->imports.push_back(getGlobal(false));
+        }
+        count = r.getULEB();
+        r.ensure(static_cast<size_t>(count) * 3, "incomplete binary file");
+        for (vm::u4 j = 0; j < count; ++j) {
+            vm::SymbolTable::GlobalUse use;
+            use.global = r.getULEB();
+            use.function = r.getULEB();
+            use.instruction = r.getULEB();
+            if (use.global >= symbols->imports.size() || use.function > functions.size()) {
+                throw InvalidFile("invalid binary file: symbol table refers to no global");
+            }
+            symbols->uses.push_back(use);
+        }
+        ensureEnd(r);
+    }
+
+    File file{2, std::move(constants), std::move(start), std::move(functions)};
+    file.startLines = std::move(startLines);
+    file.symbols = std::move(symbols);
+    return file;
+}
+
 }
 
 File File::parse_file_binary(std::ifstream& in) {
-    // read raw
-    const std::vector<unsigned char> buffer(std::istreambuf_iterator<char>(in), {});
+    auto buffer = MappedFile::read_all(in);
+    return parse_binary(buffer.data(), buffer.size());
+}
+
+File File::load_binary(const std::string& path) {
+    auto file = std::make_shared<MappedFile>(path);
+    return parse_binary(file->data(), file->size(), file);
+}
+
+File File::parse_binary(const unsigned char* buffer, size_t bufferSize) {
+    return parse_binary(buffer, bufferSize, nullptr);
+}
+
+File File::parse_binary(const unsigned char* buffer, size_t bufferSize, std::shared_ptr<const void> image) {
+    bool lazy = image != nullptr;
     size_t pos = 0;
-    const auto bufferSize = buffer.size();
-    const auto readByte = [&]() {
-        if (pos + 1 > bufferSize) {
-            throw InvalidFile("incomplete binary file");
+    const auto ensure = [&](size_t count, const char* msg) {
+        if (bufferSize - pos < count) {
+            throw InvalidFile(msg);
         }
-        vm::u1 rtv = static_cast<vm::u1>(buffer[pos]);
-        pos += 1;
-        return rtv;
+    };
+    const auto readByte = [&]() {
+        ensure(1, "incomplete binary file");
+        return buffer[pos++];
     };
     const auto read2bytes = [&] {
-        if (pos + 2 > bufferSize) {
-            throw InvalidFile("incomplete binary file");
-        }
-        vm::u2 rtv = static_cast<vm::u2>(
-            (buffer[pos] << 8) | buffer[pos+1]
-        );
+        ensure(2, "incomplete binary file");
+        auto rtv = load_be<vm::u2>(buffer + pos);
         pos += 2;
         return rtv;
     };
     const auto read4bytes = [&]() {
-        if (pos + 4 > bufferSize) {
-            throw InvalidFile("incomplete binary file");
-        }
-        vm::u4 rtv = static_cast<vm::u4>(
-            (buffer[pos] << 24) | (buffer[pos+1] << 16) | (buffer[pos+2] << 8) | buffer[pos+3]
-        );
+        ensure(4, "incomplete binary file");
+        auto rtv = load_be<vm::u4>(buffer + pos);
         pos += 4;
         return rtv;
     };
     const auto readDouble = [&]() {
-        if (pos + 8 > bufferSize) {
-            throw InvalidFile("invalid binary file: incomplete double constant");
-        }
-        union {
-            vm::double_t d;
-            unsigned char b[8];
-        } rtv;
-        for (int i = 7; i >= 0; --i) {
-            rtv.b[i] = buffer[pos++];
-        }
-        return rtv.d;
+        ensure(8, "invalid binary file: incomplete double constant");
+        auto rtv = load_be<vm::double_t>(buffer + pos);
+        pos += 8;
+        return rtv;
     };
     const auto readString = [&](vm::u2 length) {
-        if (pos + length > bufferSize) {
-            throw InvalidFile("invalid binary file: incomplete string constant");
-        }
-        vm::str_t rtv;
-        while (length-- ) {
-            rtv += buffer[pos++];
-        }
+        ensure(length, "invalid binary file: incomplete string constant");
+        vm::str_t rtv(reinterpret_cast<const char*>(buffer + pos), length);
+        pos += length;
         return rtv;
     };
-    const auto readInstruction = [&]() {
-        vm::Instruction ins;
-        ins.op = static_cast<vm::OpCode>(readByte());
-        if (vm::nameOfOpCode.count(ins.op) == 0) {
-            throw InvalidFile("invalid binary file: invalid opcode");
-        }
-        if (auto it = vm::paramSizeOfOpCode.find(ins.op); it != vm::paramSizeOfOpCode.end()) {
-            auto paramSizes = it->second;
-            switch (paramSizes[0]) {
-            case 1: ins.x = readByte(); break;
-            case 2: ins.x = read2bytes(); break;
-            case 4: ins.x = read4bytes(); break;
-            default: ;
-            }
-            if (paramSizes.size() == 2) {
-                ins.y = read4bytes();
-            }
-        }
-        return ins;
+    const auto readInstructions = [&](std::vector<vm::Instruction>& v) {
+        ByteReader r{ buffer + pos, buffer + bufferSize };
+        decodeInstructionsV1(r, v);
+        pos = r.p - buffer;
+    };
+    // the body is decoded by load_function
+    const auto skipInstructions = [&](vm::Function& fun) {
+        ByteReader r{ buffer + pos, buffer + bufferSize };
+        skipInstructionsV1(r);
+        fun.code = buffer + pos;
+        fun.codeEnd = r.p;
+        pos = r.p - buffer;
     };
 
     // parse magic
@@ -232,10 +1064,16 @@ File File::parse_file_binary(std::ifstream& in) {
 
     // parse version
     auto version = read4bytes(); 
+    if (version == 2) {
+        File file = parseBinaryV2(buffer, bufferSize, lazy);
+        file.image = std::move(image);
+        return file;
+    }
 
     // parse constants
     auto constantsCount = read2bytes();
     std::vector<vm::Constant> constants;
+    constants.reserve(constantsCount);
     for (int j = 0; j < constantsCount; ++j) {
         vm::Constant constant;
         constant.type = static_cast<vm::Constant::Type>(readByte());
@@ -243,7 +1081,7 @@ File File::parse_file_binary(std::ifstream& in) {
         {
         case vm::Constant::Type::STRING: {
             auto length = read2bytes();
-            constant.value = std::move(readString(length));
+            constant.value = readString(length);
         } break;
         case vm::Constant::Type::INT: {
             constant.value = static_cast<vm::int_t>(read4bytes());
@@ -258,15 +1096,13 @@ File File::parse_file_binary(std::ifstream& in) {
     }
 
     // parse start
-    auto instructionsCount = read2bytes();
     std::vector<vm::Instruction> start;
-    for (int j = 0; j < instructionsCount; ++j) {
-        start.push_back(std::move(readInstruction()));
-    }
+    readInstructions(start);
 
     // parse functions
     auto functionsCount = read2bytes();
     std::vector<vm::Function> functions;
+    functions.reserve(functionsCount);
     bool mainFound = false;
     for (int j = 0; j < functionsCount; ++j) {
         vm::Function fun;
@@ -282,9 +1118,11 @@ File File::parse_file_binary(std::ifstream& in) {
         }
         fun.paramSize = read2bytes();
         fun.level = read2bytes();
-        auto instructionsCount = read2bytes();
-        for (int k = 0; k < instructionsCount; ++k) {
-            fun.instructions.push_back(std::move(readInstruction()));
+        if (lazy) {
+            skipInstructions(fun);
+        }
+        else {
+            readInstructions(fun.instructions);
         }
         functions.push_back(std::move(fun));
     }
@@ -293,296 +1131,66 @@ File File::parse_file_binary(std::ifstream& in) {
         throw InvalidFile("invalid binary file: main() not found");
     }
 
-    if (pos != buffer.size()) {
-        throw InvalidFile("invalid binary file: unused content");
-    }
-
-    return File{version, std::move(constants), std::move(start), std::move(functions)};
-}
-
-File File::parse_file_text(std::ifstream& in) {
-    int line_count = 0;
-    std::string line = "";
-    std::string str = "";
-    std::stringstream ss;
-    const auto readLine = [&]() {
-        while(std::getline(in, line)) {
-            ++line_count;
-            // remove comment
-            if (auto ed = line.find_first_of('#'); ed != std::string::npos) {
-                line.resize(ed); 
-                // line.erase(line.begin()+ed, line.end());
+    // parse line table, optional
+    vm::LineTable startLines;
+    if (pos != bufferSize) {
+        auto entriesCount = read4bytes();
+        // 12 bytes per entry
+        ensure(static_cast<size_t>(entriesCount) * 12, "incomplete binary file");
+        for (vm::u4 j = 0; j < entriesCount; ++j) {
+            auto index = read2bytes();
+            auto instruction = read2bytes();
+            auto line = read4bytes();
+            auto column = read4bytes();
+            if (index != U2_MAX && index >= functions.size()) {
+                throw InvalidFile("invalid binary file: line table refers to no function");
             }
-            // remove leading and trailing whitespaces
-            line = trim(std::move(line));
-            // not a blank line     
-            if (!line.empty()) {
-                ss.str(line);
-                ss.clear();
-                return;
+            auto& lines = index == U2_MAX ? startLines : functions[index].lines;
+            if (!lines.empty() && lines.entries.back().instruction >= instruction) {
+                throw InvalidFile("invalid binary file: unordered line table");
             }
+            lines.entries.push_back(vm::LineEntry{instruction, line, column});
         }
-        // eof
-        line = "";
-        ss.str("");
-        ss.clear();
-    };
-    const auto reuseLine = [&]() {
-        ss.str(line);
-        ss.clear();
-    };
-    const auto errorLineInfo = [&]() {
-        println(std::cerr, "line", line_count, ":\n   ", line);
-    };
-    const auto errorInvalidFile = [&](std::string msg) {
-        errorLineInfo();
-        throw InvalidFile(msg);
-    };
-    #define errorIf(cond, msg)    do { if ((cond)) { errorInvalidFile((msg)); } } while(false)
-    #define errorIfNot(cond, msg) errorIf(!(cond), (msg))
-    #define errorIfAssignFailed(lhs, rhs, msg) do { try { lhs = (rhs); } catch (const std::exception&) { errorIf(true, (msg)); } } while(false)
-    auto ensureNoMoreInput = [&]() {
-        if (char ch; ss >> std::skipws >> ch) {
-            errorIf(true, "invalid line");
-        }
-    };
-
-    readLine();
-
-    // parse constants
-    std::vector<vm::Constant> constants;
-    ss >> str;
-    if (str == ".constants:") {
-        ensureNoMoreInput();
-        while (true) {
-            // {index} {type} {value}
-            readLine();
-            vm::Constant constant;
-            std::string temp;
-            int index;
-            std::string type;
-            std::string value;
-            // eof
-            if (!(ss >> temp)) { 
-                reuseLine(); break; 
-            }
-            // parse index
-            try {
-                index = try_to_int(temp);
-            }
-            catch (const std::exception&) {
-                reuseLine(); break;
-            }
-            errorIf(index != constants.size(), "unordered index");
-            errorIfNot(ss >> type, "constant type expected");
-            if (type == "S") {
-                constant.type = vm::Constant::Type::STRING;
-                char ch;
-                errorIfNot(ss >> std::skipws >> ch, "string constant expected");
-                errorIf(ch != '\"', "no leading qoute for string constant");
-                // parse the content of string
-                while (true) {
-                    errorIfNot(ss.get(ch), "no trailing quote for string constant");
-                    if (ch == '\"') { 
-                        break; 
-                    }
-                    if (ch == '\\') {
-                        errorIfNot(ss.get(ch), "incomplete escape seq");
-                        switch (ch) {
-                        case '\\': value += '\\'; break;
-                        case '\'': value += '\''; break;
-                        case '\"': value += '\"'; break;
-                        case 'n':  value += '\n'; break;
-                        case 'r':  value += '\r'; break;
-                        case 't':  value += '\t'; break;
-                        case 'x': {
-                            errorIfNot(ss.get(ch), "incomplete hex escape seq");
-                            errorIfNot(is_hex_digit(ch), "invalid hex escape seq");
-                            char v = (0xff & hex_digit_to_int(ch)) << 4;
-                            errorIfNot(ss.get(ch), "incomplete hex escape seq");
-                            errorIfNot(is_hex_digit(ch), "invalid hex escape seq");
-                            v |= (0xff & hex_digit_to_int(ch));
-                            value += v;
-                        }; break;
-                        default: errorIf(true, strfmt("unknown escape seq \"\\{}\"", ch));
-                        }
-                    }
-                    else {
-                        value += ch;
-                    }
-                }
-                errorIf(value.length() > UINT16_MAX, "too long the string constant");
-                constant.value = std::move(value);
-            }
-            else if (type == "I") {
-                constant.type = vm::Constant::Type::INT;
-                errorIfNot(ss >> std::skipws >> value, "invalid format");
-                errorIfAssignFailed(constant.value, try_to_int(value), "out of range or invalid format");
-            }
-            else if (type == "D") {
-                constant.type = vm::Constant::Type::DOUBLE;
-                errorIfNot(ss >> std::skipws >> value, "invalid format");
-                errorIfAssignFailed(constant.value, try_to_double(value), "out of range or invalid format");
-            }
-            else {
-                errorIf(true, "invalid constant type");
-            }
-            constants.push_back(std::move(constant));
-            ensureNoMoreInput();
-        }
-    }
-    else {
-        errorIf(true, ".constants expected");
-    }
-    errorIf(constants.size() > U2_MAX, "too many constants");
-
-    // parse instructions
-    auto parseInstructions = [&]() {
-        std::vector<vm::Instruction> rtv;
-        while(true) {
-            // {index} {opcode} {param1} {param2}
-            readLine();
-            std::string temp;
-            int index;
-            std::string opName;
-            // eof
-            if (!(ss >> temp)) { 
-                reuseLine(); break; 
-            }
-            // parse index
-            try {
-                index = try_to_int(temp);
-            }
-            catch (const std::exception&) {
-                reuseLine(); break;
-            }
-            errorIf(index != rtv.size(), "unordered index");
-            errorIfNot(ss >> opName, "opcode expected");
-            opName = to_lower(opName);
-            vm::Instruction ins;
-            if (auto it = vm::opCodeOfName.find(opName); true) {
-                errorIf(it == vm::opCodeOfName.end(), "no such opcode");
-                ins.op = it->second;
-            }
-            if (auto it = vm::paramSizeOfOpCode.find(ins.op); it != vm::paramSizeOfOpCode.end()) {
-                int paramCount = it->second.size();
-                std::string restLine;
-                errorIfNot(std::getline(ss, restLine), "parameters expected");
-                auto params = split(restLine, ',');
-                errorIf(params.size() != paramCount, 
-                    strfmt("{} parameters expected, {} got", paramCount, params.size())
-                );
-                errorIfAssignFailed(ins.x, try_to_int(params[0]), 
-                    strfmt("invalid first parameter: {}", params[0])
-                );
-                if (paramCount == 2) {
-                    errorIfAssignFailed(ins.y, try_to_int(params[1]), 
-                        strfmt("invalid second parameter: {}", params[1])
-                    );
-                }
-            }
-            ensureNoMoreInput();
-            rtv.push_back(ins);
-        }
-        errorIf(rtv.size() > U2_MAX, "too many instructions");
-        return rtv;
-    };
-
-    // parse start
-    std::vector<vm::Instruction> start;
-    ss >> str;
-    if (str == ".start:") {
-        ensureNoMoreInput();
-        start = std::move(parseInstructions());
     }
-    else {
-        errorIf(true, ".start expected");
+
+    if (pos != bufferSize) {
+        throw InvalidFile("invalid binary file: unused content");
     }
 
-    // parse functions
-    std::vector<vm::Function> functions;
-    bool mainFound = false;
-    ss >> str;
-    if (str == ".functions:") {
-        ensureNoMoreInput();
-        while (true) {
-            // {index} {nameIndex} {paramSize} {level}
-            readLine();
-            vm::Function function;
-            std::string temp;
-            int index;
-            // no more function
-            if (!(ss >> temp)) { 
-                reuseLine(); break; 
-            }
-            // parse index
-            try {
-                index = try_to_int(temp);
-            }
-            catch (const std::exception&) {
-                reuseLine(); break;
-            }
-            errorIf(index != functions.size(), "unordered index");
-            errorIfNot(ss >> temp, "name_index expected");
-            errorIfAssignFailed(function.nameIndex, try_to_int(temp), "invalid name_index");
-            errorIf(function.nameIndex >= constants.size(), "name not found");
-            errorIf(constants[function.nameIndex].type != vm::Constant::Type::STRING, "name not found");
-            if (std::get<vm::str_t>(constants[function.nameIndex].value) == "main") {
-                mainFound = true;
-            }
-            errorIfNot(ss >> temp, "param_size expected");
-            errorIfAssignFailed(function.paramSize, try_to_int(temp), "invalid param_size");
-            errorIf(function.paramSize > U2_MAX, "too many parameters");
-            errorIfNot(ss >> temp, "level expected");
-            errorIfAssignFailed(function.level, try_to_int(temp), "invalid level");
-            errorIf(function.level > U2_MAX, "too high the level");
-            functions.push_back(std::move(function));
-            ensureNoMoreInput();
-        }
-    }
-    else {
-        errorIf(true, ".functions expected");
-    }
-    errorIfNot(mainFound, "main() not found");
-
-    int functions_count = functions.size();
-    errorIf(functions_count > U2_MAX, "too many functions");
-    for (int i = 0; i < functions_count; ++i) {
-        errorIfNot(ss >> str, strfmt("\".F{}:\" expected", i));
-        errorIf((str.length() < 2 || str.back() != ':'), strfmt("\".F{}:\" expected", i));
-        str.pop_back();
-
-        int index = -1;
-        if (str.front() == '.') {
-            str.erase(str.begin());
-            ss.str(str);
-            ss.clear();
-            char ch;
-            ss >> std::skipws >> ch;
-            if ((ch == 'F' || ch == 'f')) {
-                // .Fx
-                std::string temp;
-                errorIfNot(ss >> temp, strfmt("\".F{}:\" expected", i));
-                errorIfAssignFailed(index, try_to_int(temp), "invalid function index");
-                errorIf(index != i, strfmt("\".F{}:\" expected", i));
-            }
+    File file{version, std::move(constants), std::move(start), std::move(functions)};
+    file.startLines = std::move(startLines);
+    file.image = std::move(image);
+    return file;
+}
+
+const std::vector<vm::Instruction>& File::load_function(size_t index) {
+    auto& fun = functions.at(index);
+    if (!fun.loaded()) {
+        ByteReader r{ fun.code, fun.codeEnd };
+        std::vector<vm::Instruction> instructions;
+        if (version == 2) {
+            decodeInstructionsV2(r, instructions);
         }
         else {
-            // str is name
-            index = -1;
-            for (auto j = 0; j < functions_count; ++j) {
-                if (std::get<std::string>(constants.at(functions.at(j).nameIndex).value) == str) {
-                    index = j;
-                    break;
-                }
-            } 
+            decodeInstructionsV1(r, instructions);
+        }
+        if (r.p != r.end) {
+            throw InvalidFile("invalid binary file: unused content");
         }
-        ensureNoMoreInput();
-        errorIf(index < 0, "no such function");
-        functions.at(index).instructions = std::move(parseInstructions());
+        fun.instructions = std::move(instructions);
+        fun.code = fun.codeEnd = nullptr;
     }
+    return fun.instructions;
+}
 
-    errorIf(in >> str, "unused content");
+void File::load_all() {
+    for (size_t i = 0; i < functions.size(); ++i) {
+        load_function(i);
+    }
+}
 
-    return File{0x00000001, std::move(constants), std::move(start), std::move(functions)};
+bool File::all_loaded() const {
+    return std::all_of(functions.begin(), functions.end(), 
+        [](const vm::Function& fun) { return fun.loaded(); }
+    );
 }
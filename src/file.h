@@ -5,25 +5,66 @@
 #include "./instruction.h"
 #include "./constant.h"
 #include "./function.h"
+#include "./line_table.h"
+#include "./symbol_table.h"
 
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
 struct File
 {
     static const vm::u4 magic_v = 0x43303A29;
+    // the format output_binary writes: 1, or 2 for 32-bit counts,
+    // a section table and LEB128 operands
     vm::u4 version;
     std::vector<vm::Constant> constants;
     std::vector<vm::Instruction> start;
     std::vector<vm::Function> functions;
+    // optional source positions of .start, see Function::lines for the functions
+    vm::LineTable startLines;
+    // the data the bodies not decoded yet point into, see Function::code
+    std::shared_ptr<const void> image;
+    // an object file is linked with others by File::link before it runs
+    std::optional<vm::SymbolTable> symbols;
 
     File(vm::u4, std::vector<vm::Constant>, std::vector<vm::Instruction>, std::vector<vm::Function>);
 
-    static File parse_file_text(std::ifstream& in);
     static File parse_file_binary(std::ifstream& in);
+    // maps the file into memory instead of reading it through a stream,
+    // the function bodies are decoded on first use
+    static File load_binary(const std::string& path);
+    static File parse_binary(const unsigned char* data, size_t size);
+    // with an image that owns data, only the function headers are decoded
+    static File parse_binary(const unsigned char* data, size_t size, std::shared_ptr<const void> image);
     void output_text(std::ostream& out);
     void output_binary(std::ofstream& out);
+    // the binary file in memory, exactly binary_size() bytes,
+    // throws InvalidFile if the file does not fit the version
+    void output_binary(std::vector<unsigned char>& buffer) const;
+    std::vector<unsigned char> serialize_binary() const;
+    size_t binary_size() const;
+    bool has_line_table() const;
+    // decodes the body of the function if it is not yet,
+    // throws InvalidFile if it is malformed
+    const std::vector<vm::Instruction>& load_function(size_t index);
+    void load_all();
+    bool all_loaded() const;
+    // merges the constants equal in type and value and remaps their uses,
+    // returns the number of constants removed; run on the output of the
+    // analyser and of link, a binary file run as it is keeps its pool
+    size_t dedup_constants();
+
+    bool is_object() const noexcept { return symbols.has_value(); }
+    // Links the object files into one program: the constants are merged,
+    // the functions and globals imported resolved by name, and the indexes
+    // of call and loadc and the offsets of the globals relocated.
+    // Throws InvalidFile for undefined or duplicated symbols.
+    static File link(std::vector<File> objects);
 };
 
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "./type.h"
 #include "./util/print.hpp"
 #include "./instruction.h"
+#include "./line_table.h"
 
 #include <cstdint>
 #include <vector>
@@ -11,10 +12,20 @@
 namespace vm {
 
 struct Function {
-    u2 nameIndex;
+    u4 nameIndex;
     u2 paramSize;
     u2 level;
     std::vector<vm::Instruction> instructions;
+    // empty unless the file carries a line table
+    LineTable lines;
+    // the encoded body until File::load_function decodes it into instructions,
+    // points into File::image
+    const u1* code = nullptr;
+    const u1* codeEnd = nullptr;
+
+    bool loaded() const noexcept {
+        return code == nullptr;
+    }
 };
 
 }
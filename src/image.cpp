@@ -0,0 +1,194 @@
+#include "./image.h"
+#include "./exception.h"
+#include "./util/sha256.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <elf.h>
+#include <link.h>
+#endif
+
+namespace vm {
+
+#ifdef __linux__
+// the NT_GNU_BUILD_ID note of the executable, empty if it was linked without one
+static std::string gnuBuildId() {
+    std::string id;
+    dl_iterate_phdr([](dl_phdr_info* info, size_t, void* data) {
+        auto& id = *static_cast<std::string*>(data);
+        for (int i = 0; i < info->dlpi_phnum; ++i) {
+            const auto& ph = info->dlpi_phdr[i];
+            if (ph.p_type != PT_NOTE) {
+                continue;
+            }
+            auto p = reinterpret_cast<const char*>(info->dlpi_addr + ph.p_vaddr);
+            auto end = p + ph.p_memsz;
+            while (p + sizeof(ElfW(Nhdr)) <= end) {
+                auto note = reinterpret_cast<const ElfW(Nhdr)*>(p);
+                auto name = p + sizeof(ElfW(Nhdr));
+                auto desc = name + ((note->n_namesz + 3) & ~3u);
+                if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0) {
+                    id.assign(desc, note->n_descsz);
+                    return 1;
+                }
+                p = desc + ((note->n_descsz + 3) & ~3u);
+            }
+        }
+        // the executable is the first object
+        return 1;
+    }, &id);
+    return id;
+}
+#endif
+
+const std::array<u1, 16>& imageBuildId() {
+    static const std::array<u1, 16> id = [] {
+        Sha256 h;
+        h.update("cc0 image 1");
+        std::string build;
+#ifdef __linux__
+        build = gnuBuildId();
+#endif
+        if (build.empty()) {
+            build = __DATE__ " " __TIME__;
+        }
+        h.update(build);
+        const u4 layout[] = {
+            sizeof(ImageHeader), sizeof(ImageFunction), sizeof(ConstantSlots), sizeof(ImageHeapRecord),
+            sizeof(Instruction), offsetof(Instruction, x), offsetof(Instruction, y), sizeof(slot_t), 0x01020304,
+        };
+        h.update(layout, sizeof layout);
+        auto digest = h.finish();
+        std::array<u1, 16> id;
+        std::memcpy(id.data(), digest.data(), id.size());
+        return id;
+    }();
+    return id;
+}
+
+Image::Image(const std::string& path) : _file(path, false), _header(nullptr) {
+    const auto invalid = [](const char* msg) {
+        throw InvalidFile(std::string("invalid image: ") + msg);
+    };
+    if (_file.size() < sizeof(ImageHeader) || std::memcmp(_file.data(), imageMagic, sizeof imageMagic) != 0) {
+        invalid("not an image");
+    }
+    _header = reinterpret_cast<const ImageHeader*>(_file.data());
+    if (_header->buildId != imageBuildId()) {
+        invalid("written by another build of cc0");
+    }
+    const auto ensureArray = [&](u8 offset, u8 count, u8 size) {
+        if (offset % 8 != 0 || offset > _file.size() || count > (_file.size() - offset) / size) {
+            invalid("array out of range");
+        }
+    };
+    ensureArray(_header->functionsOffset, _header->functionCount, sizeof(ImageFunction));
+    ensureArray(_header->constantsOffset, _header->constantCount, sizeof(ConstantSlots));
+    ensureArray(_header->heapRecordsOffset, _header->heapRecordCount, sizeof(ImageHeapRecord));
+    ensureArray(_header->heapOffset, _header->heapSize, sizeof(slot_t));
+    ensureArray(_header->codeOffset, _header->codeSize, sizeof(Instruction));
+    ensureArray(_header->namesOffset, _header->namesSize, 1);
+    if (_header->startSize > _header->codeSize) {
+        invalid(".start out of range");
+    }
+    for (u4 i = 0; i < _header->functionCount; ++i) {
+        auto& fun = functions()[i];
+        if (fun.codeOffset > _header->codeSize || fun.codeSize > _header->codeSize - fun.codeOffset
+            || fun.nameOffset > _header->namesSize || fun.nameSize > _header->namesSize - fun.nameOffset) {
+            invalid("function out of range");
+        }
+    }
+}
+
+std::shared_ptr<const Image> Image::load(const std::string& path) {
+    return std::make_shared<const Image>(path);
+}
+
+std::vector<unsigned char> Image::serialize(const ImageSource& source) {
+    ImageHeader header{};
+    std::memcpy(header.magic, imageMagic, sizeof imageMagic);
+    header.buildId = imageBuildId();
+    header.functionCount = static_cast<u4>(source.functions.size());
+    header.constantCount = static_cast<u4>(source.constants.size());
+    header.heapRecordCount = static_cast<u4>(source.heapRecords.size());
+    header.heapSize = source.heapSize;
+    header.startSize = static_cast<u4>(source.start->size());
+    u8 codeSize = source.start->size();
+    u8 namesSize = 0;
+    for (auto& fun : source.functions) {
+        codeSize += fun.code->size();
+        namesSize += fun.name.size();
+    }
+    if (codeSize > U4_MAX || namesSize > U4_MAX) {
+        throw InvalidFile("the program is too large for an image");
+    }
+    header.codeSize = static_cast<u4>(codeSize);
+    header.namesSize = namesSize;
+
+    u8 size = sizeof(ImageHeader);
+    const auto place = [&](u8& offset, u8 bytes) {
+        size = (size + 7) & ~u8(7);
+        offset = size;
+        size += bytes;
+    };
+    place(header.functionsOffset, u8(header.functionCount) * sizeof(ImageFunction));
+    place(header.constantsOffset, u8(header.constantCount) * sizeof(ConstantSlots));
+    place(header.heapRecordsOffset, u8(header.heapRecordCount) * sizeof(ImageHeapRecord));
+    place(header.heapOffset, u8(header.heapSize) * sizeof(slot_t));
+    place(header.codeOffset, codeSize * sizeof(Instruction));
+    place(header.namesOffset, namesSize);
+
+    // zero filled, so the padding of the structures is deterministic
+    std::vector<unsigned char> image(size);
+    auto base = image.data();
+    std::memcpy(base, &header, sizeof header);
+
+    auto code = reinterpret_cast<Instruction*>(base + header.codeOffset);
+    u4 codeOffset = 0;
+    const auto putCode = [&](const std::vector<Instruction>& instructions) {
+        for (auto& ins : instructions) {
+            code[codeOffset].op = ins.op;
+            code[codeOffset].x = ins.x;
+            code[codeOffset].y = ins.y;
+            ++codeOffset;
+        }
+    };
+    putCode(*source.start);
+
+    auto functions = reinterpret_cast<ImageFunction*>(base + header.functionsOffset);
+    auto names = reinterpret_cast<char*>(base + header.namesOffset);
+    u4 nameOffset = 0;
+    for (size_t i = 0; i < source.functions.size(); ++i) {
+        auto& fun = source.functions[i];
+        functions[i].codeOffset = codeOffset;
+        functions[i].codeSize = static_cast<u4>(fun.code->size());
+        functions[i].paramSize = fun.paramSize;
+        functions[i].level = fun.level;
+        functions[i].nameOffset = nameOffset;
+        functions[i].nameSize = static_cast<u4>(fun.name.size());
+        putCode(*fun.code);
+        std::memcpy(names + nameOffset, fun.name.data(), fun.name.size());
+        nameOffset += static_cast<u4>(fun.name.size());
+    }
+
+    auto constants = reinterpret_cast<ConstantSlots*>(base + header.constantsOffset);
+    for (size_t i = 0; i < source.constants.size(); ++i) {
+        constants[i].count = source.constants[i].count;
+        constants[i].value[0] = source.constants[i].value[0];
+        constants[i].value[1] = source.constants[i].value[1];
+    }
+    auto records = reinterpret_cast<ImageHeapRecord*>(base + header.heapRecordsOffset);
+    for (size_t i = 0; i < source.heapRecords.size(); ++i) {
+        records[i].addr = source.heapRecords[i].first;
+        records[i].size = source.heapRecords[i].second;
+    }
+    if (header.heapSize != 0) {
+        std::memcpy(base + header.heapOffset, source.heap, u8(header.heapSize) * sizeof(slot_t));
+    }
+    return image;
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef IMAGE_H_INCLUDED
+#define IMAGE_H_INCLUDED
+
+#include "./type.h"
+#include "./instruction.h"
+#include "./mapped_file.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace vm {
+
+// what loadc pushes for a constant, strings are resolved to their heap address
+struct ConstantSlots {
+    u4 count; // 1, or 2 for a double
+    slot_t value[2];
+};
+
+// An execution image is what VM::start otherwise builds from a File: the
+// constants as ConstantSlots, the heap holding the string literals, and the
+// decoded and verified instructions, in the layout and byte order of this
+// build. The VM maps it and runs it as is, nothing is decoded or verified,
+// so only images written by the same build are accepted, see imageBuildId.
+//
+// The header is followed by arrays at the offsets it records, in bytes from
+// the start of the image, each aligned to 8 bytes:
+//   functions     ImageFunction[functionCount]
+//   constants     ConstantSlots[constantCount]
+//   heap records  ImageHeapRecord[heapRecordCount]
+//   heap          slot_t[heapSize], from the lowest heap address on
+//   code          Instruction[], .start and then the functions
+//   names         the names of the functions, not terminated
+struct ImageHeader {
+    char magic[8];
+    std::array<u1, 16> buildId;
+    u4 functionCount;
+    u4 constantCount;
+    u4 heapRecordCount;
+    u4 heapSize;
+    u4 codeSize;
+    u4 startSize;
+    u8 functionsOffset;
+    u8 constantsOffset;
+    u8 heapRecordsOffset;
+    u8 heapOffset;
+    u8 codeOffset;
+    u8 namesOffset;
+    u8 namesSize;
+};
+
+struct ImageFunction {
+    u4 codeOffset; // in instructions from the start of the code
+    u4 codeSize;
+    u4 paramSize;
+    u4 level;
+    u4 nameOffset; // in bytes from the start of the names
+    u4 nameSize;
+};
+
+struct ImageHeapRecord {
+    addr_t addr;
+    addr_t size;
+};
+
+inline constexpr char imageMagic[8] = { 'C', '0', 'I', 'M', 'A', 'G', 'E', '\0' };
+
+// the GNU build ID of the running executable where there is one, hashed with
+// the layout of the structures above
+const std::array<u1, 16>& imageBuildId();
+
+// the input of Image::serialize, gathered by VM::make_image
+struct ImageSource {
+    struct Function {
+        std::string_view name;
+        const std::vector<Instruction>* code;
+        u4 paramSize;
+        u4 level;
+    };
+    const std::vector<Instruction>* start;
+    std::vector<Function> functions;
+    std::vector<ConstantSlots> constants;
+    std::vector<std::pair<addr_t, addr_t>> heapRecords;
+    const slot_t* heap;
+    u4 heapSize;
+};
+
+class Image {
+public:
+    // throws InvalidFile unless the file is an image of this build,
+    // only the header and the bounds of the arrays are checked
+    static std::shared_ptr<const Image> load(const std::string& path);
+    static std::vector<unsigned char> serialize(const ImageSource& source);
+
+    explicit Image(const std::string& path);
+
+    const ImageHeader& header() const noexcept { return *_header; }
+    const ImageFunction* functions() const noexcept { return at<ImageFunction>(_header->functionsOffset); }
+    const ConstantSlots* constants() const noexcept { return at<ConstantSlots>(_header->constantsOffset); }
+    const ImageHeapRecord* heapRecords() const noexcept { return at<ImageHeapRecord>(_header->heapRecordsOffset); }
+    const slot_t* heap() const noexcept { return at<slot_t>(_header->heapOffset); }
+    const Instruction* code() const noexcept { return at<Instruction>(_header->codeOffset); }
+    std::string_view name(const ImageFunction& fun) const noexcept {
+        return std::string_view(at<char>(_header->namesOffset) + fun.nameOffset, fun.nameSize);
+    }
+
+private:
+    template <typename T>
+    const T* at(u8 offset) const noexcept {
+        return reinterpret_cast<const T*>(_file.data() + offset);
+    }
+
+    MappedFile _file;
+    const ImageHeader* _header;
+};
+
+}
+
+#endif
@@ -18,17 +18,16 @@ struct Instruction {
 
 template <>
 inline void print(std::ostream& out, const vm::Instruction& t) {
-    const char* name = vm::nameOfOpCode.at(t.op); 
-    if (auto it = vm::paramSizeOfOpCode.find(t.op); it != vm::paramSizeOfOpCode.end()) {
-        switch (it->second.size()) {
-        case 0: print(out, name); break;
-        case 1: print(out, name, t.x); break;
-        case 2: printfmt(out, "{} {},{}", name, t.x, t.y); break;
-        default: print(out, "????"); break;
-        }
+    const auto& info = vm::infoOf(t.op);
+    if (!info.valid()) {
+        print(out, "????");
+        return;
     }
-    else {
-        print(out, name);
+    switch (info.paramCount) {
+    case 0: print(out, info.name); break;
+    case 1: print(out, info.name, t.x); break;
+    case 2: printfmt(out, "{} {},{}", info.name, t.x, t.y); break;
+    default: print(out, "????"); break;
     }
 }
 
@@ -0,0 +1,55 @@
+#ifndef LINE_TABLE_H_INCLUDED
+#define LINE_TABLE_H_INCLUDED
+
+#include "./type.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace vm {
+
+// instruction index -> C0 source position, 1-based line and column
+struct LineEntry {
+    u4 instruction;
+    u4 line;
+    u4 column;
+};
+
+// Only the instructions where the source position changes are recorded,
+// an instruction belongs to the last entry at or before it.
+struct LineTable {
+    std::vector<LineEntry> entries;
+
+    bool empty() const noexcept {
+        return entries.empty();
+    }
+
+    void add(u4 instruction, u4 line, u4 column) {
+        if (!entries.empty()) {
+            auto& last = entries.back();
+            if (last.line == line && last.column == column) {
+                return;
+            }
+            if (last.instruction == instruction) {
+                last.line = line;
+                last.column = column;
+                return;
+            }
+        }
+        entries.push_back(LineEntry{instruction, line, column});
+    }
+
+    const LineEntry* lookup(u4 instruction) const noexcept {
+        auto it = std::upper_bound(entries.begin(), entries.end(), instruction,
+            [](u4 ins, const LineEntry& e) { return ins < e.instruction; }
+        );
+        if (it == entries.begin()) {
+            return nullptr;
+        }
+        return &*(it - 1);
+    }
+};
+
+}
+
+#endif
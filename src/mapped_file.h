@@ -0,0 +1,96 @@
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include "./exception.h"
+
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CC0_HAS_MMAP 1
+#endif
+
+// Read-only view of a whole file: mmap(2) where available, otherwise the
+// file is read into memory with one read.
+class MappedFile {
+public:
+    // sequential if the file is decoded front to back exactly once
+    explicit MappedFile(const std::string& path, bool sequential = true) {
+#ifdef CC0_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw InvalidFile("invalid binary file: cannot open " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw InvalidFile("invalid binary file: cannot open " + path);
+        }
+        _size = static_cast<size_t>(st.st_size);
+        if (_size > 0) {
+            void* p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                _data = static_cast<const unsigned char*>(p);
+                _mapped = true;
+                ::madvise(p, _size, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+            }
+        }
+        ::close(fd);
+        if (_mapped || _size == 0) {
+            return;
+        }
+#endif
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw InvalidFile("invalid binary file: cannot open " + path);
+        }
+        _buffer = read_all(in);
+        _data = _buffer.data();
+        _size = _buffer.size();
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+#ifdef CC0_HAS_MMAP
+        if (_mapped) {
+            ::munmap(const_cast<unsigned char*>(_data), _size);
+        }
+#endif
+    }
+
+    const unsigned char* data() const noexcept { return _data; }
+    size_t size() const noexcept { return _size; }
+
+    static std::vector<unsigned char> read_all(std::istream& in) {
+        std::vector<unsigned char> buffer;
+        in.seekg(0, std::ios::end);
+        auto end = in.tellg();
+        in.seekg(0, std::ios::beg);
+        if (end > 0) {
+            buffer.resize(static_cast<size_t>(end));
+            in.read(reinterpret_cast<char*>(buffer.data()), end);
+            buffer.resize(static_cast<size_t>(in.gcount()));
+        }
+        else {
+            // not seekable
+            in.clear();
+            buffer.assign(std::istreambuf_iterator<char>(in), {});
+        }
+        return buffer;
+    }
+
+private:
+    const unsigned char* _data = nullptr;
+    size_t _size = 0;
+    bool _mapped = false;
+    std::vector<unsigned char> _buffer;
+};
+
+#endif
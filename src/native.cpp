@@ -0,0 +1,129 @@
+#include "./native.h"
+#include "./array_kernels.h"
+#include "./exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+
+namespace vm {
+
+// no array is larger than the heap
+static const int_t MAX_ARRAY_SLOTS = 0x01000000;
+
+// T[count] at addr, one range check for the whole array
+template <typename T>
+static T* nativeArray(NativeMemory& memory, addr_t addr, int_t count) {
+    if (count < 0) {
+        throw InvalidMemoryAccess("negative array length");
+    }
+    if (count == 0) {
+        return nullptr;
+    }
+    if (count > (MAX_ARRAY_SLOTS / slots_count<T>)) {
+        throw InvalidMemoryAccess("tried to access unexistent memory");
+    }
+    return reinterpret_cast<T*>(memory.checkAddr(addr, count * slots_count<T>));
+}
+
+// double name(double)
+#define NATIVE_D_D(name, fn) { #name, "d", 'd', [](const slot_t* args, slot_t* result, NativeMemory&) { \
+    nativeResult<double_t>(result, fn(nativeArg<double_t>(args, 0))); } }
+// double name(double, double)
+#define NATIVE_D_DD(name, fn) { #name, "dd", 'd', [](const slot_t* args, slot_t* result, NativeMemory&) { \
+    nativeResult<double_t>(result, fn(nativeArg<double_t>(args, 0), nativeArg<double_t>(args, 2))); } }
+// int name(int, int)
+#define NATIVE_I_II(name, fn) { #name, "ii", 'i', [](const slot_t* args, slot_t* result, NativeMemory&) { \
+    nativeResult<int_t>(result, fn(nativeArg<int_t>(args, 0), nativeArg<int_t>(args, 1))); } }
+
+// Tfill(array, count, value) -> array
+#define NATIVE_FILL(name, T, sig) { #name, sig, 'a', [](const slot_t* args, slot_t* result, NativeMemory& memory) { \
+    auto addr = nativeArg<addr_t>(args, 0);                                                                     \
+    auto count = nativeArg<int_t>(args, 1);                                                                     \
+    kernels::fill(nativeArray<T>(memory, addr, count), nativeArg<T>(args, 2), count);                            \
+    nativeResult<addr_t>(result, addr); } }
+// Tcopy(dst, src, count) -> dst, the arrays may overlap
+#define NATIVE_COPY(name, T) { #name, "aai", 'a', [](const slot_t* args, slot_t* result, NativeMemory& memory) { \
+    auto dst = nativeArg<addr_t>(args, 0);                                                                      \
+    auto count = nativeArg<int_t>(args, 2);                                                                     \
+    auto s = nativeArray<T>(memory, nativeArg<addr_t>(args, 1), count);                                         \
+    auto d = nativeArray<T>(memory, dst, count);                                                                \
+    if (count > 0) {                                                                                            \
+        std::memmove(d, s, sizeof(T) * count);                                                                  \
+    }                                                                                                           \
+    nativeResult<addr_t>(result, dst); } }
+// Tname(array, count) -> T
+#define NATIVE_REDUCE(name, T, ret, kernel) { #name, "ai", ret, [](const slot_t* args, slot_t* result, NativeMemory& memory) { \
+    auto count = nativeArg<int_t>(args, 1);                                                                     \
+    nativeResult<T>(result, kernels::kernel(nativeArray<T>(memory, nativeArg<addr_t>(args, 0), count), count)); } }
+// Tdot(lhs, rhs, count) -> T
+#define NATIVE_DOT(name, T, ret) { #name, "aai", ret, [](const slot_t* args, slot_t* result, NativeMemory& memory) { \
+    auto count = nativeArg<int_t>(args, 2);                                                                     \
+    auto lhs = nativeArray<T>(memory, nativeArg<addr_t>(args, 0), count);                                       \
+    auto rhs = nativeArray<T>(memory, nativeArg<addr_t>(args, 1), count);                                       \
+    nativeResult<T>(result, kernels::dot(lhs, rhs, count)); } }
+
+const std::vector<NativeFunction>& nativeFunctions() {
+    static const std::vector<NativeFunction> natives = {
+        NATIVE_D_D(sqrt,  std::sqrt),
+        NATIVE_D_DD(pow,  std::pow),
+        NATIVE_D_D(exp,   std::exp),
+        NATIVE_D_D(log,   std::log),
+        NATIVE_D_D(sin,   std::sin),
+        NATIVE_D_D(cos,   std::cos),
+        NATIVE_D_D(tan,   std::tan),
+        NATIVE_D_D(atan,  std::atan),
+        NATIVE_D_D(floor, std::floor),
+        NATIVE_D_D(ceil,  std::ceil),
+        NATIVE_D_D(fabs,  std::fabs),
+        NATIVE_D_DD(fmin, std::fmin),
+        NATIVE_D_DD(fmax, std::fmax),
+        { "abs", "i", 'i', [](const slot_t* args, slot_t* result, NativeMemory&) {
+            // wraps like ineg for INT_MIN
+            auto v = nativeArg<int_t>(args, 0);
+            nativeResult<int_t>(result, v < 0 ? static_cast<int_t>(0u - static_cast<u4>(v)) : v);
+        } },
+        NATIVE_I_II(min, std::min<int_t>),
+        NATIVE_I_II(max, std::max<int_t>),
+        // processor time in seconds
+        { "clock", "", 'd', [](const slot_t*, slot_t* result, NativeMemory&) {
+            nativeResult<double_t>(result, static_cast<double_t>(std::clock()) / CLOCKS_PER_SEC);
+        } },
+
+        // whole-array builtins over int and double arrays
+        NATIVE_FILL(ifill, int_t, "aii"),
+        NATIVE_FILL(dfill, double_t, "aid"),
+        NATIVE_COPY(icopy, int_t),
+        NATIVE_COPY(dcopy, double_t),
+        NATIVE_REDUCE(isum, int_t, 'i', sum),
+        NATIVE_REDUCE(dsum, double_t, 'd', sum),
+        NATIVE_DOT(idot, int_t, 'i'),
+        NATIVE_DOT(ddot, double_t, 'd'),
+        NATIVE_REDUCE(imin, int_t, 'i', min),
+        NATIVE_REDUCE(imax, int_t, 'i', max),
+        NATIVE_REDUCE(dmin, double_t, 'd', min),
+        NATIVE_REDUCE(dmax, double_t, 'd', max),
+    };
+    return natives;
+}
+
+#undef NATIVE_D_D
+#undef NATIVE_D_DD
+#undef NATIVE_I_II
+#undef NATIVE_FILL
+#undef NATIVE_COPY
+#undef NATIVE_REDUCE
+#undef NATIVE_DOT
+
+int findNative(const std::string& name) {
+    auto& natives = nativeFunctions();
+    for (size_t i = 0; i < natives.size(); ++i) {
+        if (name == natives[i].name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef NATIVE_H_INCLUDED
+#define NATIVE_H_INCLUDED
+
+#include "./type.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+// Checked access to VM memory for the builtins working on arrays,
+// throws InvalidMemoryAccess like the load and store instructions.
+class NativeMemory {
+public:
+    virtual slot_t* checkAddr(addr_t addr, addr_t count) = 0;
+protected:
+    ~NativeMemory() = default;
+};
+
+// Builtin functions implemented in C++ and called by `callnative index(2)`.
+// The parameters are on the stack as for `call` (the first one pushed
+// first), callnative pops them and pushes the result.
+struct NativeFunction {
+    const char* name;
+    // one character per parameter, 'i' int, 'a' address or 'd' double
+    const char* params;
+    // 'i', 'a' or 'd'
+    char returnType;
+    // args points to the slot of the first parameter,
+    // result has room for a double
+    void (*invoke)(const slot_t* args, slot_t* result, NativeMemory& memory);
+
+    // parameter size in slots
+    addr_t paramSize() const noexcept {
+        addr_t size = 0;
+        for (auto p = params; *p != '\0'; ++p) {
+            size += *p == 'd' ? slots_count<double_t> : slots_count<int_t>;
+        }
+        return size;
+    }
+};
+
+// the index in this table is the operand of callnative,
+// so new natives are only ever appended
+const std::vector<NativeFunction>& nativeFunctions();
+
+// index in nativeFunctions(), -1 if there is no such native
+int findNative(const std::string& name);
+
+template <typename T>
+inline T nativeArg(const slot_t* args, addr_t slot) {
+    T value;
+    std::memcpy(&value, args + slot, sizeof value);
+    return value;
+}
+
+template <typename T>
+inline void nativeResult(slot_t* result, T value) {
+    std::memcpy(result, &value, sizeof value);
+}
+
+}
+
+#endif
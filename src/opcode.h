@@ -3,219 +3,257 @@
 
 #include "./type.h"
 
-#include <vector>
-#include <unordered_map>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 
 namespace vm {
 
-enum class OpCode : u1 {
-    // do nothing
-    nop = 0x00,
-    
-    // bipush value(1)
-    // ...
-    // ..., value
-    bipush = 0x01,
-
-    // ipush value(4)
-    // ...
-    // ..., value
-    ipush  = 0x02,
-
-    // pop / popn count(4)
-    // ..., value(n)
-    // ...
-    pop = 0x04, pop2 = 0x05, popn = 0x06,
-    // dup
-    // ..., value
-    // ..., value, value
-    dup = 0x07, dup2 = 0x08,
-    
-    // loadc index(2)
-    // ...
-    // ..., value
-    loadc = 0x09,
-    
-    // loada level_diff(2), offser(4)
-    // ...
-    // ..., addr
-    loada = 0x0a,
-
-    // new
-    // ..., count
-    // ..., addr
-    _new = 0x0b,
-    // snew count(4)
-    // ...
-    // ..., value
-    snew = 0x0c,
-    
-    // Tload
-    // ..., addr
-    // ..., value
-    iload = 0x10,   dload = 0x11,   aload = 0x12,
-    // Taload
-    // ..., array, index
-    // ..., value
-    iaload = 0x18,  daload = 0x19,  aaload = 0x1a,
-    // Tstore
-    // ..., addr, value
-    // ...
-    istore = 0x20,  dstore = 0x21,  astore = 0x22,
-    // Tastore
-    // ..., array, index, value
-    // ...
-    iastore = 0x28, dastore = 0x29, aastore = 0x2a,
-    
-    // Tadd
-    // ..., lhs, rhs
-    // ..., result
-    iadd = 0x30, dadd = 0x31,
-    // Tsub
-    // ..., lhs, rhs
-    // ..., result
-    isub = 0x34, dsub = 0x35,
-    // Tmul
-    // ..., lhs, rhs
-    // ..., result
-    imul = 0x38, dmul = 0x39,
-    // Tdiv
-    // ..., lhs, rhs
-    // ..., result
-    idiv = 0x3c, ddiv = 0x3d,
-    // Tneg
-    // ..., value
-    // ..., result
-    ineg = 0x40, dneg = 0x41,
-    // Tcmp
-    // ..., lhs, rhs
-    // ..., result
-    icmp = 0x44, dcmp = 0x45,
-
-    // T2T
-    // ..., value
-    // ..., result
-    i2d = 0x60, d2i = 0x61, i2c = 0x62,
-
-    // jmp offset(2)
-    jmp = 0x70,
-    
-    // jCOND offset(2)
-    // ..., value
-    // ...
-    je = 0x71, jne = 0x72, jl = 0x73, jge = 0x74, jg = 0x75, jle = 0x76,
-
-    // call index(2)
-    // ..., params
-    // ...
-    call = 0x80,
-    
-    // ret
-    ret = 0x88,
-    // Tret
-    iret = 0x89, dret = 0x8a, aret = 0x8b,
-    
-    // Tprint
-    // ..., value
-    // ...
-    iprint = 0xa0, dprint = 0xa1, cprint = 0xa2, sprint = 0xa3,
-    
-    // printl
-    printl = 0xaf,
-    
-    // Tscan
-    // ...
-    // ..., value
-    iscan = 0xb0, dscan = 0xb1, cscan = 0xb2,
+// flags of OpCodeInfo
+enum OpCodeFlag : u1 {
+    OPF_JUMP        = 0x01, // x is an instruction index in the current function
+    OPF_CONDITIONAL = 0x02, // falls through when the condition does not hold
+    OPF_CALL        = 0x04, // x is a function index (call) or a native index (callnative)
+    OPF_RETURN      = 0x08,
+    OPF_CONSTANT    = 0x10, // x is a constant index
+    OPF_VARIADIC    = 0x20, // the stack effect depends on the operand, the constant or the callee
+    OPF_SIGNED      = 0x40, // x is a signed value, for the variable length operands of .o0 v2
 };
 
-#define NAME(op) { OpCode::op, #op }
-const std::unordered_map<OpCode, const char*> nameOfOpCode = {
-    NAME(nop),
-
-    NAME(bipush), NAME(ipush),
-    NAME(pop),    NAME(pop2), NAME(popn),
-    NAME(dup),    NAME(dup2),
-    NAME(loadc),  NAME(loada),
-    {OpCode::_new, "new"},
-    NAME(snew),
-        
-    NAME(iload),   NAME(dload),   NAME(aload),
-    NAME(iaload),  NAME(daload),  NAME(aaload),
-    NAME(istore),  NAME(dstore),  NAME(astore),
-    NAME(iastore), NAME(dastore), NAME(aastore),
-        
-    NAME(iadd), NAME(dadd),
-    NAME(isub), NAME(dsub),
-    NAME(imul), NAME(dmul),
-    NAME(idiv), NAME(ddiv),
-    NAME(ineg), NAME(dneg),
-    NAME(icmp), NAME(dcmp),
-        
-    NAME(i2d), NAME(d2i), NAME(i2c),
-        
-    NAME(jmp),
-    NAME(je), NAME(jne), NAME(jl), NAME(jge), NAME(jg), NAME(jle),
-
-    NAME(call),
-    NAME(ret),
-    NAME(iret), NAME(dret), NAME(aret),
-
-    NAME(iprint), NAME(dprint), NAME(cprint), NAME(sprint),
-    NAME(printl),
-    NAME(iscan),  NAME(dscan),  NAME(cscan),
+// The one list of opcodes, everything else in this file is generated from it.
+// X(op, code, name, x, y, pops, pushes, flags, exec)
+//   x, y          operand widths in bytes in .o0 v1, 0 if there is no such operand
+//   pops, pushes  stack effect in slots, for OPF_VARIADIC the fixed part
+//   exec          what VM::executeInstruction does for the instruction ins,
+//                 in parentheses so that template arguments may hold commas
+#define CC0_OPCODE_LIST(X) \
+    /* do nothing */ \
+    X(nop,        0x00, "nop",        0, 0, 0, 0, 0,                           ((void) 0)) \
+    \
+    /* bipush value(1) / ipush value(4) */ \
+    /* ... */ \
+    /* ..., value */ \
+    X(bipush,     0x01, "bipush",     1, 0, 0, 1, 0,                           (ipush(ins.x))) \
+    X(ipush,      0x02, "ipush",      4, 0, 0, 1, OPF_SIGNED,                  (ipush(ins.x))) \
+    \
+    /* pop / pop2 / popn count(4) */ \
+    /* ..., value(n) */ \
+    /* ... */ \
+    X(pop,        0x04, "pop",        0, 0, 1, 0, 0,                           (popn(1))) \
+    X(pop2,       0x05, "pop2",       0, 0, 2, 0, 0,                           (popn(2))) \
+    X(popn,       0x06, "popn",       4, 0, 0, 0, OPF_VARIADIC,                (popn(ins.x))) \
+    /* dup / dup2 */ \
+    /* ..., value */ \
+    /* ..., value, value */ \
+    X(dup,        0x07, "dup",        0, 0, 1, 2, 0,                           (dup())) \
+    X(dup2,       0x08, "dup2",       0, 0, 2, 4, 0,                           (dup2())) \
+    \
+    /* loadc index(2) */ \
+    /* ... */ \
+    /* ..., value */ \
+    X(loadc,      0x09, "loadc",      2, 0, 0, 0, OPF_CONSTANT | OPF_VARIADIC, (loadc(ins.x))) \
+    \
+    /* loada level_diff(2), offset(4) */ \
+    /* ... */ \
+    /* ..., addr */ \
+    X(loada,      0x0a, "loada",      2, 4, 0, 1, 0,                           (loada(ins.x, ins.y))) \
+    \
+    /* new */ \
+    /* ..., count */ \
+    /* ..., addr */ \
+    X(_new,       0x0b, "new",        0, 0, 1, 1, 0,                           (_new())) \
+    /* snew count(4) */ \
+    /* ... */ \
+    /* ..., value(n) */ \
+    X(snew,       0x0c, "snew",       4, 0, 0, 0, OPF_VARIADIC,                (snew(ins.x))) \
+    \
+    /* Tload */ \
+    /* ..., addr */ \
+    /* ..., value */ \
+    X(iload,      0x10, "iload",      0, 0, 1, 1, 0,                           (Tload<int_t>())) \
+    X(dload,      0x11, "dload",      0, 0, 1, 2, 0,                           (Tload<double_t>())) \
+    X(aload,      0x12, "aload",      0, 0, 1, 1, 0,                           (Tload<addr_t>())) \
+    /* Taload */ \
+    /* ..., array, index */ \
+    /* ..., value */ \
+    X(iaload,     0x18, "iaload",     0, 0, 2, 1, 0,                           (Taload<int_t>())) \
+    X(daload,     0x19, "daload",     0, 0, 2, 2, 0,                           (Taload<double_t>())) \
+    X(aaload,     0x1a, "aaload",     0, 0, 2, 1, 0,                           (Taload<addr_t>())) \
+    /* Tstore */ \
+    /* ..., addr, value */ \
+    /* ... */ \
+    X(istore,     0x20, "istore",     0, 0, 2, 0, 0,                           (Tstore<int_t>())) \
+    X(dstore,     0x21, "dstore",     0, 0, 3, 0, 0,                           (Tstore<double_t>())) \
+    X(astore,     0x22, "astore",     0, 0, 2, 0, 0,                           (Tstore<addr_t>())) \
+    /* Tastore */ \
+    /* ..., array, index, value */ \
+    /* ... */ \
+    X(iastore,    0x28, "iastore",    0, 0, 3, 0, 0,                           (Tastore<int_t>())) \
+    X(dastore,    0x29, "dastore",    0, 0, 4, 0, 0,                           (Tastore<double_t>())) \
+    X(aastore,    0x2a, "aastore",    0, 0, 3, 0, 0,                           (Tastore<addr_t>())) \
+    \
+    /* Tadd, Tsub, Tmul, Tdiv */ \
+    /* ..., lhs, rhs */ \
+    /* ..., result */ \
+    X(iadd,       0x30, "iadd",       0, 0, 2, 1, 0,                           (Tadd<int_t>())) \
+    X(dadd,       0x31, "dadd",       0, 0, 4, 2, 0,                           (Tadd<double_t>())) \
+    X(isub,       0x34, "isub",       0, 0, 2, 1, 0,                           (Tsub<int_t>())) \
+    X(dsub,       0x35, "dsub",       0, 0, 4, 2, 0,                           (Tsub<double_t>())) \
+    X(imul,       0x38, "imul",       0, 0, 2, 1, 0,                           (Tmul<int_t>())) \
+    X(dmul,       0x39, "dmul",       0, 0, 4, 2, 0,                           (Tmul<double_t>())) \
+    X(idiv,       0x3c, "idiv",       0, 0, 2, 1, 0,                           (Tdiv<int_t>())) \
+    X(ddiv,       0x3d, "ddiv",       0, 0, 4, 2, 0,                           (Tdiv<double_t>())) \
+    /* Tneg */ \
+    /* ..., value */ \
+    /* ..., result */ \
+    X(ineg,       0x40, "ineg",       0, 0, 1, 1, 0,                           (Tneg<int_t>())) \
+    X(dneg,       0x41, "dneg",       0, 0, 2, 2, 0,                           (Tneg<double_t>())) \
+    /* Tcmp */ \
+    /* ..., lhs, rhs */ \
+    /* ..., result */ \
+    X(icmp,       0x44, "icmp",       0, 0, 2, 1, 0,                           (Tcmp<int_t>())) \
+    X(dcmp,       0x45, "dcmp",       0, 0, 4, 1, 0,                           (Tcmp<double_t>())) \
+    \
+    /* T2T */ \
+    /* ..., value */ \
+    /* ..., result */ \
+    X(i2d,        0x60, "i2d",        0, 0, 1, 2, 0,                           (T2T<int_t, double_t>())) \
+    X(d2i,        0x61, "d2i",        0, 0, 2, 1, 0,                           (T2T<double_t, int_t>())) \
+    X(i2c,        0x62, "i2c",        0, 0, 1, 1, 0,                           (T2T<int_t, char_t>())) \
+    \
+    /* jmp offset(2) */ \
+    X(jmp,        0x70, "jmp",        2, 0, 0, 0, OPF_JUMP,                    (jmp(ins.x))) \
+    /* jCOND offset(2) */ \
+    /* ..., value */ \
+    /* ... */ \
+    X(je,         0x71, "je",         2, 0, 1, 0, OPF_JUMP | OPF_CONDITIONAL,  (je(ins.x))) \
+    X(jne,        0x72, "jne",        2, 0, 1, 0, OPF_JUMP | OPF_CONDITIONAL,  (jne(ins.x))) \
+    X(jl,         0x73, "jl",         2, 0, 1, 0, OPF_JUMP | OPF_CONDITIONAL,  (jl(ins.x))) \
+    X(jge,        0x74, "jge",        2, 0, 1, 0, OPF_JUMP | OPF_CONDITIONAL,  (jge(ins.x))) \
+    X(jg,         0x75, "jg",         2, 0, 1, 0, OPF_JUMP | OPF_CONDITIONAL,  (jg(ins.x))) \
+    X(jle,        0x76, "jle",        2, 0, 1, 0, OPF_JUMP | OPF_CONDITIONAL,  (jle(ins.x))) \
+    \
+    /* call index(2) */ \
+    /* ..., params */ \
+    /* ... */ \
+    X(call,       0x80, "call",       2, 0, 0, 0, OPF_CALL | OPF_VARIADIC,     (call(ins.x))) \
+    /* callnative index(2) */ \
+    /* ..., params */ \
+    /* ..., result */ \
+    X(callnative, 0x81, "callnative", 2, 0, 0, 0, OPF_CALL | OPF_VARIADIC,     (callnative(ins.x))) \
+    \
+    /* ret / Tret */ \
+    X(ret,        0x88, "ret",        0, 0, 0, 0, OPF_RETURN,                  (Tret<void>())) \
+    X(iret,       0x89, "iret",       0, 0, 1, 0, OPF_RETURN,                  (Tret<int_t>())) \
+    X(dret,       0x8a, "dret",       0, 0, 2, 0, OPF_RETURN,                  (Tret<double_t>())) \
+    X(aret,       0x8b, "aret",       0, 0, 1, 0, OPF_RETURN,                  (Tret<addr_t>())) \
+    \
+    /* Tprint */ \
+    /* ..., value */ \
+    /* ... */ \
+    X(iprint,     0xa0, "iprint",     0, 0, 1, 0, 0,                           (Tprint<int_t>())) \
+    X(dprint,     0xa1, "dprint",     0, 0, 2, 0, 0,                           (Tprint<double_t>())) \
+    X(cprint,     0xa2, "cprint",     0, 0, 1, 0, 0,                           (Tprint<char_t>())) \
+    X(sprint,     0xa3, "sprint",     0, 0, 1, 0, 0,                           (sprint())) \
+    /* printl */ \
+    X(printl,     0xaf, "printl",     0, 0, 0, 0, 0,                           (printl())) \
+    \
+    /* Tscan */ \
+    /* ... */ \
+    /* ..., value */ \
+    X(iscan,      0xb0, "iscan",      0, 0, 0, 1, 0,                           (Tscan<int_t>())) \
+    X(dscan,      0xb1, "dscan",      0, 0, 0, 2, 0,                           (Tscan<double_t>())) \
+    X(cscan,      0xb2, "cscan",      0, 0, 0, 1, 0,                           (Tscan<char_t>()))
+
+enum class OpCode : u1 {
+#define X(op, code, ...) op = code,
+    CC0_OPCODE_LIST(X)
+#undef X
 };
-#undef NAME
-
-const std::unordered_map<OpCode, std::vector<int>> paramSizeOfOpCode = {
-    { OpCode::bipush, {1} },    { OpCode::ipush, {4} },    
-    { OpCode::popn, {4} },
-    { OpCode::loadc, {2} },    { OpCode::loada, {2, 4} },
-    { OpCode::snew, {4} },
-    
-    { OpCode::jmp, {2} },
-    { OpCode::je, {2} }, { OpCode::jne, {2} }, { OpCode::jl, {2} }, { OpCode::jge, {2} }, { OpCode::jg, {2} }, { OpCode::jle, {2} },
-
-    { OpCode::call, {2} },
+
+struct OpCodeInfo {
+    // nullptr for the unassigned codes
+    const char* name;
+    u1 paramCount;
+    u1 paramSizes[2];
+    u1 pops;
+    u1 pushes;
+    u1 flags;
+
+    constexpr bool valid() const noexcept { return name != nullptr; }
+    constexpr bool has(OpCodeFlag flag) const noexcept { return (flags & flag) != 0; }
 };
 
-#define NAME(op) { #op, OpCode::op }
-const std::unordered_map<std::string, OpCode> opCodeOfName = {
-    NAME(nop),
-
-    NAME(bipush), NAME(ipush),
-    NAME(pop),    NAME(pop2), NAME(popn),
-    NAME(dup),    NAME(dup2),
-    NAME(loadc),  NAME(loada),
-    {"new", OpCode::_new},
-    NAME(snew),
-        
-    NAME(iload),   NAME(dload),   NAME(aload),
-    NAME(iaload),  NAME(daload),  NAME(aaload),
-    NAME(istore),  NAME(dstore),  NAME(astore),
-    NAME(iastore), NAME(dastore), NAME(aastore),
-        
-    NAME(iadd), NAME(dadd),
-    NAME(isub), NAME(dsub),
-    NAME(imul), NAME(dmul),
-    NAME(idiv), NAME(ddiv),
-    NAME(ineg), NAME(dneg),
-    NAME(icmp), NAME(dcmp),
-        
-    NAME(i2d), NAME(d2i), NAME(i2c),
-        
-    NAME(jmp),
-    NAME(je), NAME(jne), NAME(jl), NAME(jge), NAME(jg), NAME(jle),
-
-    NAME(call),
-    NAME(ret),
-    NAME(iret), NAME(dret), NAME(aret),
-
-    NAME(iprint), NAME(dprint), NAME(cprint), NAME(sprint),
-    NAME(printl),
-    NAME(iscan),  NAME(dscan),  NAME(cscan),
+constexpr std::array<OpCodeInfo, 256> makeOpCodeTable() {
+    std::array<OpCodeInfo, 256> table{};
+#define X(op, code, str, x, y, pop, push, fl, exec)                                            \
+    if (table[code].name != nullptr) {                                                         \
+        throw "duplicated opcode";                                                             \
+    }                                                                                          \
+    table[code] = OpCodeInfo{ str, (x != 0) + (y != 0), { x, y }, pop, push, fl };
+    CC0_OPCODE_LIST(X)
+#undef X
+    return table;
+}
+
+// indexed by the opcode byte
+inline constexpr std::array<OpCodeInfo, 256> opCodeTable = makeOpCodeTable();
+
+constexpr const OpCodeInfo& infoOf(OpCode op) noexcept {
+    return opCodeTable[static_cast<u1>(op)];
+}
+
+struct OpCodeName {
+    std::string_view name;
+    OpCode op;
 };
-#undef NAME
+
+inline constexpr std::size_t opCodeCount = 0
+#define X(...) + 1
+    CC0_OPCODE_LIST(X)
+#undef X
+;
+
+constexpr std::uint32_t opCodeNameHash(std::string_view name) noexcept {
+    // FNV-1a
+    std::uint32_t h = 2166136261u;
+    for (char ch : name) {
+        h = (h ^ static_cast<unsigned char>(ch)) * 16777619u;
+    }
+    return h;
+}
+
+// open addressing on opCodeNameHash, an empty name is a free slot
+inline constexpr std::size_t opCodeNameSlots = 256;
+static_assert(opCodeCount * 2 <= opCodeNameSlots);
+
+constexpr std::array<OpCodeName, opCodeNameSlots> makeOpCodeNames() {
+    std::array<OpCodeName, opCodeNameSlots> names{};
+#define X(op, code, str, ...)                                                                  \
+    for (auto i = opCodeNameHash(str) % opCodeNameSlots; ; i = (i + 1) % opCodeNameSlots) {    \
+        if (names[i].name.empty()) {                                                           \
+            names[i] = OpCodeName{ str, OpCode::op };                                          \
+            break;                                                                             \
+        }                                                                                      \
+    }
+    CC0_OPCODE_LIST(X)
+#undef X
+    return names;
+}
+
+inline constexpr std::array<OpCodeName, opCodeNameSlots> opCodeNames = makeOpCodeNames();
+
+// false if there is no such opcode, the name is lower case
+inline bool opCodeOfName(std::string_view name, OpCode& op) noexcept {
+    for (auto i = opCodeNameHash(name) % opCodeNameSlots; !opCodeNames[i].name.empty(); i = (i + 1) % opCodeNameSlots) {
+        if (opCodeNames[i].name == name) {
+            op = opCodeNames[i].op;
+            return true;
+        }
+    }
+    return false;
+}
 
 }
 
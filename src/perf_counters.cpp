@@ -0,0 +1,206 @@
+#include "./perf_counters.h"
+#include "./util/print.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace vm {
+
+static const char* const eventNames[PerfCounters::EVENT_COUNT] = {
+    "cycles", "instructions", "branch-misses", "L1d-misses",
+};
+
+PerfCounters::PerfCounters(bool perFunction) noexcept
+    : _perFunction(perFunction), _available(false), _leader(-1), _current(-1) {
+    _fds.fill(-1);
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (auto fd : _fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::open(std::string& error) {
+#ifdef __linux__
+    const std::array<std::pair<u4, u8>, EVENT_COUNT> configs = {{
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    }};
+    int lastErrno = 0;
+    for (int i = 0; i < EVENT_COUNT; ++i) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = configs[i].first;
+        attr.config = configs[i].second;
+        // the first counter opened leads the group, the others start and
+        // stop with it and one read of the leader returns all of them
+        attr.disabled = _leader < 0;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // every counter is opened on its own so that a missing one (L1d in
+        // most VMs) does not take the others down with it
+        _fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, _leader, 0));
+        if (_fds[i] < 0) {
+            lastErrno = errno;
+        }
+        else {
+            _available = true;
+            if (_leader < 0) {
+                _leader = _fds[i];
+            }
+        }
+    }
+    if (!_available) {
+        error = strfmt("perf_event_open failed: {}", std::strerror(lastErrno));
+    }
+    return _available;
+#else
+    error = "hardware performance counters are only supported on Linux";
+    return false;
+#endif
+}
+
+bool PerfCounters::read(Values& values) const {
+    values.fill(0);
+#ifdef __linux__
+    // the number of counters, then their values in the order they were opened
+    std::array<u8, 1 + EVENT_COUNT> group;
+    auto size = ::read(_leader, group.data(), sizeof group);
+    if (size < static_cast<ssize_t>(sizeof(u8)) || group[0] > EVENT_COUNT
+        || static_cast<size_t>(size) < (1 + group[0]) * sizeof(u8)) {
+        return false;
+    }
+    size_t next = 1;
+    for (int i = 0; i < EVENT_COUNT && next <= group[0]; ++i) {
+        if (_fds[i] >= 0) {
+            values[i] = group[next++];
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+PerfCounters::Record& PerfCounters::recordOf(int functionIndex) {
+    // slot 0 is .start
+    size_t i = static_cast<size_t>(functionIndex + 1);
+    if (i >= _records.size()) {
+        _records.resize(i + 1);
+    }
+    return _records[i];
+}
+
+void PerfCounters::start(std::vector<std::string> functionNames) {
+    _names = std::move(functionNames);
+    _records.assign(_names.size() + 1, Record{});
+    _current = -1;
+    _total.fill(0);
+    if (!_available) {
+        return;
+    }
+#ifdef __linux__
+    ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    read(_last);
+    ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    recordOf(-1).calls = 1;
+}
+
+void PerfCounters::switchTo(int functionIndex, bool isCall) {
+    if (!_available || !_perFunction) {
+        return;
+    }
+    Values now;
+    if (read(now)) {
+        auto& record = recordOf(_current);
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+            record.values[i] += now[i] - _last[i];
+        }
+        _last = now;
+    }
+    _current = functionIndex;
+    if (isCall) {
+        ++recordOf(functionIndex).calls;
+    }
+}
+
+void PerfCounters::stop() {
+    if (!_available) {
+        return;
+    }
+#ifdef __linux__
+    ioctl(_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    Values now;
+    if (read(now)) {
+        auto& record = recordOf(_perFunction ? _current : -1);
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+            record.values[i] += now[i] - _last[i];
+        }
+        _last = now;
+        _total = now;
+    }
+}
+
+void PerfCounters::report(std::ostream& out) const {
+    if (!_available) {
+        return;
+    }
+    const auto printRow = [&](const std::string& name, const std::string& calls, const Values& values) {
+        out << std::left << std::setw(24) << name << std::right << std::setw(10) << calls;
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+            out << std::setw(16);
+            if (_fds[i] < 0) {
+                out << "n/a";
+            }
+            else {
+                out << values[i];
+            }
+        }
+        if (_fds[CYCLES] >= 0 && _fds[INSTRUCTIONS] >= 0 && values[CYCLES] != 0) {
+            out << std::setw(8) << std::fixed << std::setprecision(2)
+                << static_cast<double>(values[INSTRUCTIONS]) / values[CYCLES];
+        }
+        out << '\n';
+    };
+    println(out, "performance counters:");
+    out << std::left << std::setw(24) << "function" << std::right << std::setw(10) << "calls";
+    for (auto name : eventNames) {
+        out << std::setw(16) << name;
+    }
+    out << std::setw(8) << "IPC" << '\n';
+    if (_perFunction) {
+        for (size_t i = 0; i < _records.size(); ++i) {
+            auto& record = _records[i];
+            if (record.calls == 0) {
+                continue;
+            }
+            std::string name = i == 0 ? ".start" : (i - 1 < _names.size() ? _names[i - 1] : "?");
+            printRow(name, std::to_string(record.calls), record.values);
+        }
+    }
+    printRow("total", "", _total);
+    out.flush();
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef PERF_COUNTERS_H_INCLUDED
+#define PERF_COUNTERS_H_INCLUDED
+
+#include "./type.h"
+
+#include <array>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+// Hardware performance counters (Linux perf_event_open) around VM::run.
+// With perFunction the counters are read at every call/ret and the deltas
+// are attributed to the C0 function on top of the call stack (self cost).
+// The counters form one group, so each call/ret costs a single read(2) of
+// all of them. The system call is counted too: for programs made of many
+// small calls it dominates the per-function numbers, use the totals of a
+// run without perFunction to judge those.
+// If the counters cannot be opened (no kernel support, containers,
+// perf_event_paranoid, ...) the VM runs without them.
+class PerfCounters {
+public:
+    enum Event { CYCLES = 0, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, EVENT_COUNT };
+    using Values = std::array<u8, EVENT_COUNT>;
+
+    explicit PerfCounters(bool perFunction) noexcept;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters();
+
+    // false and the reason in error if no counter is available
+    bool open(std::string& error);
+    bool available() const noexcept { return _available; }
+    bool perFunction() const noexcept { return _perFunction; }
+
+    // functionIndex -1 is .start
+    void start(std::vector<std::string> functionNames);
+    void switchTo(int functionIndex, bool isCall);
+    void stop();
+
+    void report(std::ostream& out) const;
+
+private:
+    struct Record {
+        Values values{};
+        u8 calls = 0;
+    };
+    bool read(Values& values) const;
+    Record& recordOf(int functionIndex);
+
+    bool _perFunction;
+    bool _available;
+    std::array<int, EVENT_COUNT> _fds;
+    // the fd of the group, one of _fds
+    int _leader;
+    Values _last{};
+    Values _total{};
+    int _current;
+    std::vector<std::string> _names;
+    std::vector<Record> _records;
+};
+
+}
+
+#endif
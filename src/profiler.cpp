@@ -0,0 +1,80 @@
+#include "./profiler.h"
+#include "./util/print.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/time.h>
+#define CC0_HAS_ITIMER 1
+#endif
+
+namespace vm {
+
+volatile std::sig_atomic_t SampleProfiler::_ticked = 0;
+
+SampleProfiler::SampleProfiler(u4 interval) noexcept
+    : _interval(interval == 0 ? 1 : interval), _timer(false), _total(0) {
+    //
+}
+
+SampleProfiler::~SampleProfiler() {
+    stopTimer();
+}
+
+void SampleProfiler::onTick(int) {
+    _ticked = 1;
+}
+
+bool SampleProfiler::startTimer(u4 hz) {
+#ifdef CC0_HAS_ITIMER
+    if (hz == 0) {
+        return false;
+    }
+    struct sigaction sa {};
+    sa.sa_handler = &SampleProfiler::onTick;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGPROF, &sa, nullptr) != 0) {
+        return false;
+    }
+    struct itimerval tv {};
+    tv.it_interval.tv_sec = 0;
+    tv.it_interval.tv_usec = hz >= 1000000 ? 1 : 1000000 / hz;
+    tv.it_value = tv.it_interval;
+    if (setitimer(ITIMER_PROF, &tv, nullptr) != 0) {
+        return false;
+    }
+    _ticked = 0;
+    _timer = true;
+    return true;
+#else
+    (void)hz;
+    return false;
+#endif
+}
+
+void SampleProfiler::stopTimer() {
+#ifdef CC0_HAS_ITIMER
+    if (!_timer) {
+        return;
+    }
+    struct itimerval tv {};
+    setitimer(ITIMER_PROF, &tv, nullptr);
+    signal(SIGPROF, SIG_DFL);
+    _timer = false;
+#endif
+}
+
+void SampleProfiler::record(const std::string& stack) {
+    ++_stacks[stack];
+    ++_total;
+    _ticked = 0;
+}
+
+void SampleProfiler::output_folded(std::ostream& out) const {
+    for (auto& [stack, count] : _stacks) {
+        print(out, stack, count);
+        out << '\n';
+    }
+    out.flush();
+}
+
+}
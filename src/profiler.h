@@ -0,0 +1,51 @@
+#ifndef PROFILER_H_INCLUDED
+#define PROFILER_H_INCLUDED
+
+#include "./type.h"
+
+#include <csignal>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace vm {
+
+// Samples the call chain of the VM and aggregates the samples into
+// the folded-stack format consumed by flamegraph.pl:
+//     __START__;main;fib;fib+12 42
+// A sample is taken every `interval` executed instructions, or, when
+// the timer is enabled, whenever SIGPROF fires (ITIMER_PROF).
+class SampleProfiler {
+public:
+    explicit SampleProfiler(u4 interval) noexcept;
+    SampleProfiler(const SampleProfiler&) = delete;
+    SampleProfiler& operator=(const SampleProfiler&) = delete;
+    ~SampleProfiler();
+
+    // use ITIMER_PROF with the given frequency instead of the instruction interval
+    bool startTimer(u4 hz);
+    void stopTimer();
+
+    bool due(u8 counter) const noexcept {
+        if (_timer) {
+            return _ticked != 0;
+        }
+        return counter % _interval == 0;
+    }
+    void record(const std::string& stack);
+    u8 samples() const noexcept { return _total; }
+    void output_folded(std::ostream& out) const;
+
+private:
+    static volatile std::sig_atomic_t _ticked;
+    static void onTick(int);
+
+    u4 _interval;
+    bool _timer;
+    u8 _total;
+    std::map<std::string, u8> _stacks;
+};
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SYMBOL_TABLE_H_INCLUDED
+#define SYMBOL_TABLE_H_INCLUDED
+
+#include "./type.h"
+#include "./util/print.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+// What an object file, a separately compiled C0 file, leaves to File::link.
+// Every function with a body is exported under its name, the functions only
+// declared are in the function table with an empty body.
+struct SymbolTable {
+    struct Global {
+        std::string name;
+        // 'I', 'C' or 'D'
+        char type;
+        // in slots from the first global of the file, unused for imports
+        u4 offset;
+    };
+    // the loada of an imported global, its offset is filled in by the linker
+    struct GlobalUse {
+        u4 global;
+        // 0 is .start and i+1 the function i
+        u4 function;
+        u4 instruction;
+    };
+
+    // the slots .start leaves on the stack for the globals
+    u4 globalsSize = 0;
+    // the indexes of the functions defined in another file
+    std::vector<u4> functionImports;
+    std::vector<Global> exports;
+    // the globals declared extern
+    std::vector<Global> imports;
+    std::vector<GlobalUse> uses;
+
+    static bool valid_type(char type) noexcept {
+        return type == 'I' || type == 'C' || type == 'D';
+    }
+
+    // the .symbols section of the text format that -s --object writes
+    void output_text(std::ostream& out) const {
+        println(out, ".symbols:");
+        println(out, "globals", globalsSize);
+        for (auto fun : functionImports) {
+            println(out, "function", fun);
+        }
+        for (auto& g : exports) {
+            println(out, "export", g.name, g.type, g.offset);
+        }
+        for (auto& g : imports) {
+            println(out, "import", g.name, g.type);
+        }
+        // {import} {function} {instruction}, function -1 is .start
+        for (auto& use : uses) {
+            println(out, "use", use.global, static_cast<int>(use.function) - 1, use.instruction);
+        }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "./time_report.h"
+#include "./util/print.hpp"
+
+#include <ctime>
+#include <iomanip>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define CC0_HAS_RUSAGE 1
+#endif
+
+namespace vm {
+
+TimeReport::TimeReport() : _begin(sample()), _last(_begin) {
+    //
+}
+
+TimeReport::Sample TimeReport::sample() {
+    Sample s;
+    s.wall = std::chrono::steady_clock::now();
+#ifdef CC0_HAS_RUSAGE
+    struct rusage ru {};
+    getrusage(RUSAGE_SELF, &ru);
+    s.cpu = static_cast<u8>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+        + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#ifdef __APPLE__
+    s.maxRss = static_cast<u8>(ru.ru_maxrss) / 1024;
+#else
+    s.maxRss = static_cast<u8>(ru.ru_maxrss);
+#endif
+#else
+    s.cpu = static_cast<u8>(std::clock()) * 1000000 / CLOCKS_PER_SEC;
+    s.maxRss = 0;
+#endif
+    return s;
+}
+
+void TimeReport::charge() {
+    auto now = sample();
+    if (!_stack.empty()) {
+        auto& stage = _stages[_stack.back()];
+        stage.wall += now.wall - _last.wall;
+        stage.cpu += now.cpu - _last.cpu;
+        stage.rss += now.maxRss - _last.maxRss;
+    }
+    _last = now;
+}
+
+void TimeReport::push(const char* stage) {
+    charge();
+    size_t i = 0;
+    while (i < _stages.size() && _stages[i].name != stage) {
+        ++i;
+    }
+    if (i == _stages.size()) {
+        _stages.emplace_back();
+        _stages.back().name = stage;
+    }
+    ++_stages[i].entries;
+    _stack.push_back(i);
+}
+
+void TimeReport::pop() {
+    charge();
+    _stack.pop_back();
+}
+
+void TimeReport::count(const char* name, u8 value) {
+    for (auto& [n, v] : _counts) {
+        if (n == name) {
+            v += value;
+            return;
+        }
+    }
+    _counts.emplace_back(name, value);
+}
+
+static double milliseconds(std::chrono::nanoseconds ns) {
+    return std::chrono::duration<double, std::milli>(ns).count();
+}
+
+void TimeReport::report(std::ostream& out) const {
+    auto now = sample();
+    auto flags = out.flags();
+    auto precision = out.precision();
+    const auto printRow = [&](const std::string& name, const std::string& entries, double wall, double cpu, u8 rss) {
+        out << std::left << std::setw(20) << name << std::right << std::setw(10) << entries
+            << std::setw(14) << wall << std::setw(14) << cpu << std::setw(16) << rss << '\n';
+    };
+    println(out, "time report:");
+    out << std::left << std::setw(20) << "stage" << std::right << std::setw(10) << "entries"
+        << std::setw(14) << "wall ms" << std::setw(14) << "cpu ms" << std::setw(16) << "peak RSS +KiB" << '\n';
+    out << std::fixed << std::setprecision(3);
+    auto wall = now.wall - _begin.wall;
+    auto cpu = now.cpu - _begin.cpu;
+    auto rss = now.maxRss - _begin.maxRss;
+    for (auto& stage : _stages) {
+        printRow(stage.name, std::to_string(stage.entries), milliseconds(stage.wall), stage.cpu / 1000.0, stage.rss);
+        wall -= stage.wall;
+        cpu -= stage.cpu;
+        rss -= stage.rss;
+    }
+    // outside of the stages: the startup of cc0, parsing the options, the reports
+    printRow("other", "", milliseconds(wall), cpu / 1000.0, rss);
+    printRow("total", "", milliseconds(now.wall - _begin.wall), (now.cpu - _begin.cpu) / 1000.0, now.maxRss);
+    out.flags(flags);
+    out.precision(precision);
+    for (auto& [name, value] : _counts) {
+        out << std::left << std::setw(20) << name << std::right << std::setw(10) << value << '\n';
+    }
+    out.flags(flags);
+}
+
+void TimeReport::output_json(std::ostream& out) const {
+    auto now = sample();
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"stages\":[";
+    for (size_t i = 0; i < _stages.size(); ++i) {
+        auto& stage = _stages[i];
+        out << (i == 0 ? "" : ",") << "{\"name\":\"" << stage.name << "\",\"entries\":" << stage.entries
+            << ",\"wall_ms\":" << milliseconds(stage.wall) << ",\"cpu_ms\":" << stage.cpu / 1000.0
+            << ",\"peak_rss_delta_kib\":" << stage.rss << "}";
+    }
+    out << "],\"total\":{\"wall_ms\":" << milliseconds(now.wall - _begin.wall)
+        << ",\"cpu_ms\":" << (now.cpu - _begin.cpu) / 1000.0 << ",\"peak_rss_kib\":" << now.maxRss << "}";
+    out << ",\"counts\":{";
+    for (size_t i = 0; i < _counts.size(); ++i) {
+        out << (i == 0 ? "" : ",") << "\"" << _counts[i].first << "\":" << _counts[i].second;
+    }
+    out << "}}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef TIME_REPORT_H_INCLUDED
+#define TIME_REPORT_H_INCLUDED
+
+#include "./type.h"
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vm {
+
+// Wall time, CPU time and growth of the peak RSS of each stage of a run of
+// cc0, for --time-report. Stages nest and only the time spent in a stage
+// itself is charged to it, not the time of the stages entered from it, so
+// the stages add up to the whole run. A stage entered many times, such as
+// the tokenizer refilling the lookahead of the analyser, sums its entries.
+class TimeReport {
+public:
+    // push and pop around a scope, nothing without a report
+    class Scope {
+    public:
+        Scope(TimeReport* report, const char* stage) : _report(report) {
+            if (_report) {
+                _report->push(stage);
+            }
+        }
+        ~Scope() {
+            if (_report) {
+                _report->pop();
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        TimeReport* _report;
+    };
+
+    TimeReport();
+    TimeReport(const TimeReport&) = delete;
+    TimeReport& operator=(const TimeReport&) = delete;
+
+    void push(const char* stage);
+    void pop();
+    // adds to a count of the run, such as the tokens or the instructions
+    void count(const char* name, u8 value);
+
+    // a table to the stream, the times in milliseconds
+    void report(std::ostream& out) const;
+    void output_json(std::ostream& out) const;
+
+private:
+    struct Sample {
+        std::chrono::steady_clock::time_point wall;
+        u8 cpu; // user and system, in microseconds
+        u8 maxRss; // in KiB
+    };
+    struct Stage {
+        std::string name;
+        u8 entries = 0;
+        std::chrono::nanoseconds wall{0};
+        u8 cpu = 0;
+        u8 rss = 0;
+    };
+
+    static Sample sample();
+    // charges the time since the last sample to the stage on top
+    void charge();
+
+    Sample _begin;
+    Sample _last;
+    // in the order they are first entered
+    std::vector<Stage> _stages;
+    std::vector<size_t> _stack;
+    std::vector<std::pair<std::string, u8>> _counts;
+};
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef BYTE_ORDER_H_INCLUDED
+#define BYTE_ORDER_H_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Big-endian loads and stores of 1, 2, 4 and 8 byte values (integers or
+// double) from/to unaligned memory, one memcpy plus a byte swap each.
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BYTE_ORDER_HOST_IS_BIG 1
+#endif
+
+template <typename U>
+inline U byte_swap(U v) {
+    static_assert(std::is_unsigned_v<U>);
+    if constexpr (sizeof(U) == 1) {
+        return v;
+    }
+#if defined(__GNUC__) || defined(__clang__)
+    else if constexpr (sizeof(U) == 2) {
+        return __builtin_bswap16(v);
+    }
+    else if constexpr (sizeof(U) == 4) {
+        return __builtin_bswap32(v);
+    }
+    else {
+        return __builtin_bswap64(v);
+    }
+#else
+    else {
+        U r = 0;
+        for (size_t i = 0; i < sizeof(U); ++i) {
+            r = static_cast<U>((r << 8) | (v & 0xff));
+            v >>= 8;
+        }
+        return r;
+    }
+#endif
+}
+
+template <size_t N> struct uint_of_size;
+template <> struct uint_of_size<1> { using type = std::uint8_t; };
+template <> struct uint_of_size<2> { using type = std::uint16_t; };
+template <> struct uint_of_size<4> { using type = std::uint32_t; };
+template <> struct uint_of_size<8> { using type = std::uint64_t; };
+
+template <typename T>
+inline T load_be(const unsigned char* p) {
+    using U = typename uint_of_size<sizeof(T)>::type;
+    U u;
+    std::memcpy(&u, p, sizeof u);
+#ifndef BYTE_ORDER_HOST_IS_BIG
+    u = byte_swap(u);
+#endif
+    T v;
+    std::memcpy(&v, &u, sizeof v);
+    return v;
+}
+
+template <typename T>
+inline void store_be(unsigned char* p, T v) {
+    using U = typename uint_of_size<sizeof(T)>::type;
+    U u;
+    std::memcpy(&u, &v, sizeof u);
+#ifndef BYTE_ORDER_HOST_IS_BIG
+    u = byte_swap(u);
+#endif
+    std::memcpy(p, &u, sizeof u);
+}
+
+#endif
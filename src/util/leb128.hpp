@@ -0,0 +1,92 @@
+#ifndef LEB128_H_INCLUDED
+#define LEB128_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+// LEB128 of 32-bit values: 7 bits per byte, low bits first, the high bit
+// of a byte is set if another one follows. At most 5 bytes.
+
+inline size_t uleb128_size(std::uint32_t v) {
+    size_t size = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+inline size_t sleb128_size(std::int32_t v) {
+    size_t size = 1;
+    while (v < -0x40 || v >= 0x40) {
+        v >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+// returns the number of bytes written
+inline size_t store_uleb128(unsigned char* p, std::uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = static_cast<unsigned char>(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = static_cast<unsigned char>(v);
+    return n;
+}
+
+inline size_t store_sleb128(unsigned char* p, std::int32_t v) {
+    size_t n = 0;
+    while (v < -0x40 || v >= 0x40) {
+        p[n++] = static_cast<unsigned char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    p[n++] = static_cast<unsigned char>(v & 0x7f);
+    return n;
+}
+
+// false if the value is incomplete before end or does not fit 32 bits,
+// otherwise p is moved past it
+inline bool load_uleb128(const unsigned char*& p, const unsigned char* end, std::uint32_t& v) {
+    std::uint32_t r = 0;
+    for (int shift = 0; p + (shift / 7) < end && shift < 35; shift += 7) {
+        unsigned char byte = p[shift / 7];
+        if (shift == 28 && (byte & 0xf0) != 0) {
+            return false;
+        }
+        r |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            p += shift / 7 + 1;
+            v = r;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool load_sleb128(const unsigned char*& p, const unsigned char* end, std::int32_t& v) {
+    std::uint32_t r = 0;
+    for (int shift = 0; p + (shift / 7) < end && shift < 35; shift += 7) {
+        unsigned char byte = p[shift / 7];
+        if (shift == 28) {
+            // the 4 bits left and the sign extension must agree
+            unsigned char rest = byte & 0x78;
+            if ((byte & 0x80) != 0 || (rest != 0 && rest != 0x78)) {
+                return false;
+            }
+        }
+        r |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            if (shift < 25 && (byte & 0x40) != 0) {
+                r |= ~std::uint32_t(0) << (shift + 7);
+            }
+            p += shift / 7 + 1;
+            v = static_cast<std::int32_t>(r);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SHA256_H_INCLUDED
+#define SHA256_H_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// SHA-256 (FIPS 180-4), fed with update() any number of times.
+class Sha256 {
+public:
+    using Digest = std::array<std::uint8_t, 32>;
+
+    void update(const void* data, size_t size) {
+        auto p = static_cast<const std::uint8_t*>(data);
+        _length += size;
+        if (_buffered != 0) {
+            size_t n = std::min(size, sizeof _buffer - _buffered);
+            std::memcpy(_buffer + _buffered, p, n);
+            _buffered += n;
+            p += n;
+            size -= n;
+            if (_buffered < sizeof _buffer) {
+                return;
+            }
+            compress(_buffer);
+            _buffered = 0;
+        }
+        for (; size >= sizeof _buffer; p += sizeof _buffer, size -= sizeof _buffer) {
+            compress(p);
+        }
+        std::memcpy(_buffer, p, size);
+        _buffered = size;
+    }
+
+    void update(std::string_view s) {
+        update(s.data(), s.size());
+    }
+
+    Digest finish() {
+        std::uint64_t bits = _length * 8;
+        std::uint8_t pad[72] = { 0x80 };
+        size_t padSize = (_buffered < 56 ? 56 : 120) - _buffered;
+        for (int i = 0; i < 8; ++i) {
+            pad[padSize + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+        }
+        update(pad, padSize + 8);
+        Digest digest;
+        for (int i = 0; i < 8; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                digest[4 * i + j] = static_cast<std::uint8_t>(_state[i] >> (24 - 8 * j));
+            }
+        }
+        return digest;
+    }
+
+    static std::string to_hex(const Digest& digest) {
+        static const char digits[] = "0123456789abcdef";
+        std::string s;
+        for (auto byte : digest) {
+            s += digits[byte >> 4];
+            s += digits[byte & 0xf];
+        }
+        return s;
+    }
+
+private:
+    static std::uint32_t rotr(std::uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void compress(const std::uint8_t* block) {
+        static const std::uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+        };
+        std::uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = std::uint32_t(block[4 * i]) << 24 | std::uint32_t(block[4 * i + 1]) << 16
+                 | std::uint32_t(block[4 * i + 2]) << 8 | std::uint32_t(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        auto a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+        auto e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+        for (int i = 0; i < 64; ++i) {
+            auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        _state[0] += a; _state[1] += b; _state[2] += c; _state[3] += d;
+        _state[4] += e; _state[5] += f; _state[6] += g; _state[7] += h;
+    }
+
+    std::uint32_t _state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    std::uint8_t _buffer[64];
+    size_t _buffered = 0;
+    std::uint64_t _length = 0;
+};
+
+#endif
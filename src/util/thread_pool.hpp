@@ -0,0 +1,72 @@
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A fixed number of threads running the submitted tasks in order.
+// The destructor runs the tasks still queued and joins the threads.
+class ThreadPool {
+public:
+    explicit ThreadPool(std::size_t threads) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (std::size_t i = 0; i < threads; ++i) {
+            _threads.emplace_back([this] { work(); });
+        }
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _ready.notify_all();
+        for (auto& t : _threads) {
+            t.join();
+        }
+    }
+
+    std::size_t size() const noexcept { return _threads.size(); }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.push_back(std::move(task));
+        }
+        _ready.notify_one();
+    }
+
+private:
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _ready.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+                if (_tasks.empty()) {
+                    return;
+                }
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> _threads;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    bool _stopping = false;
+};
+
+#endif
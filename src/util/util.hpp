@@ -5,8 +5,12 @@
 #include <iomanip>
 #include <cstdint>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <vector>
 
 inline bool is_hex_digit(unsigned char ch) {
     return ('0' <= ch && ch <= '9')
@@ -91,6 +95,103 @@ inline double try_to_double(std::string s) {
     }
 }
 
+// try_to_int without exceptions or allocations, false where try_to_int throws
+inline bool parse_int(std::string_view s, std::int32_t& v) {
+    while (!s.empty() && isspace(static_cast<unsigned char>(s.front()))) {
+        s.remove_prefix(1);
+    }
+    // the common case, a short decimal number without sign
+    if (!s.empty() && s.size() <= 9) {
+        std::int32_t r = 0;
+        size_t i = 0;
+        for (; i < s.size() && '0' <= s[i] && s[i] <= '9'; ++i) {
+            r = r * 10 + (s[i] - '0');
+        }
+        if (i == s.size()) {
+            v = r;
+            return true;
+        }
+    }
+    const char* ed = s.data() + s.size();
+    if (s.length() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        // "0x" without hex digits is 0, as for std::stoull
+        std::uint64_t u = 0;
+        if (std::from_chars(s.data() + 2, ed, u, 16).ec == std::errc::result_out_of_range) {
+            return false;
+        }
+        v = static_cast<std::int32_t>(u);
+        return true;
+    }
+    // std::stoi takes a leading '+', std::from_chars does not
+    if (!s.empty() && s[0] == '+') {
+        s.remove_prefix(1);
+        if (s.empty() || !('0' <= s[0] && s[0] <= '9')) {
+            return false;
+        }
+    }
+    std::int32_t r;
+    if (std::from_chars(s.data(), ed, r).ec != std::errc()) {
+        return false;
+    }
+    v = r;
+    return true;
+}
+
+// try_to_double without exceptions or allocations, false where try_to_double throws
+inline bool parse_double(std::string_view s, double& v) {
+    const char* ed = s.data() + s.size();
+    if (s.length() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        std::uint64_t u = 0;
+        if (std::from_chars(s.data() + 2, ed, u, 16).ec == std::errc::result_out_of_range) {
+            return false;
+        }
+        std::memcpy(&v, &u, sizeof v);
+        return true;
+    }
+    while (!s.empty() && isspace(static_cast<unsigned char>(s.front()))) {
+        s.remove_prefix(1);
+    }
+    if (!s.empty() && s[0] == '+') {
+        s.remove_prefix(1);
+        if (s.empty() || s[0] == '-' || s[0] == '+') {
+            return false;
+        }
+    }
+    double r;
+    if (std::from_chars(s.data(), ed, r).ec != std::errc()) {
+        return false;
+    }
+    v = r;
+    return true;
+}
+
+// the escape sequence at the front of s, what follows the backslash: \\ \' \" n r t
+// or xHH, is removed from s and its character stored in ch, false if there is none
+inline bool parse_escape(std::string_view& s, char& ch) {
+    if (s.empty()) {
+        return false;
+    }
+    switch (s.front()) {
+    case '\\': ch = '\\'; break;
+    case '\'': ch = '\''; break;
+    case '\"': ch = '\"'; break;
+    case 'n':  ch = '\n'; break;
+    case 'r':  ch = '\r'; break;
+    case 't':  ch = '\t'; break;
+    case 'x':
+        if (s.size() < 3 || !is_hex_digit(s[1]) || !is_hex_digit(s[2])) {
+            return false;
+        }
+        ch = static_cast<char>((hex_digit_to_int(s[1]) << 4) | hex_digit_to_int(s[2]));
+        s.remove_prefix(3);
+        return true;
+    default:
+        return false;
+    }
+    s.remove_prefix(1);
+    return true;
+}
+
 inline std::vector<std::string> split(std::string s, char delimiter) {
     std::vector<std::string> rtv;
     std::string temp = "";
@@ -3,9 +3,12 @@
 #include "./instruction.h"
 #include "./exception.h"
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <cstring>
+#include <string_view>
 
 namespace vm {
 
@@ -17,11 +20,38 @@ const addr_t VM::MIN_HEAP_ADDR  = 0x01000000;
 const addr_t VM::MAX_HEAP_ADDR  = 0x01ffffff;
 const addr_t VM::MAX_HEAP_SIZE  = 0x01000000;
 
-VM::VM(File file) noexcept : _file(std::move(file)){
+VM::VM(File file) noexcept : _file(std::move(file)), _startLines(nullptr), _instructionLimit(0), _constants(nullptr), _constantCount(0), _profiler(nullptr), _perf(nullptr), _timeReport(nullptr),
+    _in(&std::cin), _out(&std::cout), _err(&std::cerr) {
     init();
 }
 
+// operands that refer to instructions, functions, natives or constants must be in range,
+// so that a bad file is rejected before it runs
+static void verifyInstructions(const File& file, const std::vector<Instruction>& instructions) {
+    for (auto& ins : instructions) {
+        const auto& info = infoOf(ins.op);
+        if (!info.valid()) {
+            throw InvalidFile("invalid opcode");
+        }
+        if (info.has(OPF_JUMP) && ins.x >= instructions.size()) {
+            throw InvalidFile(strfmt("jump target {} out of range", ins.x));
+        }
+        if (info.has(OPF_CALL)) {
+            auto count = ins.op == OpCode::callnative ? nativeFunctions().size() : file.functions.size();
+            if (ins.x >= count) {
+                throw InvalidFile(strfmt("{} {} out of range", info.name, ins.x));
+            }
+        }
+        if (info.has(OPF_CONSTANT) && ins.x >= file.constants.size()) {
+            throw InvalidFile(strfmt("constant index {} out of range", ins.x));
+        }
+    }
+}
+
 std::unique_ptr<VM> VM::make_vm(File file) {
+    if (file.is_object()) {
+        throw InvalidFile("an object file, link it with --link first");
+    }
     // found main function
     vm::u4 mainIndex = 0;
     bool mainFound = false;
@@ -44,12 +74,110 @@ std::unique_ptr<VM> VM::make_vm(File file) {
     if (mainIndex == file.functions.size()) {
         throw InvalidFile("main not found");
     }
+    verifyInstructions(file, file.start);
+    // the bodies not decoded yet are verified on their first call
+    for (auto& fun : file.functions) {
+        if (fun.loaded()) {
+            verifyInstructions(file, fun.instructions);
+        }
+    }
     auto vm = std::make_unique<VM>(std::move(file));
-    vm->_stack = std::make_unique<slot_t[]>(MAX_STACK_ADDR-MIN_STACK_ADDR);
-    vm->_heap  = std::make_unique<slot_t[]>(MAX_HEAP_ADDR-MIN_HEAP_ADDR);
+    vm->bindFile();
+    vm->allocate();
     return std::move(vm);
 }
 
+std::unique_ptr<VM> VM::make_vm(std::shared_ptr<const Image> image) {
+    auto& header = image->header();
+    if (header.heapSize > static_cast<u4>(MAX_HEAP_SIZE)) {
+        throw InvalidFile("invalid image: heap out of range");
+    }
+    auto vm = std::make_unique<VM>(File(0, {}, {}, {}));
+    vm->_startCode = Code{ image->code(), header.startSize };
+    vm->_functions.reserve(header.functionCount);
+    for (u4 i = 0; i < header.functionCount; ++i) {
+        auto& fun = image->functions()[i];
+        vm->_functions.push_back(FunctionEntry{
+            Code{ image->code() + fun.codeOffset, fun.codeSize }, fun.paramSize, fun.level, image->name(fun), nullptr
+        });
+    }
+    vm->_image = std::move(image);
+    vm->allocate();
+    return vm;
+}
+
+std::vector<unsigned char> VM::make_image(File file) {
+    file.load_all();
+    auto vm = make_vm(std::move(file));
+    auto& f = vm->_file;
+    for (auto& fun : f.functions) {
+        verifyInstructions(f, fun.instructions);
+    }
+    vm->init();
+    vm->buildConstants();
+
+    ImageSource source;
+    source.start = &f.start;
+    for (size_t i = 0; i < f.functions.size(); ++i) {
+        auto& fun = f.functions[i];
+        source.functions.push_back(ImageSource::Function{ vm->_functions[i].name, &fun.instructions, fun.paramSize, fun.level });
+    }
+    source.constants = vm->_constantStorage;
+    source.heapRecords = vm->_heapRecord;
+    source.heap = vm->_heap.get();
+    source.heapSize = 0;
+    if (!vm->_heapRecord.empty()) {
+        auto& last = vm->_heapRecord.back();
+        source.heapSize = static_cast<u4>(last.first + last.second - MIN_HEAP_ADDR);
+    }
+    return Image::serialize(source);
+}
+
+void VM::bindFile() {
+    _startCode = Code{ _file.start.data(), static_cast<u4>(_file.start.size()) };
+    _startLines = &_file.startLines;
+    _functions.clear();
+    _functions.reserve(_file.functions.size());
+    for (auto& fun : _file.functions) {
+        Code code;
+        if (fun.loaded()) {
+            code = Code{ fun.instructions.data(), static_cast<u4>(fun.instructions.size()) };
+        }
+        auto& name = std::get<str_t>(_file.constants.at(fun.nameIndex).value);
+        _functions.push_back(FunctionEntry{ code, fun.paramSize, fun.level, name, &fun.lines });
+    }
+}
+
+void VM::allocate() {
+    _stack.reset(static_cast<slot_t*>(std::calloc(MAX_STACK_ADDR-MIN_STACK_ADDR, sizeof(slot_t))));
+    _heap.reset(static_cast<slot_t*>(std::calloc(MAX_HEAP_ADDR-MIN_HEAP_ADDR, sizeof(slot_t))));
+    if (!_stack || !_heap) {
+        throw std::bad_alloc();
+    }
+}
+
+void VM::setProfiler(SampleProfiler* profiler) noexcept {
+    _profiler = profiler;
+}
+
+void VM::setPerfCounters(PerfCounters* perf) noexcept {
+    _perf = perf;
+}
+
+void VM::setTimeReport(TimeReport* report) noexcept {
+    _timeReport = report;
+}
+
+void VM::setStreams(std::istream& in, std::ostream& out, std::ostream& err) noexcept {
+    _in = &in;
+    _out = &out;
+    _err = &err;
+}
+
+void VM::setInstructionLimit(u8 limit) noexcept {
+    _instructionLimit = limit;
+}
+
 void VM::init() noexcept {
     prepared = false;
     _sp = 0;
@@ -58,30 +186,61 @@ void VM::init() noexcept {
     _counterInstruction = 0;
     _contexts.clear();
     _heapRecord.clear();
-    _stringLiteralPool.clear();
-}
-
-void VM::buildStringLiteralPool() {
-    u2 i = 0;
-    for (auto it = _file.constants.begin(), ed = _file.constants.end(); it != ed; ++it) {
-        auto& c = *it;
-        if (c.type == vm::Constant::Type::STRING) {
-            str_t str = std::get<str_t>(c.value);
-            addr_t addr = NEW(str.length()+1);
-            _stringLiteralPool[i] = addr;
-            slot_t* dst =  toHeapPtr(addr);
-            for (auto ch : str) {
-                *dst++ = ch & 0xff;
+}
+
+void VM::buildConstants() {
+    if (_image) {
+        // the string literals are laid out in the heap of the image already
+        auto& header = _image->header();
+        std::copy(_image->heap(), _image->heap() + header.heapSize, _heap.get());
+        for (u4 i = 0; i < header.heapRecordCount; ++i) {
+            _heapRecord.emplace_back(_image->heapRecords()[i].addr, _image->heapRecords()[i].size);
+        }
+        _constants = _image->constants();
+        _constantCount = header.constantCount;
+        return;
+    }
+    _constantStorage.clear();
+    // equal strings share one heap block, as older files may repeat them
+    std::unordered_map<std::string_view, addr_t> addrs;
+    for (auto& c : _file.constants) {
+        ConstantSlots slots{ 1, { 0, 0 } };
+        switch (c.type) {
+        case Constant::Type::STRING: {
+            const str_t& str = std::get<str_t>(c.value);
+            auto [found, inserted] = addrs.try_emplace(str, 0);
+            if (inserted) {
+                found->second = NEW(str.length()+1);
+                slot_t* dst =  toHeapPtr(found->second);
+                for (auto ch : str) {
+                    *dst++ = ch & 0xff;
+                }
+                *dst = '\0';
             }
-            *dst = '\0';
+            slots.value[0] = found->second;
+        } break;
+        case Constant::Type::INT:
+            slots.value[0] = std::get<int_t>(c.value);
+            break;
+        case Constant::Type::DOUBLE: {
+            // the slots PUSH<double_t> writes
+            auto d = std::get<double_t>(c.value);
+            slots.count = slots_count<double_t>;
+            std::memcpy(slots.value, &d, sizeof d);
+        } break;
         }
-        ++i;
+        _constantStorage.push_back(slots);
     }
+    _constants = _constantStorage.data();
+    _constantCount = static_cast<u4>(_constantStorage.size());
 }
 
 void VM::start() {
-    init();
-    buildStringLiteralPool();
+    {
+        TimeReport::Scope scope(_timeReport, "vm init");
+        init();
+        buildConstants();
+    }
     Context globalContext;
     globalContext.prevPC = 0;
     globalContext.prevSP = 0;
@@ -91,18 +250,44 @@ void VM::start() {
     globalContext.functionIndex = -1;
     globalContext.functionName = "__START__";
     globalContext.functionLevel = 0;
-    _currentInstructions = _file.start;
+    _code = _startCode;
     _contexts.push_back(globalContext);
     prepared = true;
-    run();
+    if (_perf) {
+        std::vector<std::string> names;
+        for (auto& fun : _functions) {
+            names.emplace_back(fun.name);
+        }
+        _perf->start(std::move(names));
+    }
+    {
+        TimeReport::Scope scope(_timeReport, "execute");
+        run();
+    }
+    if (_perf) {
+        _perf->stop();
+    }
+    if (_timeReport) {
+        _timeReport->count("executed", _counterInstruction);
+        if (!_image) {
+            // the functions of a binary file are decoded on their first call
+            _timeReport->count("decoded functions", std::count_if(_file.functions.begin(), _file.functions.end(),
+                [](const vm::Function& fun) { return fun.loaded(); }));
+        }
+    }
 }
 
 void VM::run() {
     try {
-        while (_ip < _currentInstructions.size()) {
-            executeInstruction(_currentInstructions.at(_ip));
+        while (static_cast<u4>(_ip) < _code.size) {
+            executeInstruction(_code.data[_ip]);
             ++_ip;
-            ++_counterInstruction;
+            if (++_counterInstruction == _instructionLimit) {
+                throw InstructionLimitExceeded();
+            }
+            if (_profiler && _profiler->due(_counterInstruction)) {
+                takeSample();
+            }
         }
         if (_contexts.size() != 1) {
             // no ret at the end of funtion
@@ -110,9 +295,9 @@ void VM::run() {
         }
     }
     catch (const std::exception& e) {
-        println(std::cerr, "runtime error:", e.what(), "!");
-        println(std::cerr, "occurred at:");
-        printStackTrace(std::cerr);
+        println(*_err, "runtime error:", e.what(), "!");
+        println(*_err, "occurred at:");
+        printStackTrace(*_err);
     }
 }
 
@@ -123,11 +308,11 @@ void VM::printStackTrace(std::ostream& out) {
         return;
     }
     auto pc = this->_ip;
-    if (pc >= _currentInstructions.size()) {
+    if (static_cast<u4>(pc) >= _code.size) {
         println(out, "          control reaches the end of function", rit->functionName, "without return");
     }
     else {
-        println(out, "          function", rit->functionName, "at instruction", pc, ":", _currentInstructions.at(pc));
+        println(out, "          function", rit->functionName, "at instruction", pc, ":", strfmt("{}{}", _code.data[pc], sourceLocation(rit->functionIndex, pc)));
     }
     while (true) {
         pc = rit->prevPC;
@@ -136,11 +321,45 @@ void VM::printStackTrace(std::ostream& out) {
             return;
         }
         if (rit->functionIndex == -1) {
-            println(out, "called by .start at instruction", pc, ":", _file.start.at(pc));
+            println(out, "called by .start at instruction", pc, ":", strfmt("{}{}", _startCode.data[pc], sourceLocation(-1, pc)));
             return;
         }
-        println(out, "called by function", rit->functionName, "at instruction", pc, ":", _file.functions.at(rit->functionIndex).instructions.at(pc));
+        auto& code = _functions.at(rit->functionIndex).code;
+        println(out, "called by function", rit->functionName, "at instruction", pc, ":", strfmt("{}{}", code.data[pc], sourceLocation(rit->functionIndex, pc)));
+    }
+}
+
+std::string VM::sourceLocation(int functionIndex, addr_t ip) const {
+    auto lines = functionIndex == -1 ? _startLines : _functions.at(functionIndex).lines;
+    if (lines == nullptr) {
+        return "";
+    }
+    if (auto e = lines->lookup(ip); e != nullptr) {
+        return strfmt(" (line {}, column {})", e->line, e->column);
+    }
+    return "";
+}
+
+void VM::takeSample() {
+    // outermost frame first, the current instruction as the innermost frame
+    std::string stack;
+    for (auto& context : _contexts) {
+        stack += context.functionName;
+        stack += ';';
     }
+    auto& current = _contexts.back();
+    stack += current.functionName;
+    auto lines = current.functionIndex == -1 ? _startLines : _functions.at(current.functionIndex).lines;
+    if (auto e = lines != nullptr ? lines->lookup(_ip) : nullptr; e != nullptr) {
+        // function:line once the file carries a line table
+        stack += ':';
+        stack += std::to_string(e->line);
+    }
+    else {
+        stack += '+';
+        stack += std::to_string(_ip);
+    }
+    _profiler->record(stack);
 }
 
 void VM::ensureStackRest(addr_t count) {
@@ -291,21 +510,26 @@ void VM::WRITE<double_t>(addr_t addr, double_t value) {
     *reinterpret_cast<double_t*>(checkAddr(addr, 2)) = value;
 }
 
-void VM::JUMP(u2 offset) {
-    if (0 > offset || offset >= _currentInstructions.size()) {
+void VM::JUMP(u4 offset) {
+    if (0 > offset || offset >= _code.size) {
         throw InvalidControlTransfer();
     }
     this->_ip = offset - 1;
 }
 
-void VM::CALL(u2 index) {
-    if (0 > index || index >= this->_file.functions.size()) {
+void VM::CALL(u4 index) {
+    if (0 > index || index >= this->_functions.size()) {
         throw InvalidControlTransfer();
     }
-    Function& calledFunction = this->_file.functions.at(index);
+    FunctionEntry& calledFunction = this->_functions[index];
+    if (calledFunction.code.data == nullptr) {
+        auto& instructions = this->_file.load_function(index);
+        verifyInstructions(this->_file, instructions);
+        calledFunction.code = Code{ instructions.data(), static_cast<u4>(instructions.size()) };
+    }
     Context newContext;
     newContext.functionIndex = index;
-    newContext.functionName = std::get<str_t>(this->_file.constants.at(calledFunction.nameIndex).value);
+    newContext.functionName = calledFunction.name;
 
     newContext.functionLevel = calledFunction.level;
     int newLv = newContext.functionLevel;
@@ -330,8 +554,11 @@ void VM::CALL(u2 index) {
     newContext.prevSP = this->_bp;
     newContext.BP = this->_bp;
     _contexts.push_back(newContext);
+    if (_perf) {
+        _perf->switchTo(index, true);
+    }
     this->_ip = -1;
-    this->_currentInstructions = calledFunction.instructions;
+    this->_code = calledFunction.code;
 }
 
 void VM::RET() {
@@ -343,11 +570,14 @@ void VM::RET() {
     this->_bp = curContext.prevBP;
     this->_ip = curContext.prevPC;
     _contexts.pop_back();
+    if (_perf) {
+        _perf->switchTo(_contexts.back().functionIndex, false);
+    }
     if (_contexts.size() != 1) {
-        this->_currentInstructions = _file.functions.at(_contexts.back().functionIndex).instructions;
+        this->_code = _functions[_contexts.back().functionIndex].code;
     }
     else {
-        this->_currentInstructions = _file.start;
+        this->_code = _startCode;
     }
 }
 
@@ -367,17 +597,15 @@ void VM::dup2() {
     DUP2();
 }
 
-void VM::loadc(u2 index) {
-    if (index < 0 || index >= _file.constants.size()) {
-        throw;
+void VM::loadc(u4 index) {
+    // the code of an image is not verified
+    if (index >= _constantCount) {
+        throw InvalidMemoryAccess(strfmt("constant index {} out of range", index));
     }
-    auto& constant = _file.constants.at(index);
-    switch (constant.type)
-    {
-    case Constant::Type::STRING: PUSH(_stringLiteralPool.at(index)); break;
-    case Constant::Type::INT:    PUSH(std::get<int_t>(constant.value));    break;
-    case Constant::Type::DOUBLE: PUSH(std::get<double_t>(constant.value)); break;
-    default: throw; break;
+    auto& constant = _constants[index];
+    ensureStackRest(constant.count);
+    for (u4 i = 0; i < constant.count; ++i) {
+        _stack[_sp++] = constant.value[i];
     }
 }
 
@@ -501,56 +729,82 @@ void VM::T2T() {
     PUSH(static_cast<T2>(POP<T1>()));
 }
 
-void VM::jmp(u2 offset) {
+void VM::jmp(u4 offset) {
     JUMP(offset);
 }
 
-void VM::je(u2 offset) {
+void VM::je(u4 offset) {
     auto cond = POP<int_t>();
     if (cond == 0) {
         JUMP(offset);
     }
 }
 
-void VM::jne(u2 offset) {
+void VM::jne(u4 offset) {
     auto cond = POP<int_t>();
     if (cond != 0) {
         JUMP(offset);
     }
 }
 
-void VM::jl(u2 offset) {
+void VM::jl(u4 offset) {
     auto cond = POP<int_t>();
     if (cond < 0) {
         JUMP(offset);
     }
 }
 
-void VM::jge(u2 offset) {
+void VM::jge(u4 offset) {
     auto cond = POP<int_t>();
     if (cond >= 0) {
         JUMP(offset);
     }
 }
 
-void VM::jg(u2 offset) {
+void VM::jg(u4 offset) {
     auto cond = POP<int_t>();
     if (cond > 0) {
         JUMP(offset);
     }
 }
 
-void VM::jle(u2 offset) {
+void VM::jle(u4 offset) {
     auto cond = POP<int_t>();
     if (cond <= 0) {
         JUMP(offset);
     }
 }
 
-void VM::call(u2 index) {
+void VM::call(u4 index) {
     CALL(index);
 }
 
+void VM::callnative(u4 index) {
+    auto& natives = nativeFunctions();
+    if (index >= natives.size()) {
+        throw InvalidControlTransfer();
+    }
+    auto& native = natives[index];
+    addr_t count = native.paramSize();
+    ensureStackUsed(count);
+    struct Memory final : NativeMemory {
+        VM& vm;
+        explicit Memory(VM& vm) : vm(vm) {}
+        slot_t* checkAddr(addr_t addr, addr_t count) override {
+            return vm.checkAddr(addr, count);
+        }
+    } memory(*this);
+    slot_t result[slots_count<double_t>] = {};
+    native.invoke(toStackPtr(_sp - count), result, memory);
+    _sp -= count;
+    if (native.returnType == 'd') {
+        PUSH(nativeArg<double_t>(result, 0));
+    }
+    else {
+        PUSH(nativeArg<int_t>(result, 0));
+    }
+}
+
 template <typename T>
 void VM::Tret() {
     auto rtv = POP<T>();
@@ -567,10 +821,10 @@ template <typename T>
 void VM::Tprint() {
     auto value = POP<T>();
     if constexpr (std::is_floating_point_v<T>) {
-        std::cout << std::fixed << std::setprecision(6) << value;
+        *_out << std::fixed << std::setprecision(6) << value;
     }
     else if constexpr (std::is_integral_v<T>) {
-        std::cout << value;
+        *_out << value;
     }
 }
 
@@ -579,17 +833,17 @@ void VM::sprint() {
     // std::cout << reinterpret_cast<const char*>(str);
     char_t ch;
     while ((ch = READ<char_t>(str++)) != '\0') {
-        std::cout << ch;
+        *_out << ch;
     }
 }
 
 void VM::printl() {
-    std::cout << std::endl;
+    *_out << std::endl;
 }
 
 template <typename T>
 void VM::Tscan() {
-    if (T value; std::cin >> value) {
+    if (T value; *_in >> value) {
         PUSH(value);
     }
     else {
@@ -601,73 +855,9 @@ void VM::executeInstruction(const Instruction& ins) {
     //println(std::cout, "execute", ins);
     switch (ins.op)
     {
-    case OpCode::nop: break;
-    case OpCode::bipush:
-    case OpCode::ipush:   ipush(ins.x); break;
-    case OpCode::pop:     popn(1);      break;
-    case OpCode::pop2:    popn(2);      break;
-    case OpCode::popn:    popn(ins.x);  break;
-    case OpCode::dup:     dup();        break;
-    case OpCode::dup2:    dup2();       break;
-    case OpCode::loadc:   loadc(ins.x); break;
-    case OpCode::loada:   loada(ins.x, ins.y);break;
-    case OpCode::_new:    _new();       break;
-    case OpCode::snew:    snew(ins.x);  break;
-    
-    case OpCode::iload:   Tload<int_t>();      break;
-    case OpCode::dload:   Tload<double_t>();   break;
-    case OpCode::aload:   Tload<addr_t>();     break;
-    case OpCode::iaload:  Taload<int_t>();     break;
-    case OpCode::daload:  Taload<double_t>();  break;
-    case OpCode::aaload:  Taload<addr_t>();    break;
-    
-    case OpCode::istore:  Tstore<int_t>();     break;
-    case OpCode::dstore:  Tstore<double_t>();  break;
-    case OpCode::astore:  Tstore<addr_t>();    break;
-    case OpCode::iastore: Tastore<int_t>();    break;
-    case OpCode::dastore: Tastore<double_t>(); break;
-    case OpCode::aastore: Tastore<addr_t>();   break;
-    
-    case OpCode::iadd:    Tadd<int_t>();       break;
-    case OpCode::dadd:    Tadd<double_t>();    break;
-    case OpCode::isub:    Tsub<int_t>();       break;
-    case OpCode::dsub:    Tsub<double_t>();    break;
-    case OpCode::imul:    Tmul<int_t>();       break;
-    case OpCode::dmul:    Tmul<double_t>();    break;
-    case OpCode::idiv:    Tdiv<int_t>();       break;
-    case OpCode::ddiv:    Tdiv<double_t>();    break;
-    case OpCode::ineg:    Tneg<int_t>();       break;
-    case OpCode::dneg:    Tneg<double_t>();    break;
-
-    case OpCode::icmp:    Tcmp<int_t>();       break;
-    case OpCode::dcmp:    Tcmp<double_t>();    break;
-    
-    case OpCode::i2d:     T2T<int_t, double_t>(); break;
-    case OpCode::d2i:     T2T<double_t, int_t>(); break;
-    case OpCode::i2c:     T2T<int_t, char_t>();   break;
-    
-    case OpCode::jmp:     jmp(ins.x);   break;
-    case OpCode::je:      je(ins.x);    break;
-    case OpCode::jne:     jne(ins.x);   break;
-    case OpCode::jl:      jl(ins.x);    break;
-    case OpCode::jge:     jge(ins.x);   break;
-    case OpCode::jg:      jg(ins.x);    break;
-    case OpCode::jle:     jle(ins.x);   break;
-
-    case OpCode::call:    call(ins.x);      break;
-    case OpCode::ret:     Tret<void>();     break;
-    case OpCode::iret:    Tret<int_t>();    break;
-    case OpCode::dret:    Tret<double_t>(); break;
-    case OpCode::aret:    Tret<addr_t>();   break;
-
-    case OpCode::iprint:  Tprint<int_t>();    break;
-    case OpCode::dprint:  Tprint<double_t>(); break;
-    case OpCode::cprint:  Tprint<char_t>();   break;
-    case OpCode::sprint:  sprint();           break;
-    case OpCode::printl:  printl();           break;
-    case OpCode::iscan:   Tscan<int_t>();     break;
-    case OpCode::dscan:   Tscan<double_t>();  break;
-    case OpCode::cscan:   Tscan<char_t>();    break;
+#define X(op, code, str, x, y, pop, push, fl, exec) case OpCode::op: exec; break;
+    CC0_OPCODE_LIST(X)
+#undef X
     default:
         break;
     }
@@ -6,12 +6,21 @@
 #include "./constant.h"
 #include "./function.h"
 #include "./file.h"
+#include "./profiler.h"
+#include "./perf_counters.h"
+#include "./time_report.h"
+#include "./native.h"
+#include "./image.h"
 
 #include <memory>
 #include <cstdint>
+#include <iostream>
+#include <cstdlib>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <variant>
+#include <unordered_map>
 
 namespace vm {
 
@@ -24,17 +33,42 @@ private:
     static const addr_t MAX_HEAP_ADDR;
     static const addr_t MAX_HEAP_SIZE;
 
+    struct FreeSlots {
+        void operator()(slot_t* p) const noexcept { std::free(p); }
+    };
+    // the instructions of .start or of a function, in _file or in _image
+    struct Code {
+        const Instruction* data = nullptr;
+        u4 size = 0;
+    };
+    struct FunctionEntry {
+        // data is nullptr until the body is decoded and verified
+        Code code;
+        u4 paramSize;
+        u4 level;
+        std::string_view name;
+        // nullptr for images
+        const LineTable* lines;
+    };
+
 private:
     bool prepared;
     File _file;
+    std::shared_ptr<const Image> _image;
+    Code _startCode;
+    const LineTable* _startLines;
+    std::vector<FunctionEntry> _functions;
     //std::vector<std::shared_ptr<Stack>> stacks;
-    std::unique_ptr<slot_t[]> _stack;
-    std::unique_ptr<slot_t[]> _heap;
+    // calloc, the pages the program does not touch are never written
+    std::unique_ptr<slot_t[], FreeSlots> _stack;
+    std::unique_ptr<slot_t[], FreeSlots> _heap;
     std::vector<std::pair<addr_t, addr_t>> _heapRecord;
     addr_t _sp;
     addr_t _bp;
     addr_t _ip;
-    int _counterInstruction;
+    u8 _counterInstruction;
+    // the program stops with a runtime error after executing this many instructions, 0 for no limit
+    u8 _instructionLimit;
     // int _counterMicroIns;
     
     struct Context {
@@ -44,12 +78,22 @@ private:
         addr_t BP;
         int staticLink; // index in contexts
         int functionIndex;
-        std::string functionName;
-        vm::u2 functionLevel;
+        std::string_view functionName;
+        vm::u4 functionLevel;
     };
     std::vector<Context> _contexts;
-    std::vector<Instruction> _currentInstructions;
-    std::unordered_map<vm::u2, addr_t> _stringLiteralPool;
+    Code _code;
+    // indexed by the constant index, in _constantStorage or in _image
+    const ConstantSlots* _constants;
+    u4 _constantCount;
+    std::vector<ConstantSlots> _constantStorage;
+    SampleProfiler* _profiler;
+    PerfCounters* _perf;
+    TimeReport* _timeReport;
+    // scan and print, and the runtime errors
+    std::istream* _in;
+    std::ostream* _out;
+    std::ostream* _err;
     
 public:
     VM(File) noexcept;
@@ -59,11 +103,26 @@ public:
 
 public:
     static std::unique_ptr<VM> make_vm(File file);
+    static std::unique_ptr<VM> make_vm(std::shared_ptr<const Image> image);
+    // the execution image of the file, throws InvalidFile as make_vm does
+    static std::vector<unsigned char> make_image(File file);
     void start();
+    // the profiler is not owned and must outlive start()
+    void setProfiler(SampleProfiler* profiler) noexcept;
+    // the counters are not owned and must outlive start()
+    void setPerfCounters(PerfCounters* perf) noexcept;
+    // the report is not owned and must outlive start()
+    void setTimeReport(TimeReport* report) noexcept;
+    // std::cin, std::cout and std::cerr unless set, the streams must outlive start()
+    void setStreams(std::istream& in, std::ostream& out, std::ostream& err) noexcept;
+    // no limit (0) unless set
+    void setInstructionLimit(u8 limit) noexcept;
 
 private: 
     void init() noexcept;
-    void buildStringLiteralPool();
+    void allocate();
+    void bindFile();
+    void buildConstants();
     void run();
     void ensureStackRest(addr_t count);
     void ensureStackUsed(addr_t count);
@@ -71,6 +130,9 @@ private:
     slot_t* toHeapPtr(addr_t);
     slot_t* toStackPtr(addr_t);
     void printStackTrace(std::ostream&);
+    void takeSample();
+    // " (line L, column C)" if the file carries a line table, "" otherwise
+    std::string sourceLocation(int functionIndex, addr_t ip) const;
 
     void    DEC_SP(addr_t count);
     void    INC_SP(addr_t count);
@@ -86,8 +148,8 @@ private:
     template<typename T>
     void    WRITE(addr_t addr, T value);
 
-    void    JUMP(u2 offset);
-    void    CALL(u2 index);
+    void    JUMP(u4 offset);
+    void    CALL(u4 index);
     void    RET();
 
 private:
@@ -96,7 +158,7 @@ private:
     void ipush(int_t value);
     void popn(addr_t count);
     void dup(); void dup2();
-    void loadc(u2 index);
+    void loadc(u4 index);
     void loada(u2 level_diff, addr_t offset);
     
     void _new();
@@ -127,12 +189,13 @@ private:
     template <typename T1, typename T2>
     void T2T();
 
-    void jmp(u2 offset);
-    void je(u2 offset); void jne(u2 offset); 
-    void jl(u2 offset); void jge(u2 offset); 
-    void jg(u2 offset); void jle(u2 offset);
+    void jmp(u4 offset);
+    void je(u4 offset); void jne(u4 offset); 
+    void jl(u4 offset); void jge(u4 offset); 
+    void jg(u4 offset); void jle(u4 offset);
 
-    void call(u2 index);
+    void call(u4 index);
+    void callnative(u4 index);
     template <typename T>
     void Tret();
     
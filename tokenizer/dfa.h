@@ -0,0 +1,257 @@
+#pragma once
+
+#include "tokenizer/token.h"
+#include "error/error.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace cc0 {
+
+	// Tokenizer 的状态机，转移表是编译期生成的 状态 × 字符类别 的二维表
+	// nextToken 每读一个字符只需查一次字符类别、查一次转移表，字符串和字符字面量的内部由单独的函数处理
+	namespace dfa {
+
+		// 状态机的所有状态
+		// 一个字符的运算符、标识符、字面量和注释由对应的动作一次读完，不需要单独的状态
+		enum State : std::uint8_t {
+			INITIAL_STATE,
+
+			// 数字部分
+			ZERO_STATE, // 0
+			HEX_STATE, // 0x
+			DEC_STATE, // 1-9
+			DOUBLE_E_STATE, // e 之后，只读一位指数
+			DOT_STATE, // . 之后
+
+			DIVISION_SIGN_STATE, // / 之后可能是注释
+			EQUAL_SIGN_STATE, // =
+			GREATER_SIGN_STATE, // >
+			LESS_SIGN_STATE, // <
+			NOT_EQ_STATE, // !
+
+			STATE_COUNT
+		};
+
+		// 字符的类别，同一类别的字符在每个状态下的转移都相同
+		enum CharClass : std::uint8_t {
+			SPACE, // 除 \n \r 外的空白字符
+			LINE_END, // \n \r
+			INVALID, // 不可打印的字符
+			ZERO, // 0
+			DIGIT, // 1-9
+			LETTER_E, // e E
+			LETTER_X, // x X
+			HEX_LETTER, // a-d f A-D F
+			LETTER, // 其他字母
+			PLUS, MINUS, STAR, SLASH, EQUAL, LESS_THAN, GREATER_THAN, BANG,
+			SEMI, COMMA_CHAR, L_PAREN, R_PAREN, L_BRACE, R_BRACE, COLON, DOUBLE_QUOTE, SINGLE_QUOTE, DOT,
+			OTHER, // 其他可打印字符
+			END_OF_FILE, // 读到了文件尾
+			CLASS_COUNT
+		};
+
+		// 字符的分类与 tokenizer/utils.hpp 中的函数在 "C" locale 下相同
+		constexpr std::array<CharClass, 256> makeClasses() {
+			std::array<CharClass, 256> classes{};
+			for (std::size_t ch = 0; ch < 256; ch++) {
+				if (ch == '\n' || ch == '\r')
+					classes[ch] = LINE_END;
+				else if (ch == ' ' || ('\t' <= ch && ch <= '\f'))
+					classes[ch] = SPACE;
+				else if (ch < ' ' || ch > '~')
+					classes[ch] = INVALID;
+				else if (ch == '0')
+					classes[ch] = ZERO;
+				else if ('1' <= ch && ch <= '9')
+					classes[ch] = DIGIT;
+				else if (ch == 'e' || ch == 'E')
+					classes[ch] = LETTER_E;
+				else if (ch == 'x' || ch == 'X')
+					classes[ch] = LETTER_X;
+				else if (('a' <= ch && ch <= 'f') || ('A' <= ch && ch <= 'F'))
+					classes[ch] = HEX_LETTER;
+				else if (('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z'))
+					classes[ch] = LETTER;
+				else
+					classes[ch] = OTHER;
+			}
+			classes['+'] = PLUS;
+			classes['-'] = MINUS;
+			classes['*'] = STAR;
+			classes['/'] = SLASH;
+			classes['='] = EQUAL;
+			classes['<'] = LESS_THAN;
+			classes['>'] = GREATER_THAN;
+			classes['!'] = BANG;
+			classes[';'] = SEMI;
+			classes[','] = COMMA_CHAR;
+			classes['('] = L_PAREN;
+			classes[')'] = R_PAREN;
+			classes['{'] = L_BRACE;
+			classes['}'] = R_BRACE;
+			classes[':'] = COLON;
+			classes['"'] = DOUBLE_QUOTE;
+			classes['\''] = SINGLE_QUOTE;
+			classes['.'] = DOT;
+			return classes;
+		}
+
+		inline constexpr std::array<CharClass, 256> Classes = makeClasses();
+
+		inline CharClass classOf(char ch) { return Classes[static_cast<unsigned char>(ch)]; }
+
+		// 读到一个字符之后要做的事
+		enum Action : std::uint8_t {
+			MOVE, // 转到状态 arg
+			START, // 这是 token 的第一个字符，记录 token 的开始位置，转到状态 arg
+			// 状态不变，连续的同一段字符一次跳过
+			SKIP_SPACE, SKIP_DIGITS,
+			// 跳过整个注释，回到初始状态
+			LINE_COMMENT, BLOCK_COMMENT,
+			// 返回 arg 类型的 token，值分别是十进制整数、十六进制整数、浮点数、运算符的字符、驻留的字符串
+			INTEGER_TOKEN, HEX_TOKEN, FLOAT_TOKEN, CHAR_TOKEN, STRING_TOKEN,
+			// 以下在 token 的第一个字符处就读完整个 token
+			OPERATOR, // 一个字符的运算符，arg 是它的类型
+			IDENTIFIER_START, // 标识符或保留字
+			STRING_START, // "  String 直接处理转义符
+			CHAR_START, // ' char 直接处理转义符
+			FAIL, // 返回编译错误 arg
+			FINISH, // 没有更多的 token 了，返回 ErrEOF
+			DIE // 预料之外的状态
+		};
+
+		// 4 个字节，每行 RowSize 项，查表时下标只需移位
+		struct alignas(4) Transition {
+			Action action;
+			// 状态、TokenType 或者 ErrorCode，由 action 决定
+			std::uint8_t arg;
+			// 这个字符不属于当前的 token，要先回退
+			bool unread;
+
+			constexpr State state() const { return static_cast<State>(arg); }
+			constexpr TokenType type() const { return static_cast<TokenType>(arg); }
+			constexpr ErrorCode error() const { return static_cast<ErrorCode>(arg); }
+		};
+
+		constexpr Transition move(State s) { return { MOVE, static_cast<std::uint8_t>(s), false }; }
+		constexpr Transition start(State s) { return { START, static_cast<std::uint8_t>(s), false }; }
+		constexpr Transition skip(Action a) { return { a, 0, false }; }
+		constexpr Transition emit(Action a, TokenType t) { return { a, static_cast<std::uint8_t>(t), true }; }
+		constexpr Transition emitWith(Action a, TokenType t) { return { a, static_cast<std::uint8_t>(t), false }; }
+		constexpr Transition fail(ErrorCode e) { return { FAIL, static_cast<std::uint8_t>(e), false }; }
+		constexpr Transition failUnread(ErrorCode e) { return { FAIL, static_cast<std::uint8_t>(e), true }; }
+		constexpr Transition operation(TokenType t) { return { OPERATOR, static_cast<std::uint8_t>(t), false }; }
+
+		inline constexpr std::size_t RowSize = 32;
+		static_assert(CLASS_COUNT <= RowSize);
+
+		using Row = std::array<Transition, RowSize>;
+		using Table = std::array<Row, STATE_COUNT>;
+
+		constexpr Row fill(Transition t) {
+			Row row{};
+			for (auto& e : row)
+				e = t;
+			return row;
+		}
+
+		// < > = ! 之后可以跟一个 =
+		constexpr void withEqual(Table& table, State s, TokenType alone, TokenType eq) {
+			table[s] = fill(emit(STRING_TOKEN, alone));
+			table[s][EQUAL] = emitWith(STRING_TOKEN, eq);
+		}
+
+		// 缓冲区以 \n 结尾，除了初始状态，其他状态都读不到文件尾
+		// 这些状态下 END_OF_FILE 一列只是为了表的完整
+		constexpr Table makeTable() {
+			Table table{};
+			for (auto& row : table)
+				row = fill({ DIE, 0, false });
+
+			auto& initial = table[INITIAL_STATE];
+			initial = fill(failUnread(ErrInvalidInput));
+			initial[SPACE] = initial[LINE_END] = skip(SKIP_SPACE);
+			initial[ZERO] = start(ZERO_STATE);
+			initial[DIGIT] = start(DEC_STATE);
+			initial[LETTER_E] = initial[LETTER_X] = initial[HEX_LETTER] = initial[LETTER] = { IDENTIFIER_START, IDENTIFIER, false };
+			initial[SLASH] = start(DIVISION_SIGN_STATE);
+			initial[EQUAL] = start(EQUAL_SIGN_STATE);
+			initial[LESS_THAN] = start(LESS_SIGN_STATE);
+			initial[GREATER_THAN] = start(GREATER_SIGN_STATE);
+			initial[BANG] = start(NOT_EQ_STATE);
+			initial[DOT] = start(DOT_STATE);
+			initial[PLUS] = operation(PLUS_SIGN);
+			initial[MINUS] = operation(MINUS_SIGN);
+			initial[STAR] = operation(MULTIPLICATION_SIGN);
+			initial[SEMI] = operation(SEMICOLON);
+			initial[COMMA_CHAR] = operation(COMMA);
+			initial[L_PAREN] = operation(LEFT_PAREN);
+			initial[R_PAREN] = operation(RIGHT_PAREN);
+			initial[L_BRACE] = operation(LEFT_BRACE);
+			initial[R_BRACE] = operation(RIGHT_BRACE);
+			initial[DOUBLE_QUOTE] = { STRING_START, STRING, false };
+			initial[SINGLE_QUOTE] = { CHAR_START, CHAR_LIT, false };
+			// : 没有对应的 token，和其他不认识的字符一样是编译错误
+			initial[COLON] = failUnread(ErrInvalidInput);
+			initial[END_OF_FILE] = { FINISH, 0, false };
+
+			// 0 之后不能再跟数字
+			auto& zero = table[ZERO_STATE];
+			zero = fill(emit(INTEGER_TOKEN, INTEGER));
+			zero[ZERO] = zero[DIGIT] = failUnread(ErrInvalidInput);
+			zero[LETTER_X] = move(HEX_STATE);
+			zero[DOT] = move(DOT_STATE);
+			zero[LETTER_E] = move(DOUBLE_E_STATE);
+			zero[END_OF_FILE] = fail(ErrInvalidInput);
+
+			auto& dec = table[DEC_STATE];
+			dec = fill(emit(INTEGER_TOKEN, INTEGER));
+			dec[ZERO] = dec[DIGIT] = skip(SKIP_DIGITS);
+			dec[DOT] = move(DOT_STATE);
+			dec[LETTER_E] = move(DOUBLE_E_STATE);
+
+			auto& hex = table[HEX_STATE];
+			hex = fill(emit(HEX_TOKEN, INTEGER));
+			hex[ZERO] = hex[DIGIT] = hex[LETTER_E] = hex[HEX_LETTER] = move(HEX_STATE);
+
+			auto& dot = table[DOT_STATE];
+			dot = fill(emit(FLOAT_TOKEN, FLOAT));
+			dot[ZERO] = dot[DIGIT] = skip(SKIP_DIGITS);
+			dot[LETTER_E] = move(DOUBLE_E_STATE);
+
+			// e 之后可以有任意个正负号，第一个数字就是浮点数的结尾
+			auto& exponent = table[DOUBLE_E_STATE];
+			exponent = fill(fail(ErrInvalidInput));
+			exponent[PLUS] = exponent[MINUS] = move(DOUBLE_E_STATE);
+			exponent[ZERO] = exponent[DIGIT] = emitWith(FLOAT_TOKEN, FLOAT);
+
+			withEqual(table, EQUAL_SIGN_STATE, EQUAL_SIGN, EQUAL_EQ);
+			withEqual(table, LESS_SIGN_STATE, LESS, LESS_EQ);
+			table[LESS_SIGN_STATE][END_OF_FILE] = fail(ErrInvalidInput);
+			withEqual(table, GREATER_SIGN_STATE, GREATER, GREATER_EQ);
+			table[GREATER_SIGN_STATE][END_OF_FILE] = fail(ErrInvalidInput);
+			// 单独的 ! 不是 token，!= 的类型是 EQUAL_EQ
+			table[NOT_EQ_STATE] = fill(fail(ErrInvalidInput));
+			table[NOT_EQ_STATE][EQUAL] = emitWith(STRING_TOKEN, EQUAL_EQ);
+
+			auto& division = table[DIVISION_SIGN_STATE];
+			division = fill(emit(CHAR_TOKEN, DIVISION_SIGN));
+			division[SLASH] = skip(LINE_COMMENT);
+			division[STAR] = skip(BLOCK_COMMENT);
+
+			// 文件尾没有读到字符，不用回退
+			for (auto& row : table)
+				row[END_OF_FILE].unread = false;
+			return table;
+		}
+
+		inline constexpr Table Transitions = makeTable();
+
+		static_assert(sizeof(Transition) == 4);
+		static_assert(Transitions[DEC_STATE][DIGIT].action == SKIP_DIGITS);
+		static_assert(Transitions[DEC_STATE][END_OF_FILE].action == INTEGER_TOKEN && !Transitions[DEC_STATE][END_OF_FILE].unread);
+		static_assert(Transitions[NOT_EQ_STATE][EQUAL].type() == EQUAL_EQ);
+	}
+}
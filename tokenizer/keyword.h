@@ -0,0 +1,95 @@
+#pragma once
+
+#include "tokenizer/token.h"
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+namespace cc0 {
+
+	// 保留字表，parseIdentifier 用编译期生成的完美哈希查找
+	// 表中每个保留字的哈希值互不相同，查找时只需算一次哈希、比较一次字符串
+	namespace keyword {
+
+		struct Keyword {
+			std::string_view name;
+			TokenType type;
+		};
+
+		inline constexpr Keyword Keywords[] = {
+			{ "const", CONST }, { "extern", EXTERN },
+			{ "void", VOID }, { "int", INT }, { "char", CHAR }, { "double", DOUBLE }, { "struct", STRUCT },
+			{ "if", IF }, { "else", ELSE }, { "switch", SWITCH }, { "case", CASE }, { "default", DEFAULT },
+			{ "while", WHILE }, { "for", FOR }, { "do", DO },
+			{ "return", RETURN }, { "break", BREAK }, { "continue", CONTINUE },
+			{ "print", PRINT }, { "scan", SCAN },
+		};
+		inline constexpr std::size_t Count = sizeof(Keywords) / sizeof(Keywords[0]);
+
+		// 最短与最长的保留字，长度不在这个范围内的一定是标识符
+		inline constexpr std::size_t MinLength = 2;
+		inline constexpr std::size_t MaxLength = 8;
+
+		// 哈希表的大小，2 的幂
+		inline constexpr std::size_t TableSize = 64;
+
+		// 由长度、第一个字符、第二个字符和最后一个字符算出的哈希，str 至少有 MinLength 个字符
+		constexpr std::size_t hash(std::string_view str, std::size_t seed) {
+			auto first = static_cast<unsigned char>(str[0]);
+			auto second = static_cast<unsigned char>(str[1]);
+			auto last = static_cast<unsigned char>(str[str.size() - 1]);
+			return (first * seed + second * 3 + last + str.size()) & (TableSize - 1);
+		}
+
+		constexpr bool isPerfect(std::size_t seed) {
+			std::array<bool, TableSize> used{};
+			for (auto& kw : Keywords) {
+				auto h = hash(kw.name, seed);
+				if (used[h])
+					return false;
+				used[h] = true;
+			}
+			return true;
+		}
+
+		// 从 1 开始找第一个没有冲突的 seed
+		constexpr std::size_t findSeed() {
+			std::size_t seed = 1;
+			while (!isPerfect(seed))
+				seed++;
+			return seed;
+		}
+
+		inline constexpr std::size_t Seed = findSeed();
+
+		// 哈希表的一项，空位的 name 为空串，不会与任何长度至少为 MinLength 的 str 相等
+		struct Slot {
+			std::string_view name;
+			// 在 Keywords 中的下标，空位为 Count
+			std::size_t index;
+		};
+
+		constexpr std::array<Slot, TableSize> makeTable() {
+			std::array<Slot, TableSize> table{};
+			for (auto& slot : table)
+				slot = Slot{ "", Count };
+			for (std::size_t i = 0; i < Count; i++)
+				table[hash(Keywords[i].name, Seed)] = Slot{ Keywords[i].name, i };
+			return table;
+		}
+
+		inline constexpr std::array<Slot, TableSize> Table = makeTable();
+
+		// str 是保留字时返回它在 Keywords 中的下标，否则返回 Count
+		constexpr std::size_t find(std::string_view str) {
+			if (str.size() < MinLength || str.size() > MaxLength)
+				return Count;
+			auto& slot = Table[hash(str, Seed)];
+			return slot.name == str ? slot.index : Count;
+		}
+
+		static_assert(Keywords[find("switch")].type == SWITCH);
+		static_assert(find("fo") == Count && find("format") == Count);
+	}
+}
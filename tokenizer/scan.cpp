@@ -0,0 +1,85 @@
+#include "tokenizer/scan.h"
+
+#if defined(CC0_HAS_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CC0_HAS_AVX2 1
+#define CC0_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace cc0 {
+namespace scan {
+
+#ifdef CC0_HAS_AVX2
+	namespace avx2 {
+
+		CC0_TARGET_AVX2 inline __m256i eq(__m256i x, char ch) { return _mm256_cmpeq_epi8(x, _mm256_set1_epi8(ch)); }
+
+		CC0_TARGET_AVX2 inline __m256i in(__m256i x, char lo, char hi) {
+			return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, _mm256_set1_epi8(lo)), x),
+			                        _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(hi)), x));
+		}
+
+		CC0_TARGET_AVX2 inline unsigned none(__m256i keep) { return ~static_cast<unsigned>(_mm256_movemask_epi8(keep)); }
+
+		// 与 sse2::stops 相同，一次 32 个字符
+		template <Kind K>
+		CC0_TARGET_AVX2 inline unsigned stops(__m256i x) {
+			switch (K) {
+				case SPACE:
+					return none(_mm256_or_si256(eq(x, ' '), in(x, '\t', '\r')));
+				case IDENTIFIER:
+					return none(_mm256_or_si256(in(x, '0', '9'), _mm256_or_si256(in(x, 'A', 'Z'), in(x, 'a', 'z'))));
+				case DIGIT:
+					return none(in(x, '0', '9'));
+				case LINE_END:
+					return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(eq(x, '\n'), eq(x, '\r'))));
+				case STAR:
+					return static_cast<unsigned>(_mm256_movemask_epi8(eq(x, '*')));
+				case STRING_SPECIAL:
+					return none(_mm256_andnot_si256(_mm256_or_si256(eq(x, '"'), eq(x, '\\')), in(x, ' ', '~')));
+			}
+			return ~0u;
+		}
+
+		// 剩下不到 32 个字符时交给 SSE2
+		template <Kind K>
+		CC0_TARGET_AVX2 const char* find(const char* p, const char* end) {
+			for (; end - p >= 32; p += 32) {
+				auto mask = stops<K>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+				if (mask != 0)
+					return p + __builtin_ctz(mask);
+			}
+			return sse2::find<K>(p, end);
+		}
+	}
+#endif
+
+	static bool hasAvx2() {
+#ifdef CC0_HAS_AVX2
+		static const bool has = __builtin_cpu_supports("avx2");
+		return has;
+#else
+		return false;
+#endif
+	}
+
+	template <Kind K>
+	const char* findRest(const char* p, const char* end) {
+#if defined(CC0_HAS_AVX2)
+		return hasAvx2() ? avx2::find<K>(p, end) : sse2::find<K>(p, end);
+#elif defined(CC0_HAS_SSE2)
+		return sse2::find<K>(p, end);
+#else
+		return scalar::find<K>(p, end);
+#endif
+	}
+
+	template const char* findRest<SPACE>(const char*, const char*);
+	template const char* findRest<IDENTIFIER>(const char*, const char*);
+	template const char* findRest<DIGIT>(const char*, const char*);
+	template const char* findRest<LINE_END>(const char*, const char*);
+	template const char* findRest<STAR>(const char*, const char*);
+	template const char* findRest<STRING_SPECIAL>(const char*, const char*);
+
+}
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define CC0_HAS_SSE2 1
+#endif
+
+namespace cc0 {
+
+	// Tokenizer 中一次跳过一段字符的函数
+	// 每个函数返回 [p, end) 中第一个不属于这一段的字符的位置，一直没有时返回 end
+	// 前 16 个字符在这里内联地用 SSE2 比较，大多数 token 和空白到这里就结束了；
+	// 更长的一段在 scan.cpp 中继续，x86 上 CPU 支持时用 AVX2（运行时检查一次），其他平台逐个字符比较
+	// 字符的分类与 tokenizer/utils.hpp 中的函数在 "C" locale 下相同
+	namespace scan {
+
+		// 要跳过的字符的种类
+		enum Kind {
+			SPACE, IDENTIFIER, DIGIT, LINE_END, STAR, STRING_SPECIAL
+		};
+
+		namespace scalar {
+
+			inline bool in(unsigned char ch, unsigned char lo, unsigned char hi) {
+				return lo <= ch && ch <= hi;
+			}
+
+			// ch 是否是这一段之后的第一个字符
+			template <Kind K>
+			inline bool stops(unsigned char ch) {
+				switch (K) {
+					case SPACE:
+						return !(ch == ' ' || in(ch, '\t', '\r'));
+					case IDENTIFIER:
+						return !(in(ch, '0', '9') || in(ch, 'A', 'Z') || in(ch, 'a', 'z'));
+					case DIGIT:
+						return !in(ch, '0', '9');
+					case LINE_END:
+						return ch == '\n' || ch == '\r';
+					case STAR:
+						return ch == '*';
+					case STRING_SPECIAL:
+						return ch == '"' || ch == '\\' || !in(ch, ' ', '~');
+				}
+				return true;
+			}
+
+			template <Kind K>
+			inline const char* find(const char* p, const char* end) {
+				while (p < end && !stops<K>(static_cast<unsigned char>(*p)))
+					p++;
+				return p;
+			}
+		}
+
+#ifdef CC0_HAS_SSE2
+		namespace sse2 {
+
+			inline __m128i eq(__m128i x, char ch) { return _mm_cmpeq_epi8(x, _mm_set1_epi8(ch)); }
+
+			// 无符号比较 lo <= x <= hi
+			inline __m128i in(__m128i x, char lo, char hi) {
+				return _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(lo)), x),
+				                     _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(hi)), x));
+			}
+
+			inline unsigned none(__m128i keep) { return ~static_cast<unsigned>(_mm_movemask_epi8(keep)) & 0xFFFFu; }
+
+			// 16 个字符中是这一段之后的第一个字符的位
+			template <Kind K>
+			inline unsigned stops(__m128i x) {
+				switch (K) {
+					case SPACE:
+						return none(_mm_or_si128(eq(x, ' '), in(x, '\t', '\r')));
+					case IDENTIFIER:
+						return none(_mm_or_si128(in(x, '0', '9'), _mm_or_si128(in(x, 'A', 'Z'), in(x, 'a', 'z'))));
+					case DIGIT:
+						return none(in(x, '0', '9'));
+					case LINE_END:
+						return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(eq(x, '\n'), eq(x, '\r'))));
+					case STAR:
+						return static_cast<unsigned>(_mm_movemask_epi8(eq(x, '*')));
+					case STRING_SPECIAL:
+						return none(_mm_andnot_si128(_mm_or_si128(eq(x, '"'), eq(x, '\\')), in(x, ' ', '~')));
+				}
+				return 0xFFFFu;
+			}
+
+			inline __m128i load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+			template <Kind K>
+			inline const char* find(const char* p, const char* end) {
+				for (; end - p >= 16; p += 16) {
+					auto mask = stops<K>(load(p));
+					if (mask != 0)
+						return p + __builtin_ctz(mask);
+				}
+				return scalar::find<K>(p, end);
+			}
+		}
+#endif
+
+		// 16 个字符之后的部分，在 scan.cpp 中
+		template <Kind K>
+		const char* findRest(const char* p, const char* end);
+
+		template <Kind K>
+		inline const char* find(const char* p, const char* end) {
+			// 一个空格、一个字符的标识符之类的最常见，先只看一个字符
+			if (p < end && scalar::stops<K>(static_cast<unsigned char>(*p)))
+				return p;
+#ifdef CC0_HAS_SSE2
+			if (end - p >= 16) {
+				auto mask = sse2::stops<K>(sse2::load(p));
+				if (mask != 0)
+					return p + __builtin_ctz(mask);
+				return findRest<K>(p + 16, end);
+			}
+#endif
+			return scalar::find<K>(p, end);
+		}
+
+		// 空白字符 isspace
+		inline const char* skipSpace(const char* p, const char* end) { return find<SPACE>(p, end); }
+		// 标识符中的字符 isalpha || isdigit
+		inline const char* skipIdentifier(const char* p, const char* end) { return find<IDENTIFIER>(p, end); }
+		// 十进制数字 isdigit
+		inline const char* skipDigits(const char* p, const char* end) { return find<DIGIT>(p, end); }
+
+		// 下一个 \n 或 \r，单行注释到这里结束
+		inline const char* findLineEnd(const char* p, const char* end) { return find<LINE_END>(p, end); }
+		// 下一个 *，多行注释只可能在这里结束
+		inline const char* findStar(const char* p, const char* end) { return find<STAR>(p, end); }
+		// 字符串字面量中下一个 "、\ 或者不可打印的字符
+		inline const char* findStringSpecial(const char* p, const char* end) { return find<STRING_SPECIAL>(p, end); }
+	}
+}
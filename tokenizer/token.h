@@ -2,9 +2,10 @@
 
 #include "error/error.h"
 
-#include <any>
-#include <string>
+#include <cstddef>
 #include <cstdint>
+#include <string>
+#include <utility>
 
 namespace cc0 {
 
@@ -20,7 +21,7 @@ namespace cc0 {
         // 类型修饰符
         VOID, INT, CHAR, DOUBLE, STRUCT,
         // 修饰符
-        CONST,
+        CONST, EXTERN,
         // 判断
         IF, ELSE, SWITCH, CASE, DEFAULT,
         // 循环
@@ -63,87 +64,114 @@ namespace cc0 {
     };
 
 
+    // token 的值：INTEGER 为 int32_t，FLOAT 为 double，CHAR_LIT 与单字符运算符为 char，
+    // 其余为 Tokenizer 中驻留的字符串，同一个字符串只存一份，Token 中只存指针
+    // 字符串属于读出这个 token 的 Tokenizer，Token 不能比 Tokenizer 活得久
     class Token final {
     private:
         using uint64_t = std::uint64_t;
+        using uint32_t = std::uint32_t;
         using int32_t = std::int32_t;
-    public:
-
-        friend void swap(Token &lhs, Token &rhs);
 
+        enum ValueKind : std::uint8_t {
+            NO_VALUE, INT_VALUE, DOUBLE_VALUE, CHAR_VALUE, STRING_VALUE
+        };
     public:
 
-        Token(TokenType type, std::any value, uint64_t start_line, uint64_t start_column, uint64_t end_line,
-              uint64_t end_column)
-                : _type(type), _value(std::move(value)), _start_pos(start_line, start_column),
-                  _end_pos(end_line, end_column) {}
+        Token() : Token(TokenType::NULL_TOKEN, NO_VALUE, std::make_pair(0, 0), 0, 0) {}
 
-        Token(TokenType type, std::any value, std::pair<uint64_t, uint64_t> start, std::pair<uint64_t, uint64_t> end)
-                : Token(type, value, start.first, start.second, end.first, end.second) {}
+        // pos 为 <行号，列号>，offset 与 length 为 token 在源码中的范围
+        Token(TokenType type, int32_t value, std::pair<uint64_t, uint64_t> pos, std::size_t offset, std::size_t length)
+                : Token(type, INT_VALUE, pos, offset, length) { _value.i = value; }
 
-        Token(const Token &t) {
-            _type = t._type;
-            _value = t._value;
-            _start_pos = t._start_pos;
-            _end_pos = t._end_pos;
-        }
+        Token(TokenType type, double value, std::pair<uint64_t, uint64_t> pos, std::size_t offset, std::size_t length)
+                : Token(type, DOUBLE_VALUE, pos, offset, length) { _value.d = value; }
 
-        Token(Token &&t) : Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0) { swap(*this, t); }
+        Token(TokenType type, char value, std::pair<uint64_t, uint64_t> pos, std::size_t offset, std::size_t length)
+                : Token(type, CHAR_VALUE, pos, offset, length) { _value.c = value; }
 
-        Token &operator=(Token t) {
-            swap(*this, t);
-            return *this;
-        }
+        Token(TokenType type, const std::string *value, std::pair<uint64_t, uint64_t> pos, std::size_t offset,
+              std::size_t length)
+                : Token(type, STRING_VALUE, pos, offset, length) { _value.s = value; }
 
         bool operator==(const Token &rhs) const {
             return _type == rhs._type
-                   && GetValueString() == rhs.GetValueString()
-                   && _start_pos == rhs._start_pos
-                   && _end_pos == rhs._end_pos;
+                   && sameValue(rhs)
+                   && _line == rhs._line && _column == rhs._column
+                   && _offset == rhs._offset && _length == rhs._length;
         }
 
         TokenType GetType() const { return _type; };
 
-        std::any GetValue() const { return _value; };
+        std::pair<uint64_t, uint64_t> GetStartPos() const { return std::make_pair(_line, _column); }
+
+        // token 在源码中的范围，结束位置的 <行号，列号> 由 Tokenizer::GetEndPos 给出
+        std::size_t GetOffset() const { return _offset; }
+
+        std::size_t GetLength() const { return _length; }
+
+        // 下面几个函数只能取 token 实际存放的类型
+        int32_t GetInt() const { return _value.i; }
+
+        double GetDouble() const { return _value.d; }
 
-        std::pair<uint64_t, uint64_t> GetStartPos() const { return _start_pos; }
+        char GetChar() const { return _value.c; }
 
-        std::pair<uint64_t, uint64_t> GetEndPos() const { return _end_pos; }
+        // 标识符、关键字等 token 的值，不复制
+        const std::string &GetString() const { return *_value.s; }
 
         std::string GetValueString() const {
-            try {
-                return std::any_cast<std::string>(_value);
-            }
-            catch (const std::bad_any_cast &) {}
-            try {
-                return std::string(1, std::any_cast<char>(_value));
-            }
-            catch (const std::bad_any_cast &) {}
-            try {
-                return std::to_string(std::any_cast<int32_t>(_value));
-            }
-            catch (const std::bad_any_cast &) {}
-            try {
-                return std::to_string(std::any_cast<double>(_value));
-            }
-            catch (const std::bad_any_cast &) {
-                DieAndPrint("No suitable cast for token value.");
+            switch (_kind) {
+                case STRING_VALUE:
+                    return *_value.s;
+                case CHAR_VALUE:
+                    return std::string(1, _value.c);
+                case INT_VALUE:
+                    return std::to_string(_value.i);
+                case DOUBLE_VALUE:
+                    return std::to_string(_value.d);
+                default:
+                    DieAndPrint("No suitable cast for token value.");
             }
             return "Invalid";
         }
 
+    private:
+        Token(TokenType type, ValueKind kind, std::pair<uint64_t, uint64_t> pos, std::size_t offset, std::size_t length)
+                : _type(type), _kind(kind), _offset(static_cast<uint32_t>(offset)),
+                  _length(static_cast<uint32_t>(length)), _line(static_cast<uint32_t>(pos.first)),
+                  _column(static_cast<uint32_t>(pos.second)) { _value.s = nullptr; }
+
+        bool sameValue(const Token &rhs) const {
+            if (_kind != rhs._kind)
+                return false;
+            switch (_kind) {
+                case STRING_VALUE:
+                    return _value.s == rhs._value.s || *_value.s == *rhs._value.s;
+                case CHAR_VALUE:
+                    return _value.c == rhs._value.c;
+                case INT_VALUE:
+                    return _value.i == rhs._value.i;
+                case DOUBLE_VALUE:
+                    return _value.d == rhs._value.d;
+                default:
+                    return true;
+            }
+        }
+
     private:
         TokenType _type;
-        std::any _value;
-        std::pair<uint64_t, uint64_t> _start_pos;
-        std::pair<uint64_t, uint64_t> _end_pos;
+        ValueKind _kind;
+        // Tokenizer 不接受超过 4GiB 的源码，32 位足够
+        uint32_t _offset;
+        uint32_t _length;
+        uint32_t _line;
+        uint32_t _column;
+        union {
+            int32_t i;
+            double d;
+            char c;
+            const std::string *s;
+        } _value;
     };
-
-    inline void swap(Token &lhs, Token &rhs) {
-        using std::swap;
-        swap(lhs._type, rhs._type);
-        swap(lhs._value, rhs._value);
-        swap(lhs._start_pos, rhs._start_pos);
-        swap(lhs._end_pos, rhs._end_pos);
-    }
-}
\ No newline at end of file
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "tokenizer/tokenizer.h"
+#include "error/error.h"
+#include "src/time_report.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace cc0 {
+
+	// Tokenizer 与 Analyser 之间的 token 流
+	// 按需调用 Tokenizer::NextToken，环形缓冲区中只保留最近读到的 Capacity 个 token，
+	// 内存占用与源码中 token 的数量无关
+	class TokenStream final {
+	public:
+		// 每次读入时向前多读的 token 数，计时的开销因此分摊到多个 token 上
+		static constexpr std::size_t Lookahead = 8;
+		// Analyser 最多连续回退 4 个 token（extern int f(），回退之后还要取前一个 token 的位置，
+		// 加上多读的 Lookahead + 1 个不超过 Capacity
+		static constexpr std::size_t Capacity = 16;
+
+		// report 不为空时，读 token 的时间记为 tokenize 阶段
+		explicit TokenStream(Tokenizer& tkz, vm::TimeReport* report = nullptr) : _tkz(tkz), _report(report) {}
+		TokenStream(const TokenStream&) = delete;
+		TokenStream& operator=(const TokenStream&) = delete;
+
+		// 下标为 index 的 token，读完或者遇到词法错误时返回 nullptr
+		// 已经移出缓冲区的 token 不能再取
+		const Token* at(std::size_t index) {
+			if (_count <= index && !_end) {
+				vm::TimeReport::Scope scope(_report, "tokenize");
+				while (_count <= index + Lookahead && !_end)
+					fetch();
+			}
+			if (index >= _count)
+				return nullptr;
+			if (_count - index > Capacity)
+				DieAndPrint("analyser unreads more tokens than the lookahead buffer holds.");
+			return &_buffer[index % Capacity].value();
+		}
+
+		// 已经读到的 token 数
+		std::size_t count() const { return _count; }
+
+		// token 结束位置的 <行号，列号>
+		std::pair<std::uint64_t, std::uint64_t> endPos(const Token& t) { return _tkz.GetEndPos(t); }
+
+		// 读完剩下的 token，返回遇到的词法错误
+		// 与一次读入所有 token 一样，词法错误优先于语法错误
+		std::optional<CompilationError> drain() {
+			vm::TimeReport::Scope scope(_end ? nullptr : _report, "tokenize");
+			while (!_end)
+				fetch();
+			return _error;
+		}
+
+	private:
+		void fetch() {
+			auto p = _tkz.NextToken();
+			if (p.second.has_value()) {
+				if (p.second.value().GetCode() != ErrorCode::ErrEOF)
+					_error = p.second;
+				_end = true;
+				return;
+			}
+			_buffer[_count % Capacity] = std::move(p.first);
+			_count++;
+		}
+
+	private:
+		Tokenizer& _tkz;
+		vm::TimeReport* _report;
+		std::array<std::optional<Token>, Capacity> _buffer;
+		// 已经读到的 token 数
+		std::size_t _count = 0;
+		bool _end = false;
+		std::optional<CompilationError> _error;
+	};
+}
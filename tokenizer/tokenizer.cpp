@@ -1,14 +1,61 @@
 #include "tokenizer/tokenizer.h"
+#include "tokenizer/keyword.h"
+#include "tokenizer/scan.h"
 
+#include <algorithm>
+#include <array>
 #include <cctype>
-#include <sstream>
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
 
 namespace cc0 {
 
+    // 十进制的数字串，超出 int32_t 的范围时没有值
+    static std::optional<int32_t> toInt32(std::string_view digits) {
+        int32_t re = 0;
+        auto result = std::from_chars(digits.data(), digits.data() + digits.size(), re);
+        if (result.ec != std::errc())
+            return {};
+        return re;
+    }
+
+    // 0x 开头的十六进制数，与 strtoul(str, nullptr, 16) 一样，溢出时为 ULONG_MAX，0x 之后没有数字时为 0
+    static unsigned long toULong(std::string_view str) {
+        str.remove_prefix(2);
+        unsigned long re = 0;
+        auto result = std::from_chars(str.data(), str.data() + str.size(), re, 16);
+        if (result.ec == std::errc::result_out_of_range)
+            return std::numeric_limits<unsigned long>::max();
+        return re;
+    }
+
+    // 与读入 double 一样，溢出时为 ±DBL_MAX，. 开头的按 0. 解析
+    // 整个字符串不是一个浮点数时为 0，如 . 之后没有数字，或者 1e+-5 这样有多个正负号的指数
+    static double toDouble(std::string_view str) {
+        double re = 0;
+        auto result = std::from_chars(str.data(), str.data() + str.size(), re);
+        if (result.ec == std::errc::invalid_argument || result.ptr != str.data() + str.size())
+            return 0;
+        // 上溢和下溢时 from_chars 不给出结果，这种很少见的情况仍然交给 strtod
+        if (result.ec == std::errc::result_out_of_range) {
+            std::string s = str.front() == '.' ? "0" : "";
+            s.append(str);
+            re = std::strtod(s.c_str(), nullptr);
+            if (std::isinf(re))
+                return re > 0 ? DBL_MAX : -DBL_MAX;
+        }
+        return re;
+    }
+
     std::pair<std::optional<Token>, std::optional<CompilationError>> Tokenizer::NextToken() {
         if (!_initialized)
             readAll();
-        if (_rdr.bad())
+        // Token 中的偏移量只有 32 位
+        if ((_rdr && _rdr->bad()) || _source.size() > UINT32_MAX)
             return std::make_pair(std::optional<Token>(),
                                   std::make_optional<CompilationError>(0, 0, ErrorCode::ErrStreamError));
         if (isEOF())
@@ -39,802 +86,201 @@ namespace cc0 {
 
     // 注意：这里的返回值中 Token 和 CompilationError 只能返回一个，不能同时返回。
     std::pair<std::optional<Token>, std::optional<CompilationError>> Tokenizer::nextToken() {
-        // 用于存储已经读到的组成当前token字符
-        std::stringstream ss;
-        // 分析token的结果，作为此函数的返回值
-        std::pair<std::optional<Token>, std::optional<CompilationError>> result;
-        // <行号，列号>，表示当前token的第一个字符在源代码中的位置
-        std::pair<int64_t, int64_t> pos;
+        // 当前token的第一个字符的偏移量，读到的字符不再复制，token 的内容就是缓冲区中 [start, _ptr) 的部分
+        std::size_t start = 0;
+        const auto text = [&] { return _source.substr(start, _ptr - start); };
+        // <行号，列号>，表示当前token的第一个字符在源代码中的位置，只在返回 token 或者错误时才计算
+        const auto pos = [&] { return std::pair<int64_t, int64_t>(position(start)); };
         // 记录当前自动机的状态，进入此函数时是初始状态
-        DFAState current_state = DFAState::INITIAL_STATE;
-        // 这是一个死循环，除非主动跳出
-        // 每一次执行while内的代码，都可能导致状态的变更
+        auto state = dfa::INITIAL_STATE;
+        // 读到的字符是一个token的第一个字符
+        const auto begin = [&] { start = _ptr - 1; };
+        // 返回 type 类型、值为 value 的 token
+        const auto token = [&](TokenType type, auto value) {
+            return std::make_pair(std::make_optional<Token>(type, value, pos(), start, _ptr - start),
+                                  std::optional<CompilationError>());
+        };
+        // 每次循环读一个字符，做什么完全由 dfa::Transitions 决定
         while (true) {
-            // 读一个字符，请注意auto推导得出的类型是std::optional<char>
-            // 这里其实有两种写法
-            // 1. 每次循环前立即读入一个 char
-            // 2. 只有在可能会转移的状态读入一个 char
-            // 因为我们实现了 unread，为了省事我们选择第一种
-            auto current_char = nextChar();
-            // 针对当前的状态进行不同的操作
-            switch (current_state) {
-                // 初始状态
-                // 这个 case 我们给出了核心逻辑，但是后面的 case 不用照搬。
-                case INITIAL_STATE: {
-                    // 已经读到了文件尾
-                    if (!current_char.has_value())
-                        // 返回一个空的token，和编译错误ErrEOF：遇到了文件尾
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(0, 0, ErrEOF));
-
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    // 标记是否读到了不合法的字符，初始化为否
-                    auto invalid = false;
-
-                    // 使用了自己封装的判断字符类型的函数，定义于 tokenizer/utils.hpp
-                    // see https://en.cppreference.com/w/cpp/string/byte/isblank
-                    if (cc0::isspace(ch)) // 读到的字符是空白字符（空格、换行、制表符等）
-                        current_state = DFAState::INITIAL_STATE; // 保留当前状态为初始状态，此处直接break也是可以的
-                    else if (!cc0::isprint(ch)) // control codes and backspace
-                        invalid = true;
-                    else if (ch == '0') current_state = DFAState::ZERO_STATE;
-                    else if (cc0::isdigit(ch)) // 读到的字符是数字
-                        current_state = DFAState::DEC_STATE; // 切换到无符号整数的状态
-                    else if (cc0::isalpha(ch)) // 读到的字符是英文字母
-                        current_state = DFAState::IDENTIFIER_STATE; // 切换到标识符的状态
-                    else {
-                        switch (ch) {
-                            case '=': // 如果读到的字符是`=`，则切换到等于号的状态
-                                current_state = DFAState::EQUAL_SIGN_STATE;
-                                break;
-                            case '-':
-                                // 请填空：切换到减号的状态
-                                current_state = DFAState::MINUS_SIGN_STATE;
-                                break;
-                            case '+':
-                                // 请填空：切换到加号的状态
-                                current_state = DFAState::PLUS_SIGN_STATE;
-                                break;
-                            case '*':
-                                // 请填空：切换状态
-                                current_state = DFAState::MULTIPLICATION_SIGN_STATE;
-                                break;
-                            case '/':
-                                // 请填空：切换状态
-                                current_state = DFAState::DIVISION_SIGN_STATE;
-                                break;
-                                // 切换到对应的状态
-                            case ';':
-                                current_state = DFAState::SEMICOLON_STATE;
-                                break;
-                            case ')':
-                                current_state = DFAState::RIGHT_PAREN_STATE;
-                                break;
-                            case '(':
-                                current_state = DFAState::LEFT_PAREN_STATE;
-                                break;
-                            case '{':
-                                current_state = DFAState::LEFT_BRACE_STATE;
-                                break;
-                            case '}':
-                                current_state = DFAState::RIGHT_BRACE_STATE;
-                                break;
-                            case '>':
-                                current_state = DFAState::GREATER_SIGN_STATE;
-                                break;
-                            case '<':
-                                current_state = DFAState::LESS_SIGN_STATE;
-                                break;
-                            case '!':
-                                current_state = DFAState::NOT_EQ_STATE;
-                                break;
-                            case ',':
-                                current_state = DFAState::COMMA_STATE;
-                                break;
-                            case ':':
-                                current_state = DFAState::COLON_STATE;
-                                break;
-                            case '"':
-                                current_state = DFAState::STRING_STATE;
-                                break;
-                            case '.':
-                                ss << '0';
-                                current_state = DFAState::DOT_STATE;
-                                break;
-                            case '\'':
-                                current_state = DFAState::CHAR_STATE;
-                                break;
-                                // 不接受的字符导致的不合法的状态
-                            default:
-                                invalid = true;
-                                break;
-                        }
-                    }
-                    // 如果读到的字符导致了状态的转移，说明它是一个token的第一个字符
-                    if (current_state != DFAState::INITIAL_STATE)
-                        pos = previousPos(); // 记录该字符的的位置为token的开始位置
-                    // 读到了不合法的字符
-                    if (invalid) {
-                        // 回退这个字符
-                        unreadLast();
-                        // 返回编译错误：非法的输入
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
-                    }
-                    // 如果读到的字符导致了状态的转移，说明它是一个token的第一个字符
-                    if (current_state != DFAState::INITIAL_STATE) // ignore white spaces
-                        ss << ch; // 存储读到的字符
+            // 文件尾也是一类字符
+            auto cls = isEOF() ? dfa::END_OF_FILE : dfa::classOf(_source[_ptr++]);
+            auto transition = dfa::Transitions[state][cls];
+            // 不属于当前 token 的字符先回退
+            _ptr -= transition.unread;
+            switch (transition.action) {
+                case dfa::MOVE:
+                    state = transition.state();
                     break;
-                }
-                    // 当前状态是无符号整数
-                case DEC_STATE: {
-                    // 如果当前已经读到了文件尾，则解析已经读到的字符串为整数
-                    //     解析成功则返回无符号整数类型的token，否则返回编译错误
-                    if (!current_char.has_value()) {
-                        int64_t re = 0;
-                        try {
-                            ss >> re;
-                            if (INT32_MIN <= re && re <= INT32_MAX)
-                                return std::make_pair(
-                                        std::make_optional<Token>(TokenType::INTEGER, (int32_t) re, pos,
-                                                                  currentPos()),
-                                        std::optional<CompilationError>());
-                            else
-                                return std::make_pair(std::optional<Token>(),
-                                                      std::make_optional<CompilationError>(pos,
-                                                                                           ErrorCode::ErrInvalidInput));
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                    }
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-
-                    // 如果读到的字符是数字，则存储读到的字符
-                    if (isdigit(ch))
-                        ss << ch;
-                        // 如果读到的是字母，则存储读到的字符，并切换状态到标识符
-                    else if (ch == '.') {
-                        ss << ch;
-                        current_state = DFAState::DOT_STATE;
-                    } else if (ch == 'e' || ch == 'E') {
-                        ss << ch;
-                        current_state = DFAState::DOUBLE_E_STATE;
-                    }
-                        // 如果读到的字符不是上述情况之一，则回退读到的字符，并解析已经读到的字符串为整数
-                        //     解析成功则返回无符号整数类型的token，否则返回编译错误
-                    else {
-                        unreadLast();
-                        int64_t re = 0;
-                        try {
-                            ss >> re;
-                            if (INT32_MIN <= re && re <= INT32_MAX)
-                                return std::make_pair(
-                                        std::make_optional<Token>(TokenType::INTEGER, (int32_t) re, pos,
-                                                                  currentPos()),
-                                        std::optional<CompilationError>());
-                            else
-                                return std::make_pair(std::optional<Token>(),
-                                                      std::make_optional<CompilationError>(pos,
-                                                                                           ErrorCode::ErrIntegerOverflow));
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrIntegerOverflow));
-                        }
-                    }
-                    if (!isprint(ch)) {
-                        // 输入符号不在上述范围内，显然有错
-                        // 回退这个字符
-                        unreadLast();
-                        // 返回编译错误：非法的输入
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
-                    }
+                case dfa::START:
+                    begin();
+                    state = transition.state();
                     break;
-                }
-
-                case ZERO_STATE: {
-                    // 如果当前已经读到了文件尾,返回编译错误
-                    if (!current_char.has_value()) {
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
-                    }
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-
-                    // 如果读到的是x，0x HEX
-                    if (ch == 'X' || ch == 'x') {
-                        ss << ch;
-                        current_state = DFAState::HEX_STATE;
-                    } else if (ch == '.') {
-                        ss << ch;
-                        current_state = DFAState::DOT_STATE;
-                    } else if (ch == 'e' || ch == 'E') {
-                        ss << ch;
-                        current_state = DFAState::DOUBLE_E_STATE;
-                    }
-                        // 如果读到的字符不是上述情况之一，则返回编译错误
-                    else {
-                        unreadLast();
-                        if (!isdigit(ch))
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::INTEGER, 0, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
-
-                    }
-                    if (!isprint(ch)) {
-                        // 输入符号不在上述范围内，显然有错
-                        // 回退这个字符
-                        unreadLast();
-                        // 返回编译错误：非法的输入
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
-                    }
+                case dfa::SKIP_SPACE:
+                    advance(scan::skipSpace);
                     break;
-                }
-                case IDENTIFIER_STATE: {
-                    // 请填空：
-                    // 如果当前已经读到了文件尾，则解析已经读到的字符串
-                    //     如果解析结果是关键字，那么返回对应关键字的token，否则返回标识符的token
-                    if (!current_char.has_value()) {
-                        try {
-                            auto str = ss.str();
-                            return parseIdentifier(str, pos);
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                    }
-                    auto ch = current_char.value();
-                    // 如果读到的是字符或字母，则存储读到的字符
-                    if (isalpha(ch)) {
-                        ss << ch;
-                    } else if (isdigit(ch)) {
-                        ss << ch;
-                    }
-                        // 如果读到的字符不是上述情况之一，则回退读到的字符，并解析已经读到的字符串
-                        //     如果解析结果是关键字，那么返回对应关键字的token，否则返回标识符的token
-                    else {
-                        unreadLast();
-                        try {
-                            auto str = ss.str();
-                            return parseIdentifier(str, pos);
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                    }
+                case dfa::SKIP_DIGITS:
+                    advance(scan::skipDigits);
                     break;
-                }
-                case DOT_STATE: {
-                    if (!current_char.has_value()) {
-                        double re;
-                        try {
-                            ss >> re;
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::FLOAT, (double) re, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                    }
-                    auto ch = current_char.value();
-                    // 如果读到的是字符或字母，则存储读到的字符
-                    if (isdigit(ch)) {
-                        ss << ch;
-                    } else if (ch == 'e' || ch == 'E') {
-                        ss << ch;
-                        current_state = DOUBLE_E_STATE;
-                    } else {
-                        unreadLast();
-                        double re;
-                        try {
-                            ss >> re;
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::FLOAT, re, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                    }
-
-                    break;
-                }
-                case DOUBLE_E_STATE: {
-                    // e digit [+|-]{0-9}
-                    if (!current_char.has_value())
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
-
-                    auto ch = current_char.value();
-                    // 如果读到的是字符或字母，则存储读到的字符
-                    if (ch == '+' || ch == '-') {
-                        ss << ch;
-                    } else if (isdigit(ch)) {
-                        ss << ch;
-                        double re;
-                        try {
-                            ss >> re;
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::FLOAT, re, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                    } else {
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
-                    }
-
+                case dfa::LINE_COMMENT:
+                    // 行尾的 \n 或 \r 在初始状态作为空白字符跳过
+                    advance(scan::findLineEnd);
+                    state = dfa::INITIAL_STATE;
                     break;
-
-                }
-                case HEX_STATE: {
-                    // 如果当前已经读到了文件尾，则解析
-                    if (!current_char.has_value()) {
-                        try {
-                            char str[66];
-                            ss.str().assign(str);
-                            int64_t in = strtoul(str, nullptr, 16);
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::INTEGER, (int32_t) in, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                    }
-                    auto ch = current_char.value();
-                    // 如果读到的是字符或字母，则存储读到的字符
-                    if (isxdigit(ch)) {
-                        ss << ch;
-                    }
-                        // 如果读到的字符不是上述情况之一，则回退读到的字符，并解析已经读到的字符串
-                    else {
-                        unreadLast();
-                        try {
-                            char str[66];
-//                            std::cout << ss.str();
-                            ss >> str;
-                            int64_t in = strtoul(str, nullptr, 16);
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::INTEGER, (int32_t) in, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
+                case dfa::BLOCK_COMMENT:
+                    // 多行注释只可能在 * 处结束
+                    while (true) {
+                        advance(scan::findStar);
+                        if (isEOF())
                             return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
+                                                  std::make_optional<CompilationError>(pos(), ErrorCode::ErrNoCommentEnd));
+                        if (++_ptr < _source.size() && _source[_ptr] == '/')
+                            break;
                     }
+                    ++_ptr;
+                    state = dfa::INITIAL_STATE;
                     break;
-                }
-                case CHAR_STATE: {
-                    //如果当前已经读到了文件尾，则解析
-                    //解析成功则返回CHAR类型的token，否则返回编译错误
-                    if (!current_char.has_value())
+                case dfa::INTEGER_TOKEN: {
+                    auto re = toInt32(text());
+                    if (!re.has_value())
                         return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
-                    std::string a;
-                    ss >> a;
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    char re =0;
-                    // 如果读到的字符是数字，则存储读到的字符
-                    if (ch == '\\') {
-
-                        current_char = nextChar();
-                        ch = current_char.value();
-                        if (ch == 'x') {
-                            current_char = nextChar();
-                            ch = current_char.value();
-                            if (!isxdigit(ch))
-                                return std::make_pair(std::optional<Token>(),
-                                                      std::make_optional<CompilationError>(pos,
-                                                                                           ErrorCode::ErrIntegerOverflow));
-                            // digit
-                            char str[3];
-                            str[2] = '\0';
-                            str[0] = ch;
-
-                            current_char = nextChar();
-                            ch = current_char.value();
-                            if (!isxdigit(ch))
-                                return std::make_pair(std::optional<Token>(),
-                                                      std::make_optional<CompilationError>(pos,
-                                                                                           ErrorCode::ErrIntegerOverflow));
-                            // digit
-                            str[1] = ch;
-                            int32_t in = strtoul(str, nullptr, 16);
-                            re += in;
-
-                        } else {
-                            switch (ch) {
-                                case '\\' :
-                                    re = '\\';
-                                    break;
-                                case '\'' :
-                                    re = '\'';
-                                    break;
-                                case 'n' :
-                                    re = '\n';
-                                    break;
-                                case 'r' :
-                                    re = '\r';
-                                    break;
-                                case 't' :
-                                    re = '\t';
-                                    break;
-
-                            }
-                        }
-                    } else {
-                        ss << ch;
-                        re = ch;
-                    }
-                    current_char = nextChar();
-                    ch = current_char.value();
-
-                    if (ch == '\'') {
-
-                        try {
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::CHAR_LIT, (char) re, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                        break;
-                    }
-
-                    unreadLast();
+                                              std::make_optional<CompilationError>(pos(), ErrorCode::ErrIntegerOverflow));
+                    return token(transition.type(), re.value());
+                }
+                case dfa::HEX_TOKEN:
+                    return token(transition.type(), (int32_t) (int64_t) toULong(text()));
+                case dfa::FLOAT_TOKEN:
+                    return token(transition.type(), toDouble(text()));
+                case dfa::CHAR_TOKEN:
+                    return token(transition.type(), _source[start]);
+                case dfa::STRING_TOKEN:
+                    return token(transition.type(), intern(text()));
+                case dfa::OPERATOR:
+                    begin();
+                    return token(transition.type(), _source[start]);
+                case dfa::IDENTIFIER_START:
+                    begin();
+                    advance(scan::skipIdentifier);
+                    return parseIdentifier(text(), pos());
+                case dfa::STRING_START:
+                    begin();
+                    return parseString(nextChar(), start, pos());
+                case dfa::CHAR_START:
+                    begin();
+                    return parseChar(nextChar(), start, pos());
+                case dfa::FAIL:
                     return std::make_pair(std::optional<Token>(),
-                                          std::make_optional<CompilationError>(pos,
-                                                                               ErrorCode::ErrIntegerOverflow));
-
+                                          std::make_optional<CompilationError>(pos(), transition.error()));
+                case dfa::FINISH:
+                    // 返回一个空的token，和编译错误ErrEOF：遇到了文件尾
+                    return std::make_pair(std::optional<Token>(),
+                                          std::make_optional<CompilationError>(0, 0, ErrEOF));
+                    // 预料之外的状态，如果执行到了这里，说明程序异常
+                default:
+                    DieAndPrint("unhandled state.");
                     break;
-                }
-                case STRING_STATE: {
-                    //如果当前已经读到了文件尾，则解析
-                    //解析成功则返回CHAR类型的token，否则返回编译错误
-                    if (!current_char.has_value())
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
+            }
+        }
+    }
 
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    // "
-                    ss << current_char.value();
+    std::pair<std::optional<Token>, std::optional<CompilationError>>
+    Tokenizer::parseChar(std::optional<char> current_char, std::size_t start, std::pair<int64_t, int64_t> pos) {
+        //如果当前已经读到了文件尾，则解析
+        //解析成功则返回CHAR类型的token，否则返回编译错误
+        if (!current_char.has_value())
+            return std::make_pair(std::optional<Token>(),
+                                  std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
+        // 获取读到的字符的值，注意auto推导出的类型是char
+        auto ch = current_char.value();
+        char re = 0;
+        if (ch == '\\') {
+            current_char = nextChar();
+            ch = current_char.value();
+            if (ch == 'x') {
+                // 两个十六进制数字
+                char str[2];
+                for (auto &digit : str) {
                     current_char = nextChar();
-
-                    auto ch = current_char.value();
-                    while (ch != '\"') {
-                        if (ch == '\\') {
-                            ss << ch;
-                            current_char = nextChar();
-                            ch = current_char.value();
-                            if (ch == 'x') {
-                                ss << ch;
-                                current_char = nextChar();
-                                ch = current_char.value();
-                                ss << ch;
-                                current_char = nextChar();
-                                ch = current_char.value();
-                            }
-                        } else {
-                            if (!isprint(ch))
-                                return std::make_pair(std::optional<Token>(),
-                                                      std::make_optional<CompilationError>(pos,
-                                                                                           ErrorCode::ErrInvalidInput));
-                            ss << ch;
-                            current_char = nextChar();
-                            ch = current_char.value();
-                        }
-                    }
-                    ss << ch;
-                    std::string re;
-                    try {
-                        ss >> re;
-                        return std::make_pair(
-                                std::make_optional<Token>(TokenType::STRING, (std::string) re, pos,
-                                                          currentPos()),
-                                std::optional<CompilationError>());
-                    } catch (ErrorCode) {
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
-                    }
-
-
-                    break;
-                }
-                case NOT_EQ_STATE: {
-                    // 如果当前已经读到了文件尾，则返回编译错误
-                    if (!current_char.has_value()) {
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
-                    }
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-
-                    if (ch == '=') {
-                        ss << ch;
-                        try {
-                            auto str = ss.str();
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::EQUAL_EQ, str, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrInvalidInput));
-                        }
-                    } else {
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
-                    }
-                }
-                case LESS_SIGN_STATE: {
-                    // 如果当前已经读到了文件尾，则返回编译错误
-                    if (!current_char.has_value()) {
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
-                    }
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    if (ch == '=') {
-                        ss << ch;
-                        try {
-                            auto str = ss.str();
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::LESS_EQ, str, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrIntegerOverflow));
-                        }
-                    } else {
-                        unreadLast();
-                        try {
-                            auto str = ss.str();
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::LESS, str, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrIntegerOverflow));
-                        }
-                    }
-                }
-                case GREATER_SIGN_STATE: {
-                    // 如果当前已经读到了文件尾，则返回编译错误
-                    if (!current_char.has_value()) {
+                    ch = current_char.value();
+                    if (!isxdigit(ch))
                         return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrInvalidInput));
-                    }
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    if (ch == '=') {
-                        ss << ch;
-                        try {
-                            auto str = ss.str();
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::GREATER_EQ, str, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrIntegerOverflow));
-                        }
-                    } else {
-                        unreadLast();
-                        try {
-                            auto str = ss.str();
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::GREATER, str, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrIntegerOverflow));
-                        }
-                    }
-                }
-                    // 当前状态为=号的状态
-                case EQUAL_SIGN_STATE: {
-                    // 获取读到的字符的值，注意auto推导出的类型是char
-                    auto ch = current_char.value();
-                    if (ch == '=') {
-                        ss << ch;
-                        try {
-                            auto str = ss.str();
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::EQUAL_EQ, str, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrIntegerOverflow));
-                        }
-                    } else {
-                        unreadLast();
-                        try {
-                            auto str = ss.str();
-                            return std::make_pair(
-                                    std::make_optional<Token>(TokenType::EQUAL_SIGN, str, pos,
-                                                              currentPos()),
-                                    std::optional<CompilationError>());
-                        } catch (ErrorCode) {
-                            return std::make_pair(std::optional<Token>(),
-                                                  std::make_optional<CompilationError>(pos,
-                                                                                       ErrorCode::ErrIntegerOverflow));
-                        }
-                    }
+                                              std::make_optional<CompilationError>(pos, ErrorCode::ErrIntegerOverflow));
+                    digit = ch;
                 }
-                    // 如果当前状态是加号
-                case PLUS_SIGN_STATE: {
-                    // 请思考这里为什么要回退，在其他地方会不会需要
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(std::make_optional<Token>(TokenType::PLUS_SIGN, '+', pos, currentPos()),
-                                          std::optional<CompilationError>());
-                }
-                    // 当前状态为减号的状态
-                case MINUS_SIGN_STATE: {
-                    // 请填空：回退，并返回减号token
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(std::make_optional<Token>(TokenType::MINUS_SIGN, '-', pos, currentPos()),
-                                          std::optional<CompilationError>());
-                }
-
-                    // 当前状态为*号的状态
-                case MULTIPLICATION_SIGN_STATE: {
-                    // 请填空：回退，并返回减号token
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(
-                            std::make_optional<Token>(TokenType::MULTIPLICATION_SIGN, '*', pos, currentPos()),
-                            std::optional<CompilationError>());
-                }
-                    // 当前状态为;号的状态
-                case SEMICOLON_STATE: {
-                    // 请填空：回退，并返回减号token
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(std::make_optional<Token>(TokenType::SEMICOLON, ';', pos, currentPos()),
-                                          std::optional<CompilationError>());
-                }
-                    // 当前状态为(号的状态
-                case LEFT_PAREN_STATE: {
-                    // 请填空：回退，并返回减号token
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(std::make_optional<Token>(TokenType::LEFT_PAREN, '(', pos, currentPos()),
-                                          std::optional<CompilationError>());
-                }
-                    // 当前状态为)号的状态
-                case RIGHT_PAREN_STATE: {
-                    // 请填空：回退，并返回减号token
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(std::make_optional<Token>(TokenType::RIGHT_PAREN, ')', pos, currentPos()),
-                                          std::optional<CompilationError>());
-                }    // 当前状态为{号的状态
-                case LEFT_BRACE_STATE: {
-                    // 请填空：回退，并返回减号token
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(std::make_optional<Token>(TokenType::LEFT_BRACE, '{', pos, currentPos()),
-                                          std::optional<CompilationError>());
-                }
-                    // 当前状态为}号的状态
-                case RIGHT_BRACE_STATE: {
-                    // 请填空：回退，并返回减号token
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(std::make_optional<Token>(TokenType::RIGHT_BRACE, '}', pos, currentPos()),
-                                          std::optional<CompilationError>());
-                }
-                    // 当前状态为,号的状态
-                case COMMA_STATE: {
-                    // 请填空：回退，并返回减号token
-                    unreadLast(); // Yes, we unread last char even if it's an EOF.
-                    return std::make_pair(std::make_optional<Token>(TokenType::COMMA, ',', pos, currentPos()),
-                                          std::optional<CompilationError>());
+                int32_t in = 0;
+                std::from_chars(str, str + 2, in, 16);
+                re += in;
+            } else {
+                switch (ch) {
+                    case '\\' :
+                        re = '\\';
+                        break;
+                    case '\'' :
+                        re = '\'';
+                        break;
+                    case 'n' :
+                        re = '\n';
+                        break;
+                    case 'r' :
+                        re = '\r';
+                        break;
+                    case 't' :
+                        re = '\t';
+                        break;
                 }
+            }
+        } else {
+            re = ch;
+        }
+        current_char = nextChar();
+        ch = current_char.value();
+        if (ch == '\'')
+            return std::make_pair(std::make_optional<Token>(TokenType::CHAR_LIT, re, pos, start, _ptr - start),
+                                  std::optional<CompilationError>());
+        unreadLast();
+        return std::make_pair(std::optional<Token>(),
+                              std::make_optional<CompilationError>(pos, ErrorCode::ErrIntegerOverflow));
+    }
 
-
-                    // 当前状态为/号的状态
-                case DIVISION_SIGN_STATE: {
-                    auto ch = current_char.value();
-                    if (ch == '/') {
-                        current_state = DFAState::COMMENT_ONE_STATE;
-                    } else if (ch == '*') {
-                        current_state = DFAState::COMMENT_MORE_STATE;
-                    } else {
-                        // 请填空：回退，并返回减号token
-                        unreadLast(); // Yes, we unread last char even if it's an EOF.
-                        return std::make_pair(
-                                std::make_optional<Token>(TokenType::DIVISION_SIGN, '/', pos, currentPos()),
-                                std::optional<CompilationError>());
-                    }
-                    break;
-                }
-                case COMMENT_ONE_STATE: {
-                    auto ch = current_char.value();
-                    if (ch == '\n' || ch == '\r') {
-                        ss.str("");
-                        current_state = DFAState::INITIAL_STATE;
-                    }
-                    break;
-                }
-                case COMMENT_MORE_STATE: {
-                    // 如果当前已经读到了文件尾，则返回编译错误
-                    if (!current_char.has_value()) {
-                        return std::make_pair(std::optional<Token>(),
-                                              std::make_optional<CompilationError>(pos,
-                                                                                   ErrorCode::ErrNoCommentEnd));
-                    }
-                    auto ch = current_char.value();
-                    if (ch == '*') {
-                        auto re = nextChar().value();
-                        if (re == '/') {
-                            current_state = DFAState::INITIAL_STATE;
-                            ss.str("");
-                        } else unreadLast();
-                    }
-                    break;
+    std::pair<std::optional<Token>, std::optional<CompilationError>>
+    Tokenizer::parseString(std::optional<char> current_char, std::size_t start, std::pair<int64_t, int64_t> pos) {
+        //如果当前已经读到了文件尾，则返回编译错误
+        if (!current_char.has_value())
+            return std::make_pair(std::optional<Token>(),
+                                  std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
+        // " 之后的第一个字符不检查
+        current_char = nextChar();
+        auto ch = current_char.value();
+        while (ch != '\"') {
+            if (ch == '\\') {
+                current_char = nextChar();
+                ch = current_char.value();
+                if (ch == 'x') {
+                    current_char = nextChar();
+                    ch = current_char.value();
+                    current_char = nextChar();
+                    ch = current_char.value();
                 }
-                    // 预料之外的状态，如果执行到了这里，说明程序异常
-                default:
-                    DieAndPrint("unhandled state.");
-                    break;
+            } else {
+                if (!isprint(ch))
+                    return std::make_pair(std::optional<Token>(),
+                                          std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
+                // 一直到下一个需要处理的字符都是可打印的普通字符
+                advance(scan::findStringSpecial);
+                current_char = nextChar();
+                ch = current_char.value();
             }
         }
-        // 预料之外的状态，如果执行到了这里，说明程序异常
-        return
-
-                std::make_pair(std::optional<Token>(), std::optional<CompilationError>()
-
-                );
+        // 与读入 std::string 一样，在第一个空白字符处截断
+        auto literal = _source.substr(start, _ptr - start);
+        auto re = intern(literal.substr(0, literal.find_first_of(" \t\n\v\f\r")));
+        return std::make_pair(std::make_optional<Token>(TokenType::STRING, re, pos, start, _ptr - start),
+                              std::optional<CompilationError>());
     }
 
     std::optional<CompilationError> Tokenizer::checkToken(const Token &t) {
         switch (t.GetType()) {
             case IDENTIFIER: {
-                auto val = t.GetValueString();
-                if (cc0::isdigit(val[0]))
+                if (cc0::isdigit(t.GetString()[0]))
                     return std::make_optional<CompilationError>(t.GetStartPos().first, t.GetStartPos().second,
                                                                 ErrorCode::ErrInvalidIdentifier);
                 break;
@@ -848,138 +294,96 @@ namespace cc0 {
     void Tokenizer::readAll() {
         if (_initialized)
             return;
-        for (std::string tp; std::getline(_rdr, tp);)
-            _lines_buffer.emplace_back(std::move(tp + "\n"));
+        if (_rdr)
+            _storage.assign(std::istreambuf_iterator<char>(*_rdr), std::istreambuf_iterator<char>());
+        else
+            _storage.clear();
+        // 与按行读入再给每行加上 \n 一样，最后一行没有 \n 时补上
+        if (_rdr || (!_source.empty() && _source.back() != '\n')) {
+            if (!_rdr)
+                _storage.assign(_source);
+            if (!_storage.empty() && _storage.back() != '\n')
+                _storage.push_back('\n');
+            _source = _storage;
+        }
+        // 缓冲区以 \n 结尾，最后一个 \n 之后的偏移量就是缓冲区的长度
+        _line_starts.clear();
+        _line_starts.push_back(0);
+        for (auto p = _source.find('\n'); p != std::string_view::npos; p = _source.find('\n', p + 1))
+            _line_starts.push_back(p + 1);
         _initialized = true;
-        _ptr = std::make_pair<int64_t, int64_t>(0, 0);
+        _ptr = 0;
+        _line = 0;
         return;
     }
 
-// Note: We allow this function to return a postion which is out of bound according to the design like std::vector::end().
-    std::pair<uint64_t, uint64_t> Tokenizer::nextPos() {
-        if (_ptr.first >= _lines_buffer.size())
-            DieAndPrint("advance after EOF");
-        if (_ptr.second == _lines_buffer[_ptr.first].size() - 1)
-            return std::make_pair(_ptr.first + 1, 0);
-        else
-            return std::make_pair(_ptr.first, _ptr.second + 1);
+    std::pair<uint64_t, uint64_t> Tokenizer::position(std::size_t offset) {
+        // 最后的 _line_starts.back() 是缓冲区的末尾所在的“行”
+        if (_line_starts[_line] > offset || (_line + 1 < _line_starts.size() && _line_starts[_line + 1] <= offset)) {
+            auto it = std::upper_bound(_line_starts.begin(), _line_starts.end(), offset);
+            _line = it - _line_starts.begin() - 1;
+        }
+        return std::make_pair(_line, offset - _line_starts[_line]);
     }
 
     std::pair<uint64_t, uint64_t> Tokenizer::currentPos() {
-        return _ptr;
+        return position(_ptr);
     }
 
     std::pair<uint64_t, uint64_t> Tokenizer::previousPos() {
-        if (_ptr.first == 0 && _ptr.second == 0)
+        if (_ptr == 0)
             DieAndPrint("previous position from beginning");
-        if (_ptr.second == 0)
-            return std::make_pair(_ptr.first - 1, _lines_buffer[_ptr.first - 1].size() - 1);
-        else
-            return std::make_pair(_ptr.first, _ptr.second - 1);
+        return position(_ptr - 1);
     }
 
     std::optional<char> Tokenizer::nextChar() {
         if (isEOF())
             return {}; // EOF
-        auto result = _lines_buffer[_ptr.first][_ptr.second];
-        _ptr = nextPos();
-        return result;
+        return _source[_ptr++];
     }
 
     bool Tokenizer::isEOF() {
-        return _ptr.first >= _lines_buffer.size();
+        return _ptr >= _source.size();
+    }
+
+    // 保留字 token 的值，与 keyword::Keywords 一一对应，不用驻留
+    static const std::string *keywordValue(std::size_t index) {
+        static const auto values = [] {
+            std::array<std::string, keyword::Count> re;
+            for (std::size_t i = 0; i < keyword::Count; i++)
+                re[i] = std::string(keyword::Keywords[i].name);
+            return re;
+        }();
+        return &values[index];
     }
 
     std::pair<std::optional<Token>, std::optional<CompilationError>>
-    Tokenizer::parseIdentifier(const std::string &str, std::pair<int64_t, int64_t> pos) {
-        if (str == "const")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::CONST, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "void")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::VOID, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "int")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::INT, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "char")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::CHAR, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "double")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::DOUBLE, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "struct")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::STRUCT, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "if")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::IF, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "else")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::ELSE, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "switch")
+    Tokenizer::parseIdentifier(std::string_view str, std::pair<int64_t, int64_t> pos) {
+        auto index = keyword::find(str);
+        if (index != keyword::Count)
             return std::make_pair(
-                    std::make_optional<Token>(TokenType::IF, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "case")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::CASE, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "default")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::DEFAULT, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "while")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::WHILE, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "for")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::FOR, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "for")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::FOR, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "do")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::DO, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "return")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::RETURN, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "break")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::BREAK, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "continue")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::CONTINUE, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "print")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::PRINT, str, pos, currentPos()),
-                    std::optional<CompilationError>());
-        if (str == "scan")
-            return std::make_pair(
-                    std::make_optional<Token>(TokenType::SCAN, str, pos, currentPos()),
+                    std::make_optional<Token>(keyword::Keywords[index].type, keywordValue(index), pos,
+                                              _ptr - str.size(), str.size()),
                     std::optional<CompilationError>());
         return std::make_pair(
-                std::make_optional<Token>(TokenType::IDENTIFIER, str, pos, currentPos()),
+                std::make_optional<Token>(TokenType::IDENTIFIER, intern(str), pos, _ptr - str.size(), str.size()),
                 std::optional<CompilationError>());
     }
 
+    const std::string *Tokenizer::intern(std::string_view str) {
+        auto it = _interned.find(str);
+        if (it != _interned.end())
+            return it->second;
+        auto &re = _strings.emplace_back(str);
+        _interned.emplace(re, &re);
+        return &re;
+    }
+
 // Note: Is it evil to unread a buffer?
     void Tokenizer::unreadLast() {
-        _ptr = previousPos();
+        if (_ptr == 0)
+            DieAndPrint("previous position from beginning");
+        --_ptr;
     }
 
 }
\ No newline at end of file
@@ -1,16 +1,21 @@
 #pragma once
 
 #include "tokenizer/token.h"
+#include "tokenizer/dfa.h"
 #include "tokenizer/utils.hpp"
 #include "error/error.h"
 
 #include <utility>
 #include <optional>
 #include <iostream>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <deque>
+#include <unordered_map>
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace cc0 {
 
@@ -18,81 +23,13 @@ namespace cc0 {
 	private:
 		using uint64_t = std::uint64_t;
 
-		// 状态机的所有状态
-		enum DFAState {
-			INITIAL_STATE,
-
-			// 数字部分
-			ZERO_STATE, // 0
-			HEX_STATE,
-			DEC_STATE, // 0-9
-			// todo double
-			DOUBLE_STATE,
-			DOUBLE_E_STATE,
-			DOT_STATE,
-
-			// +
-			PLUS_SIGN_STATE,
-
-			// -
-			MINUS_SIGN_STATE,
-
-			// *
-			MULTIPLICATION_SIGN_STATE,
-
-			// /
-			DIVISION_SIGN_STATE,
-			// TODO 注释 // /**/
-
-			// =
-			EQUAL_SIGN_STATE,
-            EQUAL_EQ_STATE, // == ?
-
-            // >
-			GREATER_SIGN_STATE,
-
-			// <
-			LESS_SIGN_STATE,
-
-			// !=
-			NOT_EQ_STATE,
-
-			// ;
-			SEMICOLON_STATE,
-
-            // ,
-            COMMA_STATE,
-
-			// ()
-			LEFT_PAREN_STATE,
-			RIGHT_PAREN_STATE,
-
-			// {}
-			LEFT_BRACE_STATE,
-			RIGHT_BRACE_STATE,
-
-			// :
-			COLON_STATE,
-
-			// "  String 直接处理转义符
-			STRING_STATE,
-
-			// ' char 直接处理转义符
-			CHAR_STATE,
-
-			// a-z A-Z 标识符 处理保留字
-            IDENTIFIER_STATE,
-
-            // 注释
-            COMMENT_ONE_STATE,
-            COMMENT_MORE_STATE
-
-		};
-
-
 	public:
+		// 第一次读 token 时读入全部输入
 		Tokenizer(std::istream& ifs)
-			: _rdr(ifs), _initialized(false), _ptr(0, 0),_lines_buffer() {}
+			: _rdr(&ifs), _initialized(false), _ptr(0), _line(0) {}
+		// 直接在 source 上读 token，不复制（没有以 \n 结尾时除外），source 必须比 Tokenizer 活得久
+		explicit Tokenizer(std::string_view source)
+			: _rdr(nullptr), _initialized(false), _source(source), _ptr(0), _line(0) {}
 		Tokenizer(Tokenizer&& tkz) = delete;
 		Tokenizer(const Tokenizer&) = delete;
 		Tokenizer& operator=(const Tokenizer&) = delete;
@@ -101,6 +38,8 @@ namespace cc0 {
 		std::pair<std::optional<Token>, std::optional<CompilationError>> NextToken();
 		// 一次返回所有 token
 		std::pair<std::vector<Token>, std::optional<CompilationError>> AllTokens();
+		// token 结束位置的 <行号，列号>，即 token 之后的第一个字符的位置
+		std::pair<uint64_t, uint64_t> GetEndPos(const Token& t) { return position(t.GetOffset() + t.GetLength()); }
 	private:
 		// 检查 Token 的合法性
 		std::optional<CompilationError> checkToken(const Token&);
@@ -110,42 +49,59 @@ namespace cc0 {
 		// 返回下一个 token，是 NextToken 实际实现部分
 		std::pair<std::optional<Token>, std::optional<CompilationError>> nextToken();
 
-		// 从这里开始其实是一个基于行号的缓冲区的实现
-		// 为了简单起见，我们没有单独拿出一个类实现
+		// 从这里开始是一块连续的缓冲区加一个偏移量的实现
 		// 核心思想和 C 的文件输入输出类似，就是一个 buffer 加一个指针，有三个细节
-		// 1.缓冲区包括 \n
+		// 1.缓冲区以 \n 结尾，输入的最后一行没有 \n 时补上
 		// 2.指针始终指向下一个要读取的 char
-		// 3.行号和列号从 0 开始
+		// 3.行号和列号从 0 开始，只在需要时由每行开头的偏移量算出
 
-		// 一次读入全部内容，并且替换所有换行为 \n
-		// 这样其实是不合理的，这里只是简单起见这么实现
+		// 准备缓冲区和每行开头的偏移量
 		void readAll();
 		// 一个简单的总结
-		// | 0 | 1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9  | 偏移
-		// | = | = | = | = | = | = | = | = | = | =  |
-		// | h | a | 1 | 9 | 2 | 6 | 0 | 8 | 1 | \n |（缓冲区第0行）
-		// | 7 | 1 | 1 | 4 | 5 | 1 | 4 |             （缓冲区第1行）
-		// 这里假设指针指向第一行的 \n，那么有
-		// nextPos() = (1, 0)
+		// | 0 | 1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9  | 10 | 11 | 12 | 13 | 14 | 15 | 16 | 17 | 偏移
+		// | h | a | 1 | 9 | 2 | 6 | 0 | 8 | 1 | \n | 7  | 1  | 1  | 4  | 5  | 1  | 4  | \n |
+		// 每行开头的偏移量为 0 10 18，最后的 18 是缓冲区的末尾
+		// 这里假设指针为 9，指向第一行的 \n，那么有
 		// currentPos() = (0, 9)
 		// previousPos() = (0, 8)
-		// nextChar() = '\n' 并且指针移动到 (1, 0)
-		// unreadLast() 指针移动到 (0, 8)
-		std::pair<uint64_t, uint64_t> nextPos();
+		// nextChar() = '\n' 并且指针移动到 10，即 (1, 0)
+		// unreadLast() 指针移动到 8
 		std::pair<uint64_t, uint64_t> currentPos();
 		std::pair<uint64_t, uint64_t> previousPos();
+		// 偏移量 offset 所在的 <行号，列号>，缓冲区的末尾为 (行数, 0)
+		std::pair<uint64_t, uint64_t> position(std::size_t offset);
 		std::optional<char> nextChar();
 		bool isEOF();
 		void unreadLast();
+		// 指针移动到 scanner 返回的位置，scanner 是 tokenizer/scan.h 中的函数
+		template <typename Scanner>
+		void advance(Scanner scanner) {
+			_ptr = scanner(_source.data() + _ptr, _source.data() + _source.size()) - _source.data();
+		}
 	private:
-		std::istream& _rdr;
+		// 构造时给出 source 时为 nullptr
+		std::istream* _rdr;
 		// 如果没有初始化，那么就 readAll
 		bool _initialized;
+		// 从 _rdr 读入的内容，或者补上 \n 的 source
+		std::string _storage;
+		// 缓冲区
+		std::string_view _source;
 		// 指向下一个要读取的字符
-		std::pair<uint64_t, uint64_t> _ptr;
-		// 以行为基础的缓冲区
-		std::vector<std::string> _lines_buffer;
+		std::size_t _ptr;
+		// 每行开头的偏移量，最后是缓冲区的长度
+		std::vector<std::size_t> _line_starts;
+		// 上一次 position 所在的行，token 是按顺序读的，通常不用二分查找
+		std::size_t _line;
+		// 驻留的字符串，deque 追加时不移动已有的元素，Token 中的指针一直有效
+		std::deque<std::string> _strings;
+		std::unordered_map<std::string_view, const std::string*> _interned;
+		// 返回与 str 相同的驻留字符串，没有时加入
+		const std::string* intern(std::string_view str);
         // 解析标识符
-        std::pair<std::optional<Token>, std::optional<CompilationError>> parseIdentifier(const std::string& str,std::pair<int64_t, int64_t> pos);
+        std::pair<std::optional<Token>, std::optional<CompilationError>> parseIdentifier(std::string_view str,std::pair<int64_t, int64_t> pos);
+        // 字符和字符串字面量，current_char 是引号之后的第一个字符
+        std::pair<std::optional<Token>, std::optional<CompilationError>> parseChar(std::optional<char> current_char, std::size_t start, std::pair<int64_t, int64_t> pos);
+        std::pair<std::optional<Token>, std::optional<CompilationError>> parseString(std::optional<char> current_char, std::size_t start, std::pair<int64_t, int64_t> pos);
     };
 }
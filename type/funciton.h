@@ -12,6 +12,7 @@ namespace cc0 {
     class Function final {
     private:
         using int32_t = std::int32_t;
+        using uint64_t = std::uint64_t;
 
     private:
         //name string in const table
@@ -24,6 +25,8 @@ namespace cc0 {
         // all var index
         int32_t _nextTokenIndex = 0;
         bool isfunction = true;
+        // 只有声明，函数体在其他文件中
+        bool _declaration = false;
         std::map<int32_t , CONST_TYPE> _params;
         CONST_TYPE _re_type;
 
@@ -70,6 +73,14 @@ namespace cc0 {
             return _re_type;
         }
 
+        bool isDeclaration() const {
+            return _declaration;
+        }
+
+        void setDeclaration(bool declaration) {
+            _declaration = declaration;
+        }
+
 
         const std::vector<Instruction> &getInstructions() const {
             return _instructions;
@@ -89,12 +100,20 @@ namespace cc0 {
             return true;
         };
 
-        void addInstruction(Operation op, int32_t x, int32_t y) {
+        // pos 为生成该指令时所分析的 token 的起始位置
+        void addInstruction(Operation op, int32_t x, int32_t y, std::pair<uint64_t, uint64_t> pos) {
             _instructions.emplace_back(op, x, y);
+            _positions.push_back(pos);
         }
 
-        void addInstruction(Operation op, int32_t x) {
+        void addInstruction(Operation op, int32_t x, std::pair<uint64_t, uint64_t> pos) {
             _instructions.emplace_back(op, x);
+            _positions.push_back(pos);
+        }
+
+        // 与 _instructions 一一对应的源码位置
+        const std::vector<std::pair<uint64_t, uint64_t>> &getPositions() const {
+            return _positions;
         }
 
 
@@ -103,7 +122,7 @@ namespace cc0 {
             return _name;
         }
 
-        Function(int32_t nameIndex, std::string &name, int32_t index, int32_t level, bool isFunction,
+        Function(int32_t nameIndex, const std::string &name, int32_t index, int32_t level, bool isFunction,
                 CONST_TYPE re_type) : _name_index(nameIndex), _index(index), _current_level(level), _name(name),
                                        isfunction(isFunction), _params({}),
                                        _re_type(re_type) {}
@@ -118,33 +137,33 @@ namespace cc0 {
 
         // 添加int char常量
         void addLocalConstant(const Token &tk, CONST_TYPE type) {
-            _allVar.addVar(tk.GetValueString(), type, _nextTokenIndex++, false, true);
+            _allVar.addVar(tk.GetString(), type, _nextTokenIndex++, false, true);
         }
 
 
         // 添加int char变量
         void addVariable(const Token &tk, CONST_TYPE type) {
-            _allVar.addVar(tk.GetValueString(), type, _nextTokenIndex++, false, false);
+            _allVar.addVar(tk.GetString(), type, _nextTokenIndex++, false, false);
         }
 
         // 添加int char未初始化变量
         void addUninitializedVariable(const Token &tk, CONST_TYPE type) {
-            _allVar.addVar(tk.GetValueString(), type, _nextTokenIndex++, true, false);
+            _allVar.addVar(tk.GetString(), type, _nextTokenIndex++, true, false);
         }
 
         // 添加double未初始化变量
         void addUninitializedDouble(const Token &tk,int32_t index) {
-            _allVar.addVar(tk.GetValueString(), D, index, true, false);
+            _allVar.addVar(tk.GetString(), D, index, true, false);
         }
 
         // 添加 double 已经初始化变量
         void addDouble(const Token &tk,int32_t index) {
-            _allVar.addVar(tk.GetValueString(), D, index, false, false);
+            _allVar.addVar(tk.GetString(), D, index, false, false);
         }
 
         // 添加 double 常量
         void addDoubleConst(const Token &tk,int32_t index) {
-            _allVar.addVar(tk.GetValueString(), D, index, false, true);
+            _allVar.addVar(tk.GetString(), D, index, false, true);
         }
 
         int32_t getInsLen() { return _instructions.size(); };
@@ -195,6 +214,7 @@ namespace cc0 {
 
     private:
         std::vector<Instruction> _instructions;
+        std::vector<std::pair<uint64_t, uint64_t>> _positions;
 
     };
 
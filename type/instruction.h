@@ -23,6 +23,7 @@ namespace cc0 {
         NEW,
         SNEW,
         POP,
+        POP2,
         DUP,
         TADD,
         IADD,
@@ -53,6 +54,7 @@ namespace cc0 {
         JG,
         JLE,
         CALL,
+        CALLNATIVE,
         RET,
         TRET,
         IRET,